@@ -0,0 +1,45 @@
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_DEF_STRING_TABLE_H
+#define LIBSTRING_DEF_STRING_TABLE_H
+
+
+#include <libtypes/types.h>
+#include <libmacro/logic.h>
+#include <libvec/def/vec-size.h>
+
+#include "string.h"
+
+
+// A `StringTable` holds a sequence of strings back-to-back in one `blob`.
+// The string at index `i` ends at `offsets.e[ i ]`, and starts where the
+// string before it ends (or at zero, for the first string).
+typedef struct stringtable {
+    StringM blob;
+    Vec_size offsets;
+} StringTable;
+
+#define STRINGTABLE_INVARIANTS( T ) \
+    IMPLIES( ( T ).offsets.length == 0, ( T ).blob.length == 0 ), \
+    IMPLIES( ( T ).offsets.length > 0, \
+             ( T ).offsets.e[ ( T ).offsets.length - 1 ] \
+                 == ( T ).blob.length )
+
+
+#endif
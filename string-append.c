@@ -0,0 +1,159 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-append.h"
+
+#include <errno.h>
+#include <stdatomic.h>  // atomic_*
+#include <stdlib.h>
+#include <string.h>     // memcpy
+#include <threads.h>    // thrd_yield
+
+#include <libmacro/assert.h>    // ASSERT
+
+
+// The state of the buffer is a single word, so that a producer's reserving
+// room and the consumer's swapping of segments are ordered by one atomic
+// operation: its top bit is the index of the active segment, and the rest
+// is the number of bytes reserved in it so far. That goes past the capacity
+// only by the one reservation that crosses it: producers stop adding to it
+// once it's there, so it stays under twice the capacity, and can't carry
+// into the top bit.
+#define SEGMENT_BIT ( ~( SIZE_MAX >> 1 ) )
+
+
+typedef struct segment {
+    char * e;
+    // The number of bytes that producers have finished with: copied into,
+    // or given up on, for the one reservation that crosses the capacity.
+    atomic_size_t committed;
+    // Where the records end, if a reservation crossed the capacity.
+    size_t end;
+} Segment;
+
+
+struct stringappendbuffer {
+    atomic_size_t state;
+    size_t capacity;
+    Segment segments[ 2 ];
+};
+
+
+StringAppendBuffer *
+stringappendbuffer__new(
+        size_t const capacity )
+{
+    ASSERT( capacity <= SIZE_MAX >> 2 );
+
+    StringAppendBuffer * const b = malloc( sizeof *b );
+    char * const e = malloc( ( capacity == 0 ) ? 1 : 2 * capacity );
+    if ( b == NULL || e == NULL ) {
+        free( b );
+        free( e );
+        errno = ENOMEM;
+        return NULL;
+    }
+    b->capacity = capacity;
+    atomic_init( &b->state, 0 );
+    for ( size_t i = 0; i < 2; i++ ) {
+        b->segments[ i ].e = e + i * capacity;
+        b->segments[ i ].end = capacity;
+        atomic_init( &b->segments[ i ].committed, 0 );
+    }
+    return b;
+}
+
+
+void
+stringappendbuffer__free(
+        StringAppendBuffer * const b )
+{
+    if ( b == NULL ) { return; }
+    free( b->segments[ 0 ].e );
+    free( b );
+}
+
+
+bool
+stringappendbuffer__append(
+        StringAppendBuffer * const b,
+        StringC const record )
+{
+    ASSERT( b != NULL, stringc__is_valid( record ) );
+
+    if ( record.length == 0 ) {
+        return true;
+    } else if ( record.length > b->capacity ) {
+        errno = EMSGSIZE;
+        return false;
+    }
+    // This acquires the reset of the segment by the swap that made it active:
+    size_t state = atomic_load_explicit( &b->state, memory_order_acquire );
+    do {
+        if ( ( state & ~SEGMENT_BIT ) >= b->capacity ) {
+            errno = ENOBUFS;
+            return false;
+        }
+    } while ( !atomic_compare_exchange_weak_explicit(
+                  &b->state, &state, state + record.length,
+                  memory_order_acquire, memory_order_acquire ) );
+    Segment * const s = &b->segments[ ( state & SEGMENT_BIT ) != 0 ];
+    size_t const offset = state & ~SEGMENT_BIT;
+    if ( record.length <= b->capacity - offset ) {
+        memcpy( s->e + offset, record.e, record.length );
+        atomic_fetch_add_explicit( &s->committed, record.length,
+                                   memory_order_release );
+        return true;
+    }
+    // This is the one reservation to cross the capacity, so it's where the
+    // records end:
+    s->end = offset;
+    atomic_fetch_add_explicit( &s->committed, b->capacity - offset,
+                               memory_order_release );
+    errno = ENOBUFS;
+    return false;
+}
+
+
+StringC
+stringappendbuffer__take(
+        StringAppendBuffer * const b )
+{
+    ASSERT( b != NULL );
+
+    size_t const active = atomic_load_explicit( &b->state,
+                                                memory_order_relaxed )
+                        & SEGMENT_BIT;
+    // Reset the inactive segment, which was returned by the last call:
+    Segment * const next = &b->segments[ active == 0 ];
+    next->end = b->capacity;
+    atomic_store_explicit( &next->committed, 0, memory_order_relaxed );
+    size_t const state = atomic_exchange_explicit( &b->state,
+                                                   active ^ SEGMENT_BIT,
+                                                   memory_order_acq_rel );
+    Segment * const s = &b->segments[ active != 0 ];
+    size_t const reserved = state & ~SEGMENT_BIT;
+    size_t const done = ( reserved < b->capacity ) ? reserved : b->capacity;
+    while ( atomic_load_explicit( &s->committed, memory_order_acquire )
+            != done ) {
+        thrd_yield();
+    }
+    return stringc__new( s->e, ( reserved < b->capacity ) ? reserved
+                                                          : s->end );
+}
@@ -0,0 +1,77 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_APPEND_H
+#define LIBSTRING_STRING_APPEND_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// An append buffer collects records from any number of producer threads
+// for a single consumer thread, like the lines of a shared log, without
+// locking. It has two segments of a fixed capacity: producers reserve room
+// in the active one with an atomic compare-and-swap, and copy their records
+// in, while the consumer takes the other. Taking swaps the segments over,
+// and waits for any producers still copying into the one that was active.
+//
+// Each record is kept whole and contiguous, but records from different
+// threads are in the order they reserved their room, which needn't be the
+// order they were appended in.
+typedef struct stringappendbuffer StringAppendBuffer;
+
+
+// Returns a new append buffer whose segments can hold `capacity` bytes
+// each, which must be at most a quarter of `SIZE_MAX`. If memory can't be
+// allocated, this sets `errno` to `ENOMEM` and returns `NULL`.
+StringAppendBuffer *
+stringappendbuffer__new(
+        size_t capacity );
+
+
+// Frees the buffer, which no thread may be using.
+void
+stringappendbuffer__free(
+        StringAppendBuffer * );
+
+
+// Copies `record` into the active segment, and returns true. This can be
+// called from any number of threads at once. If there isn't room for it in
+// the active segment, this sets `errno` to `ENOBUFS` and returns false,
+// and the record can be appended again once the consumer has taken the
+// segment. A record longer than the capacity of a segment can never fit:
+// for those, this sets `errno` to `EMSGSIZE` and returns false.
+bool
+stringappendbuffer__append(
+        StringAppendBuffer *,
+        StringC record );
+
+
+// Takes the records appended since the last call, and returns a view of
+// them, which is valid until the next call. This must only be called from
+// one thread at a time. It doesn't block producers, but it waits for those
+// that have reserved room in the taken segment to finish copying into it.
+StringC
+stringappendbuffer__take(
+        StringAppendBuffer * );
+
+
+#endif
@@ -0,0 +1,295 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "string-file.h"
+
+#include <errno.h>
+#include <fcntl.h>      // open, O_*
+#include <limits.h>     // SSIZE_MAX
+#include <string.h>     // memcpy
+#include <sys/stat.h>   // fstat, S_ISREG
+#include <threads.h>    // thrd_*
+#include <unistd.h>     // close, lseek, pread, read
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/minmax.h>    // MAX, MIN
+
+
+#ifdef STRING_RESERVE_NULL
+#define RESERVED 1
+#else
+#define RESERVED 0
+#endif
+
+// When `stringm__read_fd()` has to grow the string, it makes room for at
+// least this many more bytes.
+#define READ_MIN_SPARE ( 64 * 1024 )
+
+// When there's no spare capacity, `stringm__read_fd()` first reads up to
+// this many bytes onto the stack, to see if there's more to read before it
+// grows the string.
+#define READ_PROBE 4096
+
+// The most bytes asked of a single call to `read()` or `pread()`.
+#define READ_MAX ( MIN( ( size_t ) SSIZE_MAX, ( size_t ) 1 << 30 ) )
+
+#define READ_MAX_THREADS 64
+
+
+
+static
+size_t
+spare_capacity(
+        StringM const s )
+{
+    return s.capacity - s.length - ( s.capacity > s.length ? RESERVED : 0 );
+}
+
+
+static
+void
+finish(
+        StringM * const s )
+{
+    if ( RESERVED && s->capacity > 0 ) {
+        stringm__terminate( s );
+    }
+}
+
+
+// Reads from `fd` into a buffer on the stack, and only grows `*s` to take
+// what was read if there was something, so that a string that was sized to
+// fit all there is to read doesn't grow just to find that out. Returns as
+// `read()` does.
+static
+ssize_t
+read_growing(
+        StringM * const s,
+        int const fd )
+{
+    char probe[ READ_PROBE ];
+    ssize_t const r = read( fd, probe, sizeof probe );
+    if ( r <= 0 ) { return r; }
+    errno = 0;
+    stringm__grow_capacity_for( s, MAX( ( size_t ) r,
+                                        ( size_t ) READ_MIN_SPARE ) );
+    if ( errno ) { return -1; }
+    memcpy( s->e + s->length, probe, ( size_t ) r );
+    s->length += ( size_t ) r;
+    return r;
+}
+
+
+void
+stringm__read_fd(
+        StringM * const s,
+        int const fd )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), fd >= 0 );
+
+    while ( true ) {
+        ssize_t r;
+        if ( spare_capacity( *s ) == 0 ) {
+            r = read_growing( s, fd );
+        } else {
+            r = read( fd, s->e + s->length,
+                      MIN( spare_capacity( *s ), READ_MAX ) );
+            if ( r > 0 ) {
+                s->length += ( size_t ) r;
+            }
+        }
+        if ( r == 0 || ( r < 0 && errno != EINTR ) ) {
+            break;
+        } else if ( r < 0 ) {
+            errno = 0;
+        }
+    }
+    finish( s );
+}
+
+
+typedef struct read_job {
+    int fd;
+    char * e;
+    size_t begin;
+    size_t end;
+    // How many bytes were read, and the error that stopped the reads short
+    // of `end`, if any (or zero if the end of the file was reached first):
+    size_t length;
+    int error;
+} ReadJob;
+
+
+static
+int
+read_job__run(
+        void * const arg )
+{
+    ReadJob * const job = arg;
+    while ( job->begin + job->length < job->end ) {
+        size_t const offset = job->begin + job->length;
+        ssize_t const r = pread( job->fd, job->e + offset,
+                                 MIN( job->end - offset, READ_MAX ),
+                                 ( off_t ) offset );
+        if ( r > 0 ) {
+            job->length += ( size_t ) r;
+        } else if ( r == 0 ) {
+            break;
+        } else if ( errno != EINTR ) {
+            job->error = errno;
+            break;
+        }
+    }
+    return 0;
+}
+
+
+// Reads the first `size` bytes of `fd` into `e` in `n` chunks, all but the
+// first on threads of their own. Returns how many bytes were read before
+// the first chunk that came up short, and sets `errno` if that was due to
+// an error.
+static
+size_t
+read_chunks(
+        int const fd,
+        char * const e,
+        size_t const size,
+        size_t const n )
+{
+    ReadJob jobs[ READ_MAX_THREADS ];
+    thrd_t ts[ READ_MAX_THREADS ];
+    bool started[ READ_MAX_THREADS ] = { false };
+    size_t const chunk = size / n;
+    for ( size_t i = 0; i < n; i++ ) {
+        jobs[ i ] = ( ReadJob ){
+            .fd = fd,
+            .e = e,
+            .begin = i * chunk,
+            .end = ( i == n - 1 ) ? size : ( i + 1 ) * chunk
+        };
+    }
+    for ( size_t i = 1; i < n; i++ ) {
+        started[ i ] = thrd_create( &ts[ i ], read_job__run, &jobs[ i ] )
+                       == thrd_success;
+    }
+    read_job__run( &jobs[ 0 ] );
+    for ( size_t i = 1; i < n; i++ ) {
+        if ( started[ i ] ) {
+            thrd_join( ts[ i ], NULL );
+        } else {
+            read_job__run( &jobs[ i ] );
+        }
+    }
+    size_t length = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        length += jobs[ i ].length;
+        if ( jobs[ i ].begin + jobs[ i ].length < jobs[ i ].end ) {
+            errno = jobs[ i ].error;
+            break;
+        }
+    }
+    return length;
+}
+
+
+// Appends the contents of `fd` to `*s`, reading the `size` bytes that it's
+// known to have in `n` chunks. Returns false if a read failed.
+static
+bool
+read_sized(
+        StringM * const s,
+        int const fd,
+        size_t const size,
+        size_t const n )
+{
+    if ( size > 0 ) {
+        errno = 0;
+        stringm__grow_capacity_for( s, size );
+        if ( errno ) { return false; }
+    }
+    if ( n <= 1 ) {
+        stringm__read_fd( s, fd );
+        return errno == 0;
+    }
+    errno = 0;
+    size_t const length = read_chunks( fd, s->e + s->length, size, n );
+    if ( errno ) { return false; }
+    s->length += length;
+    if ( length < size ) {
+        finish( s );
+        return true;
+    }
+    // Read anything that was appended to the file after it was sized:
+    if ( lseek( fd, ( off_t ) size, SEEK_SET ) == -1 ) { return false; }
+    stringm__read_fd( s, fd );
+    return errno == 0;
+}
+
+
+void
+stringm__read_file_parallel(
+        StringM * const s,
+        char const * const path,
+        size_t const threads )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), path != NULL );
+
+    int const fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd == -1 ) { return; }
+    struct stat st;
+    if ( fstat( fd, &st ) == -1 ) {
+        int const error = errno;
+        close( fd );
+        errno = error;
+        return;
+    }
+    // Files without a size, like pipes and many of those in `/proc`, can
+    // only be read until they end:
+    size_t size = 0;
+    if ( S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+        size = ( ( uintmax_t ) st.st_size > SIZE_MAX - s->length )
+             ? SIZE_MAX - s->length
+             : ( size_t ) st.st_size;
+    }
+    size_t const n = MIN( MIN( threads, size / STRING_PARALLEL_MIN_CHUNK ),
+                          ( size_t ) READ_MAX_THREADS );
+    size_t const length = s->length;
+    errno = 0;
+    bool const ok = read_sized( s, fd, size, n );
+    int const error = errno;
+    close( fd );
+    if ( !ok ) {
+        s->length = length;
+        finish( s );
+        errno = error;
+    }
+}
+
+
+void
+stringm__read_file(
+        StringM * const s,
+        char const * const path )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), path != NULL );
+
+    stringm__read_file_parallel( s, path, 1 );
+}
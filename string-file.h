@@ -0,0 +1,61 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_FILE_H
+#define LIBSTRING_STRING_FILE_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// Appends everything that can be read from the file descriptor `fd` to
+// `*s`, reading straight into its spare capacity, and growing it as needed.
+// If a read fails, this sets `errno` and stops, keeping what was read
+// before it.
+void
+stringm__read_fd(
+        StringM * s,
+        int fd );
+
+
+// Appends the contents of the file at `path` to `*s`. The file's size is
+// taken from `fstat()` up front, so that the string grows once to fit it
+// (unless the file grows in the meantime). If the file can't be opened or
+// read, this sets `errno` and leaves `*s` with its old contents.
+void
+stringm__read_file(
+        StringM * s,
+        char const * path );
+
+
+// Like `stringm__read_file()`, but reads the file with `pread()` in at most
+// `threads` chunks of at least `STRING_PARALLEL_MIN_CHUNK` bytes, each on
+// its own thread. This pays off for large files on storage that serves
+// concurrent reads faster than sequential ones, like SSDs and page-cached
+// files.
+void
+stringm__read_file_parallel(
+        StringM * s,
+        char const * path,
+        size_t threads );
+
+
+#endif
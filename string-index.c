@@ -0,0 +1,617 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-index.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>     // memcmp, memcpy
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/logic.h>     // IMPLIES
+#include <libmacro/minmax.h>    // MAX
+#include <libvec/vec-size.h>
+
+#include "string-table.h"
+
+
+// The sort keys used to build an index hold a trigram in their top 24 bits,
+// and a string's index in the rest.
+#define GRAM_SHIFT 40
+
+
+struct stringindex {
+    StringTable strings;
+    size_t grams;
+    // The distinct trigrams in increasing order, how many strings contain
+    // each of them, and where each one's postings start in `postings` (with
+    // one more offset, for where the last one's end):
+    uint32_t * keys;
+    size_t * counts;
+    size_t * offsets;
+    // The indices of the strings containing each trigram, in increasing
+    // order, as varints of the differences from the index before:
+    unsigned char * postings;
+};
+
+
+
+///////////////////////////////////
+/// TRIGRAMS AND POSTINGS
+///////////////////////////////////
+
+
+static
+uint32_t
+gram_at(
+        char const * const xs )
+{
+    return ( uint32_t ) ( unsigned char ) xs[ 0 ] << 16
+         | ( uint32_t ) ( unsigned char ) xs[ 1 ] << 8
+         | ( uint32_t ) ( unsigned char ) xs[ 2 ];
+}
+
+
+static
+size_t
+grams_in(
+        StringC const s )
+{
+    return ( s.length < 3 ) ? 0 : s.length - 2;
+}
+
+
+static
+size_t
+varint_length(
+        size_t x )
+{
+    size_t n = 1;
+    while ( x >= 0x80 ) {
+        x >>= 7;
+        n++;
+    }
+    return n;
+}
+
+
+static
+unsigned char *
+put_varint(
+        unsigned char * p,
+        size_t x )
+{
+    while ( x >= 0x80 ) {
+        *p++ = ( unsigned char ) ( x | 0x80 );
+        x >>= 7;
+    }
+    *p++ = ( unsigned char ) x;
+    return p;
+}
+
+
+// Steps through the posting list of a trigram, from `id` being the first
+// index in it.
+typedef struct cursor {
+    unsigned char const * p;
+    size_t left;
+    size_t id;
+} Cursor;
+
+
+static
+bool
+cursor__next(
+        Cursor * const c )
+{
+    if ( c->left == 0 ) {
+        return false;
+    }
+    size_t delta = 0;
+    unsigned shift = 0;
+    unsigned char b;
+    do {
+        b = *c->p++;
+        delta |= ( size_t ) ( b & 0x7F ) << shift;
+        shift += 7;
+    } while ( b & 0x80 );
+    c->id += delta;
+    c->left--;
+    return true;
+}
+
+
+static
+Cursor
+cursor__open(
+        StringIndex const * const idx,
+        size_t const slot )
+{
+    Cursor c = { .p = idx->postings + idx->offsets[ slot ],
+                 .left = idx->counts[ slot ] };
+    cursor__next( &c );
+    return c;
+}
+
+
+// Returns the slot of `gram` in the index, or `SIZE_MAX` if no string
+// contains it.
+static
+size_t
+find_gram(
+        StringIndex const * const idx,
+        uint32_t const gram )
+{
+    size_t lo = 0;
+    size_t hi = idx->grams;
+    while ( lo < hi ) {
+        size_t const mid = lo + ( hi - lo ) / 2;
+        if ( idx->keys[ mid ] < gram ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return ( lo < idx->grams && idx->keys[ lo ] == gram ) ? lo : SIZE_MAX;
+}
+
+
+static
+size_t
+key_id(
+        uint64_t const key )
+{
+    return key & ( ( UINT64_C( 1 ) << GRAM_SHIFT ) - 1 );
+}
+
+
+static
+bool
+same_gram(
+        uint64_t const x,
+        uint64_t const y )
+{
+    return x >> GRAM_SHIFT == y >> GRAM_SHIFT;
+}
+
+
+// Sorts `keys` by their trigrams, keeping the order of keys with the same
+// trigram, with a byte-wise radix sort through `tmp`.
+static
+void
+sort_keys(
+        uint64_t * const keys,
+        uint64_t * const tmp,
+        size_t const n )
+{
+    uint64_t * from = keys;
+    uint64_t * to = tmp;
+    for ( unsigned shift = GRAM_SHIFT; shift < 64; shift += 8 ) {
+        size_t starts[ 256 ] = { 0 };
+        for ( size_t i = 0; i < n; i++ ) {
+            starts[ ( from[ i ] >> shift ) & 0xFF ]++;
+        }
+        size_t total = 0;
+        for ( size_t b = 0; b < 256; b++ ) {
+            size_t const count = starts[ b ];
+            starts[ b ] = total;
+            total += count;
+        }
+        for ( size_t i = 0; i < n; i++ ) {
+            to[ starts[ ( from[ i ] >> shift ) & 0xFF ]++ ] = from[ i ];
+        }
+        uint64_t * const swap = from;
+        from = to;
+        to = swap;
+    }
+    if ( from != keys && n > 0 ) {
+        memcpy( keys, from, n * sizeof *keys );
+    }
+}
+
+
+
+///////////////////////////////////
+/// BUILDING
+///////////////////////////////////
+
+
+// Fills in the trigram tables of `idx` from `keys`, sorted by `sort_keys()`,
+// which may hold duplicates.
+static
+void
+build_postings(
+        StringIndex * const idx,
+        uint64_t const * const keys,
+        size_t const n )
+{
+    size_t grams = 0;
+    size_t bytes = 0;
+    for ( size_t i = 0, prev = 0; i < n; i++ ) {
+        size_t const id = key_id( keys[ i ] );
+        if ( i == 0 || !same_gram( keys[ i ], keys[ i - 1 ] ) ) {
+            grams++;
+            bytes += varint_length( id );
+        } else if ( keys[ i ] != keys[ i - 1 ] ) {
+            bytes += varint_length( id - prev );
+        }
+        prev = id;
+    }
+    idx->keys = malloc( MAX( grams, 1 ) * sizeof *idx->keys );
+    idx->counts = malloc( MAX( grams, 1 ) * sizeof *idx->counts );
+    idx->offsets = malloc( ( grams + 1 ) * sizeof *idx->offsets );
+    idx->postings = malloc( MAX( bytes, 1 ) );
+    if ( idx->keys == NULL || idx->counts == NULL || idx->offsets == NULL
+      || idx->postings == NULL ) {
+        errno = ENOMEM;
+        return;
+    }
+    unsigned char * p = idx->postings;
+    size_t g = SIZE_MAX;
+    for ( size_t i = 0, prev = 0; i < n; i++ ) {
+        size_t const id = key_id( keys[ i ] );
+        if ( i == 0 || !same_gram( keys[ i ], keys[ i - 1 ] ) ) {
+            g++;
+            idx->keys[ g ] = ( uint32_t ) ( keys[ i ] >> GRAM_SHIFT );
+            idx->counts[ g ] = 1;
+            idx->offsets[ g ] = ( size_t ) ( p - idx->postings );
+            p = put_varint( p, id );
+        } else if ( keys[ i ] != keys[ i - 1 ] ) {
+            idx->counts[ g ]++;
+            p = put_varint( p, id - prev );
+        }
+        prev = id;
+    }
+    idx->offsets[ grams ] = bytes;
+    idx->grams = grams;
+}
+
+
+// Copies the `n` strings of `xs` into `idx`, and builds its trigram tables.
+static
+void
+build(
+        StringIndex * const idx,
+        StringC const * const xs,
+        size_t const n )
+{
+    size_t total = 0;
+    size_t grams = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        ASSERT( stringc__is_valid( xs[ i ] ) );
+        total += xs[ i ].length;
+        grams += grams_in( xs[ i ] );
+    }
+    errno = 0;
+    idx->strings = stringtable__new_empty( n, total );
+    if ( errno ) { return; }
+    stringtable__extend( &idx->strings, xs, n );
+    if ( errno ) { return; }
+    uint64_t * const keys = malloc( MAX( grams, 1 ) * 2 * sizeof *keys );
+    if ( keys == NULL || n >> GRAM_SHIFT != 0 ) {
+        free( keys );
+        errno = ENOMEM;
+        return;
+    }
+    size_t k = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        for ( size_t j = 0; j < grams_in( xs[ i ] ); j++ ) {
+            keys[ k++ ] = ( uint64_t ) gram_at( xs[ i ].e + j ) << GRAM_SHIFT
+                        | i;
+        }
+    }
+    sort_keys( keys, keys + grams, grams );
+    build_postings( idx, keys, grams );
+    free( keys );
+}
+
+
+StringIndex *
+stringindex__new(
+        StringC const * const xs,
+        size_t const n )
+{
+    ASSERT( IMPLIES( xs == NULL, n == 0 ) );
+
+    StringIndex * const idx = calloc( 1, sizeof *idx );
+    if ( idx == NULL ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    errno = 0;
+    build( idx, xs, n );
+    if ( errno ) {
+        stringindex__free( idx );
+        errno = ENOMEM;
+        return NULL;
+    }
+    return idx;
+}
+
+
+void
+stringindex__free(
+        StringIndex * const idx )
+{
+    if ( idx == NULL ) {
+        return;
+    }
+    stringtable__free( &idx->strings );
+    free( idx->keys );
+    free( idx->counts );
+    free( idx->offsets );
+    free( idx->postings );
+    free( idx );
+}
+
+
+size_t
+stringindex__length(
+        StringIndex const * const idx )
+{
+    ASSERT( idx != NULL );
+
+    return stringtable__length( idx->strings );
+}
+
+
+StringC
+stringindex__get(
+        StringIndex const * const idx,
+        size_t const index )
+{
+    ASSERT( idx != NULL, index < stringindex__length( idx ) );
+
+    return stringtable__get( idx->strings, index );
+}
+
+
+
+///////////////////////////////////
+/// QUERYING
+///////////////////////////////////
+
+
+static
+int
+compare_sizes(
+        void const * const x,
+        void const * const y )
+{
+    size_t const a = *( size_t const * ) x;
+    size_t const b = *( size_t const * ) y;
+    return ( a > b ) - ( a < b );
+}
+
+
+// Sets `slots` to the distinct slots of the trigrams of `s` that are in the
+// index, and returns how many there are. `*missing` is set to whether any
+// trigram of `s` isn't in the index.
+static
+size_t
+query_slots(
+        StringIndex const * const idx,
+        StringC const s,
+        size_t * const slots,
+        bool * const missing )
+{
+    size_t n = 0;
+    *missing = false;
+    for ( size_t i = 0; i < grams_in( s ); i++ ) {
+        size_t const slot = find_gram( idx, gram_at( s.e + i ) );
+        if ( slot == SIZE_MAX ) {
+            *missing = true;
+        } else {
+            slots[ n++ ] = slot;
+        }
+    }
+    qsort( slots, n, sizeof *slots, compare_sizes );
+    size_t distinct = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( distinct == 0 || slots[ i ] != slots[ distinct - 1 ] ) {
+            slots[ distinct++ ] = slots[ i ];
+        }
+    }
+    return distinct;
+}
+
+
+static
+bool
+contains(
+        StringC const s,
+        StringC const needle )
+{
+    return needle.length == 0 || stringc__find( s, needle, 0 ) != SIZE_MAX;
+}
+
+
+void
+stringindex__containing(
+        StringIndex const * const idx,
+        StringC const needle,
+        Vec_size * const ids )
+{
+    ASSERT( idx != NULL, stringc__is_valid( needle ), ids != NULL );
+
+    size_t const n = stringindex__length( idx );
+    if ( grams_in( needle ) == 0 ) {
+        for ( size_t i = 0; i < n; i++ ) {
+            if ( contains( stringindex__get( idx, i ), needle ) ) {
+                errno = 0;
+                vec_size__append( ids, i );
+                if ( errno ) { return; }
+            }
+        }
+        return;
+    }
+    size_t * const slots = malloc( grams_in( needle ) * sizeof *slots );
+    if ( slots == NULL ) {
+        errno = ENOMEM;
+        return;
+    }
+    bool missing;
+    size_t const m = query_slots( idx, needle, slots, &missing );
+    size_t shortest = 0;
+    for ( size_t i = 1; i < m; i++ ) {
+        if ( idx->counts[ slots[ i ] ] < idx->counts[ slots[ shortest ] ] ) {
+            shortest = i;
+        }
+    }
+    size_t * const cands = missing ? NULL
+                         : malloc( idx->counts[ slots[ shortest ] ]
+                                   * sizeof *cands );
+    if ( !missing && cands == NULL ) {
+        free( slots );
+        errno = ENOMEM;
+        return;
+    }
+    // Intersect the posting lists, starting from the shortest:
+    size_t count = 0;
+    if ( !missing ) {
+        for ( Cursor c = cursor__open( idx, slots[ shortest ] );
+              count < idx->counts[ slots[ shortest ] ];
+              cursor__next( &c ) ) {
+            cands[ count++ ] = c.id;
+        }
+    }
+    for ( size_t s = 0; s < m && count > 0; s++ ) {
+        if ( s == shortest ) {
+            continue;
+        }
+        Cursor c = cursor__open( idx, slots[ s ] );
+        bool more = true;
+        size_t kept = 0;
+        for ( size_t i = 0; i < count && more; i++ ) {
+            while ( more && c.id < cands[ i ] ) {
+                more = cursor__next( &c );
+            }
+            if ( more && c.id == cands[ i ] ) {
+                cands[ kept++ ] = cands[ i ];
+            }
+        }
+        count = kept;
+    }
+    free( slots );
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( contains( stringindex__get( idx, cands[ i ] ), needle ) ) {
+            errno = 0;
+            vec_size__append( ids, cands[ i ] );
+            if ( errno ) { break; }
+        }
+    }
+    free( cands );
+}
+
+
+// Appends `id` to `ids` if the string at `id` is within `k` of `query`;
+// returns false if that fails.
+static
+bool
+check_distance(
+        StringIndex const * const idx,
+        size_t const id,
+        StringC const query,
+        size_t const k,
+        Vec_size * const ids )
+{
+    StringC const s = stringindex__get( idx, id );
+    size_t const diff = ( s.length > query.length ) ? s.length - query.length
+                                                    : query.length - s.length;
+    if ( diff > k ) {
+        return true;
+    }
+    errno = 0;
+    if ( stringc__within_distance( s, query, k ) ) {
+        vec_size__append( ids, id );
+    }
+    return errno == 0;
+}
+
+
+void
+stringindex__within_distance(
+        StringIndex const * const idx,
+        StringC const query,
+        size_t const k,
+        Vec_size * const ids )
+{
+    ASSERT( idx != NULL, stringc__is_valid( query ), ids != NULL );
+
+    size_t const n = stringindex__length( idx );
+    size_t * const slots = malloc( MAX( grams_in( query ), 1 )
+                                   * sizeof *slots );
+    if ( slots == NULL ) {
+        errno = ENOMEM;
+        return;
+    }
+    bool missing;
+    size_t const m = query_slots( idx, query, slots, &missing );
+    // Count the distinct trigrams of the query, whether indexed or not, to
+    // know how many a string within `k` edits of it must have:
+    size_t distinct = 0;
+    for ( size_t i = 0; i < grams_in( query ); i++ ) {
+        bool seen = false;
+        for ( size_t j = 0; j < i && !seen; j++ ) {
+            seen = memcmp( query.e + i, query.e + j, 3 ) == 0;
+        }
+        distinct += !seen;
+    }
+    size_t const needed = ( k < distinct / 3 ) ? distinct - 3 * k : 0;
+    if ( needed == 0 ) {
+        free( slots );
+        for ( size_t i = 0; i < n; i++ ) {
+            if ( !check_distance( idx, i, query, k, ids ) ) { return; }
+        }
+        return;
+    }
+    // Gather the posting lists, and count how many lists each index is in:
+    size_t total = 0;
+    for ( size_t s = 0; s < m; s++ ) {
+        total += idx->counts[ slots[ s ] ];
+    }
+    size_t * const all = malloc( MAX( total, 1 ) * sizeof *all );
+    if ( all == NULL ) {
+        free( slots );
+        errno = ENOMEM;
+        return;
+    }
+    size_t count = 0;
+    for ( size_t s = 0; s < m; s++ ) {
+        Cursor c = cursor__open( idx, slots[ s ] );
+        for ( size_t i = 0; i < idx->counts[ slots[ s ] ]; i++ ) {
+            all[ count++ ] = c.id;
+            cursor__next( &c );
+        }
+    }
+    free( slots );
+    qsort( all, count, sizeof *all, compare_sizes );
+    for ( size_t i = 0; i < count; ) {
+        size_t j = i + 1;
+        while ( j < count && all[ j ] == all[ i ] ) {
+            j++;
+        }
+        if ( j - i >= needed && !check_distance( idx, all[ i ], query, k,
+                                                  ids ) ) {
+            break;
+        }
+        i = j;
+    }
+    free( all );
+}
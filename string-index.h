@@ -0,0 +1,89 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_INDEX_H
+#define LIBSTRING_STRING_INDEX_H
+
+
+#include <libtypes/types.h>
+#include <libvec/def/vec-size.h>
+
+#include "string.h"
+
+
+// An index over a set of strings, for finding those that contain a given
+// substring or are within a given edit distance of a query without looking
+// at every one of them. It maps each trigram (three consecutive bytes) to
+// the sorted list of the strings that contain it, stored as delta-encoded
+// varints. Queries intersect or count those lists to find candidates, and
+// then check each candidate; queries too short to have trigrams to go by
+// check every string. An index is immutable once built, so it can be
+// queried by any number of threads at once.
+typedef struct stringindex StringIndex;
+
+
+// Builds an index over copies of the `n` strings of `xs`; the string at
+// index `i` is identified by `i` in query results. If memory can't be
+// allocated, this sets `errno` to `ENOMEM` and returns `NULL`.
+StringIndex *
+stringindex__new(
+        StringC const * xs,
+        size_t n );
+
+
+void
+stringindex__free(
+        StringIndex * );
+
+
+size_t
+stringindex__length(
+        StringIndex const * );
+
+
+StringC
+stringindex__get(
+        StringIndex const *,
+        size_t index );
+
+
+// Appends to `*ids`, in increasing order, the indices of the strings that
+// contain `needle`. If memory can't be allocated, this sets `errno` to
+// `ENOMEM`, having appended some of them.
+void
+stringindex__containing(
+        StringIndex const *,
+        StringC needle,
+        Vec_size * ids );
+
+
+// Appends to `*ids`, in increasing order, the indices of the strings whose
+// Levenshtein distance from `query` is at most `k`. Candidates are those
+// sharing enough of the trigrams of `query`: each edit can remove at most
+// three of them. If memory can't be allocated, this sets `errno` to
+// `ENOMEM`, having appended some of them.
+void
+stringindex__within_distance(
+        StringIndex const *,
+        StringC query,
+        size_t k,
+        Vec_size * ids );
+
+
+#endif
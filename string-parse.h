@@ -0,0 +1,71 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_PARSE_H
+#define LIBSTRING_STRING_PARSE_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// The parsing functions parse the number at the start of `xs` into `*out`,
+// and return the number of bytes of `xs` that it took up; unlike `strtol()`
+// and `strtod()`, they don't need `xs` to be null-terminated, and they
+// don't skip leading whitespace. If `xs` doesn't start with a number, they
+// set `errno` to `EINVAL`, leave `*out` as it was, and return 0. If the
+// number is out of range, they set `errno` to `ERANGE`, set `*out` to the
+// nearest value in range, and return its length all the same.
+//
+// The integer functions take decimal digits, with an optional leading `+`
+// or `-` for `stringc__parse_i64()`. `stringc__parse_hex_u64()` takes
+// hexadecimal digits of either case, without a `0x` prefix.
+size_t
+stringc__parse_u64(
+        StringC xs,
+        uint64_t * out );
+
+
+size_t
+stringc__parse_i64(
+        StringC xs,
+        int64_t * out );
+
+
+size_t
+stringc__parse_hex_u64(
+        StringC xs,
+        uint64_t * out );
+
+
+// Parses a decimal floating-point number, with an optional sign, fraction
+// and exponent, or `inf`, `infinity` or `nan` in any case, and rounds it
+// to the nearest `double`, as `strtod()` does in the "C" locale. Numbers
+// that are too large are parsed as infinity, and those too small as zero.
+// Very long or borderline numbers are handed to `strtod()` to be rounded
+// exactly, which may set `errno` to `ENOMEM` if they need copying to the
+// heap to be null-terminated.
+size_t
+stringc__parse_double(
+        StringC xs,
+        double * out );
+
+
+#endif
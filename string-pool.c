@@ -0,0 +1,252 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-pool.h"
+
+#include <threads.h>    // call_once, mtx_*, tss_*
+
+#include <libmacro/assert.h>    // ASSERT
+
+
+#ifdef STRING_RESERVE_NULL
+#define RESERVED 1
+#else
+#define RESERVED 0
+#endif
+
+
+// Buffers are pooled in classes by the floor of the base-2 logarithm of their
+// capacity, starting from 64 bytes.
+#define MIN_CLASS 6
+#define CLASSES   26
+
+_Static_assert( STRING_POOL_MAX_CAPACITY
+                    <= ( ( size_t ) 1 << ( MIN_CLASS + CLASSES - 1 ) ),
+                "STRING_POOL_MAX_CAPACITY needs too many capacity classes" );
+_Static_assert( STRING_POOL_THREAD_BUFFERS >= 2,
+                "STRING_POOL_THREAD_BUFFERS must be at least 2" );
+
+
+typedef struct thread_cache {
+    StringM buffers[ CLASSES ][ STRING_POOL_THREAD_BUFFERS ];
+    size_t counts[ CLASSES ];
+    bool registered;
+} ThreadCache;
+
+
+static _Thread_local ThreadCache thread_cache;
+
+
+static struct {
+    StringM buffers[ CLASSES ][ STRING_POOL_GLOBAL_BUFFERS ];
+    size_t counts[ CLASSES ];
+} global;
+
+static mtx_t global_lock;
+static tss_t thread_key;
+static bool initialized;
+static once_flag init_flag = ONCE_FLAG_INIT;
+
+
+
+static
+void
+move_to_global(
+        ThreadCache * const c,
+        size_t const class,
+        size_t const keep );
+
+
+static
+void
+flush_thread(
+        void * const cache )
+{
+    ThreadCache * const c = cache;
+    for ( size_t class = 0; class < CLASSES; class++ ) {
+        move_to_global( c, class, 0 );
+    }
+    // In case the thread uses the pool again in another destructor:
+    c->registered = false;
+}
+
+
+static
+void
+init( void )
+{
+    if ( mtx_init( &global_lock, mtx_plain ) != thrd_success ) { return; }
+    if ( tss_create( &thread_key, flush_thread ) != thrd_success ) {
+        mtx_destroy( &global_lock );
+        return;
+    }
+    initialized = true;
+}
+
+
+// Returns true if the global list can be used, after registering the
+// calling thread's cache to be flushed to it when the thread exits.
+static
+bool
+use_global( void )
+{
+    call_once( &init_flag, init );
+    if ( initialized && !thread_cache.registered ) {
+        thread_cache.registered =
+            tss_set( thread_key, &thread_cache ) == thrd_success;
+    }
+    return initialized;
+}
+
+
+// Moves all but `keep` of the thread's buffers of `class` to the global
+// list, and frees those that don't fit.
+static
+void
+move_to_global(
+        ThreadCache * const c,
+        size_t const class,
+        size_t const keep )
+{
+    size_t n = c->counts[ class ];
+    if ( n > keep && use_global() ) {
+        mtx_lock( &global_lock );
+        while ( n > keep
+             && global.counts[ class ] < STRING_POOL_GLOBAL_BUFFERS ) {
+            global.buffers[ class ][ global.counts[ class ]++ ] =
+                c->buffers[ class ][ --n ];
+        }
+        mtx_unlock( &global_lock );
+    }
+    while ( n > keep ) {
+        stringm__free( &c->buffers[ class ][ --n ] );
+    }
+    c->counts[ class ] = n;
+}
+
+
+// Moves up to half of a thread cache's worth of buffers of `class` from the
+// global list to the thread's cache.
+static
+void
+move_from_global(
+        ThreadCache * const c,
+        size_t const class )
+{
+    if ( !use_global() ) { return; }
+    mtx_lock( &global_lock );
+    size_t n = c->counts[ class ];
+    while ( n < STRING_POOL_THREAD_BUFFERS / 2 && global.counts[ class ] > 0 ) {
+        c->buffers[ class ][ n++ ] =
+            global.buffers[ class ][ --global.counts[ class ] ];
+    }
+    mtx_unlock( &global_lock );
+    c->counts[ class ] = n;
+}
+
+
+static
+size_t
+floor_log2(
+        size_t x )
+{
+    size_t r = 0;
+    while ( x >>= 1 ) {
+        r++;
+    }
+    return r;
+}
+
+
+StringM
+stringpool__new_empty(
+        size_t const capacity )
+{
+    if ( capacity > STRING_POOL_MAX_CAPACITY ) {
+        return stringm__new_empty( capacity );
+    }
+    size_t const min = ( size_t ) 1 << MIN_CLASS;
+    size_t const c = ( capacity <= min ) ? MIN_CLASS
+                                         : floor_log2( capacity - 1 ) + 1;
+    if ( ( ( size_t ) 1 << c ) > STRING_POOL_MAX_CAPACITY ) {
+        return stringm__new_empty( capacity );
+    }
+    size_t const class = c - MIN_CLASS;
+    ThreadCache * const tc = &thread_cache;
+    if ( tc->counts[ class ] == 0 ) {
+        move_from_global( tc, class );
+    }
+    if ( tc->counts[ class ] > 0 ) {
+        return tc->buffers[ class ][ --tc->counts[ class ] ];
+    }
+    return stringm__new_empty( ( size_t ) 1 << c );
+}
+
+
+void
+stringpool__free(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    // The reserved null byte, if there is one, isn't counted in the
+    // capacity that `stringpool__new_empty()` promises:
+    size_t const capacity = s->capacity - ( s->capacity > 0 ? RESERVED : 0 );
+    if ( capacity < ( ( size_t ) 1 << MIN_CLASS )
+      || capacity > STRING_POOL_MAX_CAPACITY ) {
+        stringm__free( s );
+        return;
+    }
+    size_t const class = floor_log2( capacity ) - MIN_CLASS;
+    ThreadCache * const tc = &thread_cache;
+    // A thread that only gives buffers back still needs its cache flushed
+    // when it exits, or they'd leak:
+    if ( !tc->registered && !use_global() ) {
+        stringm__free( s );
+        return;
+    }
+    if ( tc->counts[ class ] == STRING_POOL_THREAD_BUFFERS ) {
+        move_to_global( tc, class, STRING_POOL_THREAD_BUFFERS / 2 );
+    }
+    s->length = 0;
+    s->e[ 0 ] = '\0';
+    tc->buffers[ class ][ tc->counts[ class ]++ ] = *s;
+    *s = ( StringM ){ .e = NULL, .length = 0, .capacity = 0 };
+}
+
+
+void
+stringpool__clear( void )
+{
+    ThreadCache * const tc = &thread_cache;
+    for ( size_t class = 0; class < CLASSES; class++ ) {
+        while ( tc->counts[ class ] > 0 ) {
+            stringm__free( &tc->buffers[ class ][ --tc->counts[ class ] ] );
+        }
+    }
+    if ( !use_global() ) { return; }
+    mtx_lock( &global_lock );
+    for ( size_t class = 0; class < CLASSES; class++ ) {
+        while ( global.counts[ class ] > 0 ) {
+            stringm__free( &global.buffers[ class ]
+                                          [ --global.counts[ class ] ] );
+        }
+    }
+    mtx_unlock( &global_lock );
+}
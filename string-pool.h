@@ -0,0 +1,73 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_POOL_H
+#define LIBSTRING_STRING_POOL_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// The string pool recycles the buffers of strings that are made and freed
+// often, like per-request scratch strings. Buffers are kept in classes of
+// power-of-two capacities, up to `STRING_POOL_MAX_CAPACITY`; each thread
+// caches up to `STRING_POOL_THREAD_BUFFERS` buffers of each class without
+// locking, and passes the rest on to a global list guarded by a mutex,
+// which holds up to `STRING_POOL_GLOBAL_BUFFERS` buffers of each class. A
+// thread's cached buffers are passed on to the global list when it exits.
+// Once the pool is warm, taking and giving back a string doesn't allocate.
+
+#ifndef STRING_POOL_MAX_CAPACITY
+#define STRING_POOL_MAX_CAPACITY ( 1024 * 1024 )
+#endif
+
+#ifndef STRING_POOL_THREAD_BUFFERS
+#define STRING_POOL_THREAD_BUFFERS 8
+#endif
+
+#ifndef STRING_POOL_GLOBAL_BUFFERS
+#define STRING_POOL_GLOBAL_BUFFERS 64
+#endif
+
+
+// Returns an empty string with a capacity of at least `capacity`, reusing a
+// pooled buffer if there's one big enough. Sets `errno` to `ENOMEM` if
+// memory can't be allocated.
+StringM
+stringpool__new_empty(
+        size_t capacity );
+
+
+// Empties `*s` and gives its buffer to the pool, or frees it if it's too big
+// or too small to be pooled, or if the pool is full. This leaves `*s` empty
+// with no capacity. Any string can be given, not only those taken from the
+// pool.
+void
+stringpool__free(
+        StringM * s );
+
+
+// Frees the buffers cached by the calling thread and in the global list.
+void
+stringpool__clear( void );
+
+
+#endif
@@ -0,0 +1,1648 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-regex.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>     // memcmp, memcpy, memset
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/minmax.h>    // MIN, MAX
+
+
+// The most instructions a compiled regex may have, the most that a counted
+// repetition may repeat its operand, and the deepest that groups may nest.
+#define PROGRAM_MAX 10000
+#define REPEAT_MAX  1000
+#define NESTING_MAX 250
+
+
+
+///////////////////////////////////
+/// BYTE SETS
+///////////////////////////////////
+
+
+typedef struct byteset {
+    uint64_t w[ 4 ];
+} ByteSet;
+
+
+static
+void
+byteset__add(
+        ByteSet * const s,
+        unsigned char const c )
+{
+    s->w[ c >> 6 ] |= UINT64_C( 1 ) << ( c & 63 );
+}
+
+
+static
+void
+byteset__add_range(
+        ByteSet * const s,
+        unsigned char const lo,
+        unsigned char const hi )
+{
+    for ( unsigned c = lo; c <= hi; c++ ) {
+        byteset__add( s, ( unsigned char ) c );
+    }
+}
+
+
+static
+void
+byteset__add_set(
+        ByteSet * const s,
+        ByteSet const t )
+{
+    for ( size_t i = 0; i < 4; i++ ) {
+        s->w[ i ] |= t.w[ i ];
+    }
+}
+
+
+static
+ByteSet
+byteset__negated(
+        ByteSet const s )
+{
+    return ( ByteSet ){ .w = { ~s.w[ 0 ], ~s.w[ 1 ], ~s.w[ 2 ], ~s.w[ 3 ] } };
+}
+
+
+static
+bool
+byteset__has(
+        ByteSet const * const s,
+        unsigned char const c )
+{
+    return ( s->w[ c >> 6 ] >> ( c & 63 ) ) & 1;
+}
+
+
+// Returns the only byte in the set, or -1 if it has more or less than one.
+static
+int
+byteset__single(
+        ByteSet const s )
+{
+    int found = -1;
+    for ( unsigned c = 0; c <= UCHAR_MAX; c++ ) {
+        if ( byteset__has( &s, ( unsigned char ) c ) ) {
+            if ( found >= 0 ) { return -1; }
+            found = ( int ) c;
+        }
+    }
+    return found;
+}
+
+
+
+///////////////////////////////////
+/// PARSING
+///////////////////////////////////
+
+
+enum node_kind {
+    NODE_SET,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT,
+    NODE_GROUP,
+    NODE_TEXT_START,
+    NODE_TEXT_END
+};
+
+
+// The nodes of the syntax tree are kept in one array, and refer to each
+// other by index. `NODE_CONCAT` and `NODE_ALT` nodes have a list of children
+// linked through `next`; `NODE_REPEAT` and `NODE_GROUP` nodes have one child.
+// A `NODE_REPEAT` repeats its child between `min` and `max` times (with `max`
+// of -1 meaning no limit); a `NODE_GROUP` captures into group `min`, or
+// doesn't capture if that's -1.
+typedef struct node {
+    enum node_kind kind;
+    int child;
+    int next;
+    int min;
+    int max;
+    bool greedy;
+    ByteSet set;
+} Node;
+
+
+typedef struct parser {
+    StringC pat;
+    size_t pos;
+    Node * nodes;
+    size_t length;
+    size_t capacity;
+    int groups;
+    int depth;
+    int error;
+    size_t error_index;
+} Parser;
+
+
+static
+int
+parser__fail(
+        Parser * const p,
+        int const error,
+        size_t const index )
+{
+    if ( !p->error ) {
+        p->error = error;
+        p->error_index = index;
+    }
+    return -1;
+}
+
+
+static
+int
+parser__node(
+        Parser * const p,
+        enum node_kind const kind )
+{
+    if ( p->length == p->capacity ) {
+        size_t const cap = MAX( p->capacity * 2, ( size_t ) 16 );
+        Node * const nodes = realloc( p->nodes, cap * sizeof *nodes );
+        if ( nodes == NULL ) { return parser__fail( p, ENOMEM, p->pos ); }
+        p->nodes = nodes;
+        p->capacity = cap;
+    }
+    p->nodes[ p->length ] = ( Node ){ .kind = kind, .child = -1, .next = -1,
+                                      .min = -1, .max = -1, .greedy = true };
+    return ( int ) p->length++;
+}
+
+
+static
+bool
+parser__done(
+        Parser const * const p )
+{
+    return p->error || p->pos >= p->pat.length;
+}
+
+
+static
+char
+parser__peek(
+        Parser const * const p )
+{
+    return parser__done( p ) ? '\0' : p->pat.e[ p->pos ];
+}
+
+
+static
+ByteSet
+perl_class(
+        char const c )
+{
+    ByteSet s = { .w = { 0 } };
+    switch ( c ) {
+        case 'd': case 'D':
+            byteset__add_range( &s, '0', '9' );
+            break;
+        case 'w': case 'W':
+            byteset__add_range( &s, '0', '9' );
+            byteset__add_range( &s, 'A', 'Z' );
+            byteset__add_range( &s, 'a', 'z' );
+            byteset__add( &s, '_' );
+            break;
+        default:
+            byteset__add( &s, ' ' );
+            byteset__add_range( &s, '\t', '\r' );
+            break;
+    }
+    return ( c >= 'A' && c <= 'Z' ) ? byteset__negated( s ) : s;
+}
+
+
+static
+int
+hex_digit(
+        char const c )
+{
+    return ( c >= '0' && c <= '9' ) ? c - '0'
+         : ( c >= 'a' && c <= 'f' ) ? c - 'a' + 10
+         : ( c >= 'A' && c <= 'F' ) ? c - 'A' + 10
+         : -1;
+}
+
+
+// Parses the escape sequence after a backslash at `p->pos - 1`. Returns the
+// escaped byte, or -1 after setting `*set` if it's a Perl class, or -2 if
+// the escape is invalid.
+static
+int
+parser__escape(
+        Parser * const p,
+        ByteSet * const set )
+{
+    size_t const start = p->pos - 1;
+    if ( parser__done( p ) ) {
+        parser__fail( p, EINVAL, start );
+        return -2;
+    }
+    char const c = p->pat.e[ p->pos++ ];
+    switch ( c ) {
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+            *set = perl_class( c );
+            return -1;
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'x': {
+            int const hi = ( p->pos + 2 <= p->pat.length )
+                               ? hex_digit( p->pat.e[ p->pos ] ) : -1;
+            int const lo = ( hi >= 0 ) ? hex_digit( p->pat.e[ p->pos + 1 ] )
+                                       : -1;
+            if ( lo < 0 ) {
+                parser__fail( p, EINVAL, start );
+                return -2;
+            }
+            p->pos += 2;
+            return hi * 16 + lo;
+        }
+        default:
+            if ( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' )
+              || ( c >= '0' && c <= '9' ) ) {
+                parser__fail( p, EINVAL, start );
+                return -2;
+            }
+            return ( unsigned char ) c;
+    }
+}
+
+
+static
+int
+parser__class(
+        Parser * const p )
+{
+    size_t const start = p->pos - 1;
+    ByteSet set = { .w = { 0 } };
+    bool const negated = parser__peek( p ) == '^';
+    if ( negated ) { p->pos++; }
+    bool first = true;
+    while ( !parser__done( p ) && ( first || parser__peek( p ) != ']' ) ) {
+        first = false;
+        int lo = ( unsigned char ) p->pat.e[ p->pos++ ];
+        if ( lo == '\\' ) {
+            ByteSet perl;
+            lo = parser__escape( p, &perl );
+            if ( lo == -2 ) { return -1; }
+            if ( lo == -1 ) {
+                byteset__add_set( &set, perl );
+                continue;
+            }
+        }
+        int hi = lo;
+        if ( parser__peek( p ) == '-' && p->pos + 1 < p->pat.length
+          && p->pat.e[ p->pos + 1 ] != ']' ) {
+            p->pos++;
+            hi = ( unsigned char ) p->pat.e[ p->pos++ ];
+            if ( hi == '\\' ) {
+                ByteSet perl;
+                hi = parser__escape( p, &perl );
+                if ( hi < 0 ) { return parser__fail( p, EINVAL, p->pos - 1 ); }
+            }
+            if ( hi < lo ) { return parser__fail( p, EINVAL, p->pos - 1 ); }
+        }
+        byteset__add_range( &set, ( unsigned char ) lo, ( unsigned char ) hi );
+    }
+    if ( parser__done( p ) ) { return parser__fail( p, EINVAL, start ); }
+    p->pos++;
+    int const n = parser__node( p, NODE_SET );
+    if ( n >= 0 ) {
+        p->nodes[ n ].set = negated ? byteset__negated( set ) : set;
+    }
+    return n;
+}
+
+
+static int parser__alt( Parser * );
+
+
+static
+int
+parser__atom(
+        Parser * const p )
+{
+    size_t const start = p->pos;
+    char const c = p->pat.e[ p->pos++ ];
+    switch ( c ) {
+        case '(': {
+            if ( p->depth == NESTING_MAX ) {
+                return parser__fail( p, EINVAL, start );
+            }
+            int capture = -1;
+            if ( p->pos + 1 < p->pat.length && p->pat.e[ p->pos ] == '?' ) {
+                if ( p->pat.e[ p->pos + 1 ] != ':' ) {
+                    return parser__fail( p, EINVAL, p->pos );
+                }
+                p->pos += 2;
+            } else {
+                capture = ++p->groups;
+            }
+            p->depth++;
+            int const child = parser__alt( p );
+            p->depth--;
+            if ( child < 0 ) { return -1; }
+            if ( parser__peek( p ) != ')' ) {
+                return parser__fail( p, EINVAL, start );
+            }
+            p->pos++;
+            int const n = parser__node( p, NODE_GROUP );
+            if ( n >= 0 ) {
+                p->nodes[ n ].child = child;
+                p->nodes[ n ].min = capture;
+            }
+            return n;
+        }
+        case '[':
+            return parser__class( p );
+        case '^':
+            return parser__node( p, NODE_TEXT_START );
+        case '$':
+            return parser__node( p, NODE_TEXT_END );
+        case '*': case '+': case '?': case '{': case ')': case '|':
+            return parser__fail( p, EINVAL, start );
+        default: {
+            ByteSet set = { .w = { 0 } };
+            if ( c == '.' ) {
+                set = byteset__negated( set );
+                set.w[ 0 ] &= ~( UINT64_C( 1 ) << '\n' );
+            } else if ( c == '\\' ) {
+                int const e = parser__escape( p, &set );
+                if ( e == -2 ) { return -1; }
+                if ( e >= 0 ) { byteset__add( &set, ( unsigned char ) e ); }
+            } else {
+                byteset__add( &set, ( unsigned char ) c );
+            }
+            int const n = parser__node( p, NODE_SET );
+            if ( n >= 0 ) { p->nodes[ n ].set = set; }
+            return n;
+        }
+    }
+}
+
+
+// Parses a decimal number of at most `REPEAT_MAX`, or returns -1.
+static
+int
+parser__count(
+        Parser * const p )
+{
+    int n = -1;
+    while ( parser__peek( p ) >= '0' && parser__peek( p ) <= '9' ) {
+        n = MAX( n, 0 ) * 10 + ( p->pat.e[ p->pos++ ] - '0' );
+        if ( n > REPEAT_MAX ) { return -1; }
+    }
+    return n;
+}
+
+
+// Parses an atom and the quantifier after it, if any. A quantifier can't
+// follow another (as in Perl), which keeps the syntax tree shallow.
+static
+int
+parser__repeat(
+        Parser * const p )
+{
+    int const child = parser__atom( p );
+    if ( child < 0 || parser__done( p ) ) { return child; }
+    size_t const start = p->pos;
+    char const c = parser__peek( p );
+    int min;
+    int max;
+    if ( c == '*' || c == '+' || c == '?' ) {
+        p->pos++;
+        min = ( c == '+' );
+        max = ( c == '?' ) ? 1 : -1;
+    } else if ( c == '{' ) {
+        p->pos++;
+        min = parser__count( p );
+        max = min;
+        if ( parser__peek( p ) == ',' ) {
+            p->pos++;
+            max = parser__count( p );
+        }
+        if ( min < 0 || parser__peek( p ) != '}'
+          || ( max >= 0 && max < min ) ) {
+            return parser__fail( p, EINVAL, start );
+        }
+        p->pos++;
+    } else {
+        return child;
+    }
+    bool greedy = true;
+    if ( parser__peek( p ) == '?' ) {
+        p->pos++;
+        greedy = false;
+    }
+    int const n = parser__node( p, NODE_REPEAT );
+    if ( n < 0 ) { return -1; }
+    p->nodes[ n ].child = child;
+    p->nodes[ n ].min = min;
+    p->nodes[ n ].max = max;
+    p->nodes[ n ].greedy = greedy;
+    return n;
+}
+
+
+static
+void
+parser__link(
+        Parser * const p,
+        int const list,
+        int * const last,
+        int const child )
+{
+    if ( *last < 0 ) {
+        p->nodes[ list ].child = child;
+    } else {
+        p->nodes[ *last ].next = child;
+    }
+    *last = child;
+}
+
+
+static
+int
+parser__concat(
+        Parser * const p )
+{
+    int const list = parser__node( p, NODE_CONCAT );
+    int last = -1;
+    while ( list >= 0 && !parser__done( p )
+         && parser__peek( p ) != '|' && parser__peek( p ) != ')' ) {
+        int const child = parser__repeat( p );
+        if ( child < 0 ) { return -1; }
+        parser__link( p, list, &last, child );
+    }
+    return p->error ? -1 : list;
+}
+
+
+static
+int
+parser__alt(
+        Parser * const p )
+{
+    int const list = parser__node( p, NODE_ALT );
+    int last = -1;
+    while ( list >= 0 ) {
+        int const child = parser__concat( p );
+        if ( child < 0 ) { return -1; }
+        parser__link( p, list, &last, child );
+        if ( parser__done( p ) || parser__peek( p ) != '|' ) { break; }
+        p->pos++;
+    }
+    return p->error ? -1 : list;
+}
+
+
+
+///////////////////////////////////
+/// COMPILING
+///////////////////////////////////
+
+
+enum op {
+    OP_SET,         // consume a byte in `set`, and go to the next instruction
+    OP_MATCH,
+    OP_JMP,         // go to `x`
+    OP_SPLIT,       // go to `x`, and with lower priority, to `y`
+    OP_SAVE,        // record the position in capture slot `x`
+    OP_TEXT_START,  // go on only at the start of the text being scanned
+    OP_TEXT_END     // go on only at the end of the text being scanned
+};
+
+
+typedef struct inst {
+    enum op op;
+    int x;
+    int y;
+    ByteSet set;
+} Inst;
+
+
+// Where the forward program starts matching anywhere, and where it starts
+// matching at the given position:
+#define PC_UNANCHORED 0
+#define PC_ANCHORED   3
+
+
+typedef struct program {
+    Inst * e;
+    size_t length;
+    size_t capacity;
+} Program;
+
+
+static
+int
+program__emit(
+        Program * const prog,
+        enum op const op )
+{
+    if ( prog->length == PROGRAM_MAX ) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ( prog->length == prog->capacity ) {
+        size_t const cap = MAX( prog->capacity * 2, ( size_t ) 16 );
+        Inst * const e = realloc( prog->e, cap * sizeof *e );
+        if ( e == NULL ) {
+            errno = ENOMEM;
+            return -1;
+        }
+        prog->e = e;
+        prog->capacity = cap;
+    }
+    prog->e[ prog->length ] = ( Inst ){ .op = op, .x = -1, .y = -1 };
+    return ( int ) prog->length++;
+}
+
+
+// Emits the instructions for `n` and its children. A reversed program
+// matches the reverse of what the forward program matches, and doesn't
+// record captures. Returns false after setting `errno` if the program got too
+// big, or if memory couldn't be allocated.
+static
+bool
+program__compile(
+        Program * const prog,
+        Node const * const nodes,
+        int const n,
+        bool const reversed )
+{
+    Node const node = nodes[ n ];
+    switch ( node.kind ) {
+        case NODE_SET: {
+            int const i = program__emit( prog, OP_SET );
+            if ( i < 0 ) { return false; }
+            prog->e[ i ].set = node.set;
+            return true;
+        }
+        case NODE_CONCAT: {
+            if ( !reversed ) {
+                for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                    if ( !program__compile( prog, nodes, c, reversed ) ) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            size_t count = 0;
+            for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                count++;
+            }
+            int * const children = malloc( MAX( count, 1 ) * sizeof *children );
+            if ( children == NULL ) {
+                errno = ENOMEM;
+                return false;
+            }
+            count = 0;
+            for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                children[ count++ ] = c;
+            }
+            bool ok = true;
+            while ( ok && count > 0 ) {
+                ok = program__compile( prog, nodes, children[ --count ],
+                                       reversed );
+            }
+            free( children );
+            return ok;
+        }
+        case NODE_ALT: {
+            // Each alternative but the last is preceded by a split to it or
+            // the next alternative, and followed by a jump to the end.
+            int jumps = -1;
+            for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                int split = -1;
+                if ( nodes[ c ].next >= 0 ) {
+                    split = program__emit( prog, OP_SPLIT );
+                    if ( split < 0 ) { return false; }
+                    prog->e[ split ].x = split + 1;
+                }
+                if ( !program__compile( prog, nodes, c, reversed ) ) {
+                    return false;
+                }
+                if ( split >= 0 ) {
+                    int const jmp = program__emit( prog, OP_JMP );
+                    if ( jmp < 0 ) { return false; }
+                    // Chain the jumps through `y` to patch them later:
+                    prog->e[ jmp ].y = jumps;
+                    jumps = jmp;
+                    prog->e[ split ].y = ( int ) prog->length;
+                }
+            }
+            while ( jumps >= 0 ) {
+                int const next = prog->e[ jumps ].y;
+                prog->e[ jumps ].x = ( int ) prog->length;
+                prog->e[ jumps ].y = -1;
+                jumps = next;
+            }
+            return true;
+        }
+        case NODE_GROUP: {
+            bool const save = !reversed && node.min >= 0;
+            if ( save ) {
+                int const i = program__emit( prog, OP_SAVE );
+                if ( i < 0 ) { return false; }
+                prog->e[ i ].x = 2 * node.min;
+            }
+            if ( !program__compile( prog, nodes, node.child, reversed ) ) {
+                return false;
+            }
+            if ( save ) {
+                int const i = program__emit( prog, OP_SAVE );
+                if ( i < 0 ) { return false; }
+                prog->e[ i ].x = 2 * node.min + 1;
+            }
+            return true;
+        }
+        case NODE_TEXT_START:
+        case NODE_TEXT_END: {
+            bool const start = ( node.kind == NODE_TEXT_START ) != reversed;
+            return program__emit( prog, start ? OP_TEXT_START
+                                              : OP_TEXT_END ) >= 0;
+        }
+        case NODE_REPEAT: {
+            for ( int i = 0; i < node.min; i++ ) {
+                if ( !program__compile( prog, nodes, node.child, reversed ) ) {
+                    return false;
+                }
+            }
+            int const optionals = ( node.max < 0 ) ? 1 : node.max - node.min;
+            for ( int i = 0; i < optionals; i++ ) {
+                int const split = program__emit( prog, OP_SPLIT );
+                if ( split < 0 ) { return false; }
+                if ( !program__compile( prog, nodes, node.child, reversed ) ) {
+                    return false;
+                }
+                if ( node.max < 0 ) {
+                    int const jmp = program__emit( prog, OP_JMP );
+                    if ( jmp < 0 ) { return false; }
+                    prog->e[ jmp ].x = split;
+                }
+                int const body = split + 1;
+                int const out = ( int ) prog->length;
+                prog->e[ split ].x = node.greedy ? body : out;
+                prog->e[ split ].y = node.greedy ? out : body;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Emits the forward program for the regex at `root`: the unanchored prefix
+// `.*?` (that matches any byte), then the regex in capture group 0, and then
+// the match instruction.
+static
+bool
+program__compile_forward(
+        Program * const prog,
+        Node const * const nodes,
+        int const root )
+{
+    int const split = program__emit( prog, OP_SPLIT );
+    int const any = program__emit( prog, OP_SET );
+    int const jmp = program__emit( prog, OP_JMP );
+    int const save = program__emit( prog, OP_SAVE );
+    if ( split < 0 || any < 0 || jmp < 0 || save < 0 ) { return false; }
+    prog->e[ split ].x = PC_ANCHORED;
+    prog->e[ split ].y = any;
+    prog->e[ any ].set = byteset__negated( ( ByteSet ){ .w = { 0 } } );
+    prog->e[ jmp ].x = split;
+    prog->e[ save ].x = 0;
+    if ( !program__compile( prog, nodes, root, false ) ) { return false; }
+    int const end = program__emit( prog, OP_SAVE );
+    if ( end < 0 ) { return false; }
+    prog->e[ end ].x = 1;
+    return program__emit( prog, OP_MATCH ) >= 0;
+}
+
+
+// Appends to `prefix` the literal bytes that every match of `n` must start
+// with, and returns true if that's everything `n` matches.
+static
+bool
+literal_prefix(
+        Node const * const nodes,
+        int const n,
+        StringM * const prefix )
+{
+    Node const node = nodes[ n ];
+    switch ( node.kind ) {
+        case NODE_SET: {
+            int const c = byteset__single( node.set );
+            if ( c < 0 ) { return false; }
+            errno = 0;
+            stringm__append( prefix, ( char ) c );
+            return !errno;
+        }
+        case NODE_CONCAT:
+            for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                if ( !literal_prefix( nodes, c, prefix ) ) { return false; }
+            }
+            return true;
+        case NODE_GROUP:
+            return literal_prefix( nodes, node.child, prefix );
+        case NODE_ALT:
+            return nodes[ node.child ].next < 0
+                && literal_prefix( nodes, node.child, prefix );
+        default:
+            return false;
+    }
+}
+
+
+// Returns true if every match of `n` must start at the start of the text.
+static
+bool
+starts_anchored(
+        Node const * const nodes,
+        int const n )
+{
+    Node const node = nodes[ n ];
+    switch ( node.kind ) {
+        case NODE_TEXT_START:
+            return true;
+        case NODE_GROUP:
+            return starts_anchored( nodes, node.child );
+        case NODE_CONCAT:
+            return node.child >= 0 && starts_anchored( nodes, node.child );
+        case NODE_ALT:
+            for ( int c = node.child; c >= 0; c = nodes[ c ].next ) {
+                if ( !starts_anchored( nodes, c ) ) { return false; }
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+
+///////////////////////////////////
+/// LAZY DFA
+///////////////////////////////////
+
+
+// The states of the DFA are ordered lists of the NFA instructions that the
+// NFA threads are at (only `OP_SET`, `OP_MATCH` and `OP_TEXT_END`
+// instructions are kept). They're built as the search needs them, and cached
+// along with their transitions, up to `STRING_REGEX_CACHE_SIZE` bytes; when
+// the cache is full, it's emptied, and building starts again. Each state has
+// 257 transitions: one for each byte, and one for the end of the text, which
+// just says whether the state matches there.
+//
+// A leftmost-first DFA drops the threads after a match in a state, as they
+// have a lower priority than it; a longest DFA keeps them.
+
+#define DFA_UNKNOWN ( -1 )
+#define DFA_DEAD    ( -2 )
+#define DFA_ERROR   ( -3 )
+#define DFA_EOT     256
+
+
+typedef struct dfa {
+    Program const * prog;
+    bool longest;
+    // The states:
+    size_t length;
+    size_t capacity;
+    int32_t * trans;
+    size_t * offsets;
+    size_t * counts;
+    bool * matches;
+    // The instructions of the states, back-to-back:
+    int32_t * pcs;
+    size_t pcs_length;
+    size_t pcs_capacity;
+    // A hash table of state indices, with -1 for empty slots:
+    int32_t * table;
+    size_t table_capacity;
+    size_t used;
+    // How many times the cache has been flushed:
+    size_t flushes;
+    // The start states for each start instruction (0 or 1) and whether
+    // they're at the start of the text:
+    int32_t starts[ 2 ][ 2 ];
+    int start_pcs[ 2 ];
+    // Scratch space for building states:
+    int32_t * list;
+    int32_t * stack;
+    uint32_t * marks;
+    uint32_t mark;
+} Dfa;
+
+
+static
+size_t
+dfa__state_size(
+        size_t const count )
+{
+    // The transitions, offset, count, match flag, instructions and slot in
+    // the hash table (at most half full):
+    return ( DFA_EOT + 1 ) * sizeof ( int32_t ) + 2 * sizeof ( size_t )
+         + sizeof ( bool ) + ( count + 2 ) * sizeof ( int32_t );
+}
+
+
+static
+void
+dfa__flush(
+        Dfa * const d )
+{
+    d->flushes++;
+    d->length = 0;
+    d->pcs_length = 0;
+    d->used = 0;
+    for ( size_t i = 0; i < d->table_capacity; i++ ) {
+        d->table[ i ] = -1;
+    }
+    d->starts[ 0 ][ 0 ] = d->starts[ 0 ][ 1 ] = DFA_UNKNOWN;
+    d->starts[ 1 ][ 0 ] = d->starts[ 1 ][ 1 ] = DFA_UNKNOWN;
+}
+
+
+static
+bool
+dfa__init(
+        Dfa * const d,
+        Program const * const prog,
+        bool const longest,
+        int const start_pc,
+        int const alt_start_pc )
+{
+    *d = ( Dfa ){ .prog = prog, .longest = longest,
+                  .start_pcs = { start_pc, alt_start_pc } };
+    size_t const n = prog->length;
+    size_t const max_states = STRING_REGEX_CACHE_SIZE / dfa__state_size( 1 );
+    d->table_capacity = 64;
+    while ( d->table_capacity < 2 * max_states ) {
+        d->table_capacity *= 2;
+    }
+    d->table = malloc( d->table_capacity * sizeof *d->table );
+    d->list = malloc( n * sizeof *d->list );
+    d->stack = malloc( ( 2 * n + 1 ) * sizeof *d->stack );
+    d->marks = calloc( n, sizeof *d->marks );
+    if ( d->table == NULL || d->list == NULL || d->stack == NULL
+      || d->marks == NULL ) {
+        return false;
+    }
+    dfa__flush( d );
+    return true;
+}
+
+
+static
+void
+dfa__free(
+        Dfa * const d )
+{
+    free( d->trans );
+    free( d->offsets );
+    free( d->counts );
+    free( d->matches );
+    free( d->pcs );
+    free( d->table );
+    free( d->list );
+    free( d->stack );
+    free( d->marks );
+}
+
+
+static
+uint64_t
+dfa__hash(
+        int32_t const * const pcs,
+        size_t const n )
+{
+    uint64_t h = UINT64_C( 14695981039346656037 );
+    for ( size_t i = 0; i < n; i++ ) {
+        h = ( h ^ ( uint32_t ) pcs[ i ] ) * UINT64_C( 1099511628211 );
+    }
+    return h;
+}
+
+
+static
+bool
+dfa__reserve(
+        Dfa * const d,
+        size_t const count )
+{
+    if ( d->length == d->capacity ) {
+        size_t const cap = MAX( d->capacity * 2, ( size_t ) 16 );
+        int32_t * const trans =
+            realloc( d->trans, cap * ( DFA_EOT + 1 ) * sizeof *trans );
+        if ( trans == NULL ) { return false; }
+        d->trans = trans;
+        size_t * const offsets = realloc( d->offsets, cap * sizeof *offsets );
+        if ( offsets == NULL ) { return false; }
+        d->offsets = offsets;
+        size_t * const counts = realloc( d->counts, cap * sizeof *counts );
+        if ( counts == NULL ) { return false; }
+        d->counts = counts;
+        bool * const matches = realloc( d->matches, cap * sizeof *matches );
+        if ( matches == NULL ) { return false; }
+        d->matches = matches;
+        d->capacity = cap;
+    }
+    if ( d->pcs_length + count > d->pcs_capacity ) {
+        size_t const cap = MAX( d->pcs_capacity * 2, d->pcs_length + count );
+        int32_t * const pcs = realloc( d->pcs, cap * sizeof *pcs );
+        if ( pcs == NULL ) { return false; }
+        d->pcs = pcs;
+        d->pcs_capacity = cap;
+    }
+    return true;
+}
+
+
+// Returns the index of the state for the `n` instructions in `d->list`,
+// adding it if it isn't cached yet. This may flush the cache, invalidating
+// any other state indices.
+static
+int32_t
+dfa__state(
+        Dfa * const d,
+        size_t const n,
+        bool const match )
+{
+    if ( n == 0 ) { return DFA_DEAD; }
+    size_t const mask = d->table_capacity - 1;
+    size_t slot = dfa__hash( d->list, n ) & mask;
+    for ( ; d->table[ slot ] >= 0; slot = ( slot + 1 ) & mask ) {
+        int32_t const s = d->table[ slot ];
+        if ( d->counts[ s ] == n
+          && memcmp( d->pcs + d->offsets[ s ], d->list,
+                     n * sizeof *d->list ) == 0 ) {
+            return s;
+        }
+    }
+    size_t const size = dfa__state_size( n );
+    if ( d->used + size > STRING_REGEX_CACHE_SIZE
+      || 2 * ( d->length + 1 ) > d->table_capacity ) {
+        dfa__flush( d );
+        slot = dfa__hash( d->list, n ) & mask;
+    }
+    if ( !dfa__reserve( d, n ) ) { return DFA_ERROR; }
+    int32_t const s = ( int32_t ) d->length++;
+    d->used += size;
+    d->offsets[ s ] = d->pcs_length;
+    d->counts[ s ] = n;
+    d->matches[ s ] = match;
+    memcpy( d->pcs + d->pcs_length, d->list, n * sizeof *d->list );
+    d->pcs_length += n;
+    for ( size_t c = 0; c <= DFA_EOT; c++ ) {
+        d->trans[ ( size_t ) s * ( DFA_EOT + 1 ) + c ] = DFA_UNKNOWN;
+    }
+    d->table[ slot ] = s;
+    return s;
+}
+
+
+// Adds the instructions reachable from `pc` without consuming a byte to the
+// list being built, in priority order. Returns true if a match was added.
+static
+bool
+dfa__follow(
+        Dfa * const d,
+        int const pc,
+        size_t * const n,
+        bool const at_start,
+        bool const at_end )
+{
+    Inst const * const prog = d->prog->e;
+    size_t top = 0;
+    d->stack[ top++ ] = pc;
+    while ( top > 0 ) {
+        int32_t const i = d->stack[ --top ];
+        if ( d->marks[ i ] == d->mark ) { continue; }
+        d->marks[ i ] = d->mark;
+        switch ( prog[ i ].op ) {
+            case OP_JMP:
+                d->stack[ top++ ] = prog[ i ].x;
+                break;
+            case OP_SPLIT:
+                d->stack[ top++ ] = prog[ i ].y;
+                d->stack[ top++ ] = prog[ i ].x;
+                break;
+            case OP_SAVE:
+                d->stack[ top++ ] = i + 1;
+                break;
+            case OP_TEXT_START:
+                if ( at_start ) { d->stack[ top++ ] = i + 1; }
+                break;
+            case OP_TEXT_END:
+                if ( at_end ) {
+                    d->stack[ top++ ] = i + 1;
+                } else {
+                    d->list[ ( *n )++ ] = i;
+                }
+                break;
+            case OP_SET:
+                d->list[ ( *n )++ ] = i;
+                break;
+            case OP_MATCH:
+                d->list[ ( *n )++ ] = i;
+                if ( !d->longest ) { return true; }
+                break;
+        }
+    }
+    return false;
+}
+
+
+static
+void
+dfa__new_mark(
+        Dfa * const d )
+{
+    if ( ++d->mark == 0 ) {
+        memset( d->marks, 0, d->prog->length * sizeof *d->marks );
+        d->mark = 1;
+    }
+}
+
+
+static
+bool
+dfa__list_matches(
+        Dfa const * const d,
+        size_t const n )
+{
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( d->prog->e[ d->list[ i ] ].op == OP_MATCH ) { return true; }
+    }
+    return false;
+}
+
+
+static
+int32_t
+dfa__start(
+        Dfa * const d,
+        size_t const which,
+        bool const at_start )
+{
+    int32_t const cached = d->starts[ which ][ at_start ];
+    if ( cached != DFA_UNKNOWN ) { return cached; }
+    dfa__new_mark( d );
+    size_t n = 0;
+    dfa__follow( d, d->start_pcs[ which ], &n, at_start, false );
+    int32_t const s = dfa__state( d, n, dfa__list_matches( d, n ) );
+    if ( s >= 0 ) {
+        d->starts[ which ][ at_start ] = s;
+    }
+    return s;
+}
+
+
+// Builds the state that `s` goes to on the byte `c`.
+static
+int32_t
+dfa__build_next(
+        Dfa * const d,
+        int32_t const s,
+        unsigned char const c )
+{
+    Inst const * const prog = d->prog->e;
+    int32_t const * const pcs = d->pcs + d->offsets[ s ];
+    size_t const count = d->counts[ s ];
+    dfa__new_mark( d );
+    size_t n = 0;
+    bool cut = false;
+    for ( size_t i = 0; i < count && !cut; i++ ) {
+        Inst const * const inst = &prog[ pcs[ i ] ];
+        if ( inst->op == OP_SET && byteset__has( &inst->set, c ) ) {
+            cut = dfa__follow( d, pcs[ i ] + 1, &n, false, false );
+        }
+    }
+    size_t const flushes = d->flushes;
+    int32_t const next = dfa__state( d, n, dfa__list_matches( d, n ) );
+    // Only cache the transition if `s` wasn't flushed:
+    if ( next != DFA_ERROR && d->flushes == flushes ) {
+        d->trans[ ( size_t ) s * ( DFA_EOT + 1 ) + c ] = next;
+    }
+    return next;
+}
+
+
+// Returns the state that `s` goes to on the byte `c`.
+static
+int32_t
+dfa__next(
+        Dfa * const d,
+        int32_t const s,
+        unsigned char const c )
+{
+    int32_t const next = d->trans[ ( size_t ) s * ( DFA_EOT + 1 ) + c ];
+    return ( next != DFA_UNKNOWN ) ? next : dfa__build_next( d, s, c );
+}
+
+
+// Returns true if `s` matches at the end of the text. That's cached, unless
+// the end is also the start (so the text is empty), which is rare enough.
+static
+bool
+dfa__matches_at_end(
+        Dfa * const d,
+        int32_t const s,
+        bool const at_start )
+{
+    int32_t * const t = d->trans + ( size_t ) s * ( DFA_EOT + 1 ) + DFA_EOT;
+    if ( !at_start && *t != DFA_UNKNOWN ) { return *t; }
+    Inst const * const prog = d->prog->e;
+    int32_t const * const pcs = d->pcs + d->offsets[ s ];
+    size_t const count = d->counts[ s ];
+    dfa__new_mark( d );
+    bool match = false;
+    for ( size_t i = 0; i < count && !match; i++ ) {
+        size_t n = 0;
+        match = prog[ pcs[ i ] ].op == OP_MATCH
+             || ( prog[ pcs[ i ] ].op == OP_TEXT_END
+                  && ( dfa__follow( d, pcs[ i ] + 1, &n, at_start, true )
+                       || dfa__list_matches( d, n ) ) );
+    }
+    if ( !at_start ) { *t = match; }
+    return match;
+}
+
+
+
+///////////////////////////////////
+/// CAPTURES
+///////////////////////////////////
+
+
+// The Pike VM runs the NFA threads in lockstep, each with its own capture
+// slots, to find what the capture groups of a known match matched.
+
+typedef struct vm {
+    Program const * prog;
+    size_t slots;
+    // The current and next thread lists, each with their capture slots:
+    int32_t * pcs[ 2 ];
+    size_t * caps[ 2 ];
+    size_t lengths[ 2 ];
+    // The slots of the thread being followed, and a stack of the
+    // instructions left to follow, and of the slots to restore:
+    size_t * cur;
+    struct vm_frame { int32_t pc; int32_t slot; size_t value; } * stack;
+    uint32_t * marks;
+    uint32_t mark;
+} Vm;
+
+
+static
+void
+vm__free(
+        Vm * const vm )
+{
+    free( vm->pcs[ 0 ] );
+    free( vm->pcs[ 1 ] );
+    free( vm->caps[ 0 ] );
+    free( vm->caps[ 1 ] );
+    free( vm->cur );
+    free( vm->stack );
+    free( vm->marks );
+}
+
+
+static
+bool
+vm__init(
+        Vm * const vm,
+        Program const * const prog,
+        size_t const slots )
+{
+    size_t const n = prog->length;
+    *vm = ( Vm ){ .prog = prog, .slots = slots };
+    for ( size_t i = 0; i < 2; i++ ) {
+        vm->pcs[ i ] = malloc( n * sizeof *vm->pcs[ i ] );
+        vm->caps[ i ] = malloc( n * slots * sizeof *vm->caps[ i ] );
+    }
+    vm->cur = malloc( slots * sizeof *vm->cur );
+    vm->stack = malloc( ( 3 * n + 1 ) * sizeof *vm->stack );
+    vm->marks = calloc( n, sizeof *vm->marks );
+    if ( vm->pcs[ 0 ] == NULL || vm->pcs[ 1 ] == NULL
+      || vm->caps[ 0 ] == NULL || vm->caps[ 1 ] == NULL
+      || vm->cur == NULL || vm->stack == NULL || vm->marks == NULL ) {
+        vm__free( vm );
+        return false;
+    }
+    return true;
+}
+
+
+// Adds the threads reachable from `pc` at `pos` without consuming a byte to
+// list `l`, in priority order, with the slots in `vm->cur`. Returns true if
+// a match was added, after which lower-priority threads don't matter.
+static
+bool
+vm__follow(
+        Vm * const vm,
+        size_t const l,
+        int32_t const pc,
+        size_t const pos,
+        size_t const length )
+{
+    Inst const * const prog = vm->prog->e;
+    size_t top = 0;
+    vm->stack[ top++ ] = ( struct vm_frame ){ .pc = pc, .slot = -1 };
+    while ( top > 0 ) {
+        struct vm_frame const f = vm->stack[ --top ];
+        if ( f.slot >= 0 ) {
+            vm->cur[ f.slot ] = f.value;
+            continue;
+        }
+        int32_t const i = f.pc;
+        if ( vm->marks[ i ] == vm->mark ) { continue; }
+        vm->marks[ i ] = vm->mark;
+        switch ( prog[ i ].op ) {
+            case OP_JMP:
+                vm->stack[ top++ ] = ( struct vm_frame ){ .pc = prog[ i ].x,
+                                                         .slot = -1 };
+                break;
+            case OP_SPLIT:
+                vm->stack[ top++ ] = ( struct vm_frame ){ .pc = prog[ i ].y,
+                                                         .slot = -1 };
+                vm->stack[ top++ ] = ( struct vm_frame ){ .pc = prog[ i ].x,
+                                                         .slot = -1 };
+                break;
+            case OP_SAVE:
+                // Restore the slot after following what comes after this:
+                vm->stack[ top++ ] = ( struct vm_frame ){
+                    .slot = prog[ i ].x, .value = vm->cur[ prog[ i ].x ] };
+                vm->cur[ prog[ i ].x ] = pos;
+                vm->stack[ top++ ] = ( struct vm_frame ){ .pc = i + 1,
+                                                         .slot = -1 };
+                break;
+            case OP_TEXT_START:
+                if ( pos == 0 ) {
+                    vm->stack[ top++ ] = ( struct vm_frame ){ .pc = i + 1,
+                                                             .slot = -1 };
+                }
+                break;
+            case OP_TEXT_END:
+                if ( pos == length ) {
+                    vm->stack[ top++ ] = ( struct vm_frame ){ .pc = i + 1,
+                                                             .slot = -1 };
+                }
+                break;
+            case OP_SET:
+            case OP_MATCH: {
+                size_t const t = vm->lengths[ l ]++;
+                vm->pcs[ l ][ t ] = i;
+                memcpy( vm->caps[ l ] + t * vm->slots, vm->cur,
+                        vm->slots * sizeof *vm->cur );
+                if ( prog[ i ].op == OP_MATCH ) { return true; }
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+
+static
+void
+vm__new_mark(
+        Vm * const vm )
+{
+    if ( ++vm->mark == 0 ) {
+        memset( vm->marks, 0, vm->prog->length * sizeof *vm->marks );
+        vm->mark = 1;
+    }
+}
+
+
+// Runs the threads starting at `pc` from `start` until `end`, where the
+// leftmost-first match starting at `start` is known to end, and sets
+// `caps` to the slots of that match.
+static
+void
+vm__run(
+        Vm * const vm,
+        int32_t const pc,
+        StringC const xs,
+        size_t const start,
+        size_t const end,
+        size_t * const caps )
+{
+    for ( size_t i = 0; i < vm->slots; i++ ) {
+        vm->cur[ i ] = SIZE_MAX;
+    }
+    size_t l = 0;
+    vm->lengths[ l ] = 0;
+    vm__new_mark( vm );
+    vm__follow( vm, l, pc, start, xs.length );
+    for ( size_t pos = start; vm->lengths[ l ] > 0; pos++ ) {
+        size_t const nl = !l;
+        vm->lengths[ nl ] = 0;
+        vm__new_mark( vm );
+        for ( size_t t = 0; t < vm->lengths[ l ]; t++ ) {
+            Inst const * const inst = &vm->prog->e[ vm->pcs[ l ][ t ] ];
+            size_t const * const tcaps = vm->caps[ l ] + t * vm->slots;
+            if ( inst->op == OP_MATCH ) {
+                memcpy( caps, tcaps, vm->slots * sizeof *caps );
+                break;
+            }
+            if ( pos < end
+              && byteset__has( &inst->set, ( unsigned char ) xs.e[ pos ] ) ) {
+                memcpy( vm->cur, tcaps, vm->slots * sizeof *vm->cur );
+                if ( vm__follow( vm, nl, vm->pcs[ l ][ t ] + 1, pos + 1,
+                                 xs.length ) ) {
+                    break;
+                }
+            }
+        }
+        if ( pos == end ) { break; }
+        l = nl;
+    }
+}
+
+
+
+///////////////////////////////////
+/// REGEXES
+///////////////////////////////////
+
+
+struct stringregex {
+    Program forward;
+    Program reverse;
+    // The leftmost-first forward DFA finds where matches end, the longest
+    // reverse DFA finds where they start, and the longest forward DFA checks
+    // whole strings. They're only made when they're needed:
+    Dfa * finder;
+    Dfa * reverser;
+    Dfa * matcher;
+    size_t groups;
+    // Whether every match has to start at the start of the string, and the
+    // bytes that every match has to start with:
+    bool anchored;
+    StringM prefix;
+};
+
+
+StringRegex *
+stringregex__new(
+        StringC const pattern,
+        size_t * const error_index )
+{
+    ASSERT( stringc__is_valid( pattern ) );
+
+    Parser p = { .pat = pattern };
+    int const root = parser__alt( &p );
+    if ( !p.error && p.pos < pattern.length ) {
+        // Only an unmatched `)` stops the parser early:
+        parser__fail( &p, EINVAL, p.pos );
+    }
+    if ( p.error ) {
+        free( p.nodes );
+        if ( p.error == EINVAL && error_index != NULL ) {
+            *error_index = p.error_index;
+        }
+        errno = p.error;
+        return NULL;
+    }
+    StringRegex * const re = calloc( 1, sizeof *re );
+    if ( re == NULL ) {
+        free( p.nodes );
+        errno = ENOMEM;
+        return NULL;
+    }
+    re->groups = ( size_t ) p.groups;
+    re->anchored = starts_anchored( p.nodes, root );
+    bool const ok = program__compile_forward( &re->forward, p.nodes, root )
+                 && program__compile( &re->reverse, p.nodes, root, true )
+                 && program__emit( &re->reverse, OP_MATCH ) >= 0
+                 && ( literal_prefix( p.nodes, root, &re->prefix )
+                      || !errno );
+    free( p.nodes );
+    if ( !ok ) {
+        int const error = errno;
+        stringregex__free( re );
+        if ( error == EINVAL && error_index != NULL ) {
+            // The program got too big, which is the whole pattern's fault:
+            *error_index = 0;
+        }
+        errno = error;
+        return NULL;
+    }
+    return re;
+}
+
+
+static
+void
+free_dfa(
+        Dfa * const d )
+{
+    if ( d != NULL ) {
+        dfa__free( d );
+        free( d );
+    }
+}
+
+
+void
+stringregex__free(
+        StringRegex * const re )
+{
+    if ( re == NULL ) { return; }
+    free( re->forward.e );
+    free( re->reverse.e );
+    free_dfa( re->finder );
+    free_dfa( re->reverser );
+    free_dfa( re->matcher );
+    stringm__free( &re->prefix );
+    free( re );
+}
+
+
+size_t
+stringregex__groups(
+        StringRegex const * const re )
+{
+    ASSERT( re != NULL );
+
+    return re->groups;
+}
+
+
+// Returns the DFA in `*d`, making it first if it hasn't been made yet, or
+// returns `NULL` after setting `errno` to `ENOMEM`.
+static
+Dfa *
+lazy_dfa(
+        Dfa * * const d,
+        Program const * const prog,
+        bool const longest,
+        int const start_pc,
+        int const alt_start_pc )
+{
+    if ( *d != NULL ) { return *d; }
+    Dfa * const made = malloc( sizeof *made );
+    if ( made == NULL
+      || !dfa__init( made, prog, longest, start_pc, alt_start_pc ) ) {
+        if ( made != NULL ) { dfa__free( made ); }
+        free( made );
+        errno = ENOMEM;
+        return NULL;
+    }
+    *d = made;
+    return made;
+}
+
+
+bool
+stringregex__match(
+        StringRegex * const re,
+        StringC const xs )
+{
+    ASSERT( re != NULL, stringc__is_valid( xs ) );
+
+    Dfa * const d = lazy_dfa( &re->matcher, &re->forward, true,
+                              PC_ANCHORED, PC_ANCHORED );
+    if ( d == NULL ) { return false; }
+    int32_t s = dfa__start( d, 0, true );
+    for ( size_t i = 0; s >= 0 && i < xs.length; i++ ) {
+        s = dfa__next( d, s, ( unsigned char ) xs.e[ i ] );
+    }
+    if ( s == DFA_ERROR ) {
+        errno = ENOMEM;
+        return false;
+    }
+    return s >= 0 && dfa__matches_at_end( d, s, xs.length == 0 );
+}
+
+
+bool
+stringregex__find(
+        StringRegex * const re,
+        StringC const xs,
+        size_t const from,
+        StringC * const found )
+{
+    ASSERT( re != NULL, stringc__is_valid( xs ), from <= xs.length );
+
+    if ( re->anchored && from > 0 ) { return false; }
+    Dfa * const d = lazy_dfa( &re->finder, &re->forward, false,
+                              PC_UNANCHORED, PC_ANCHORED );
+    if ( d == NULL ) { return false; }
+    // Find where the leftmost-first match ends:
+    size_t const n = xs.length;
+    StringC const prefix = stringc__view( re->prefix );
+    bool const skip = prefix.length > 0 && !re->anchored;
+    if ( skip ) { dfa__start( d, 0, false ); }
+    int32_t s = dfa__start( d, re->anchored, from == 0 );
+    size_t end = SIZE_MAX;
+    if ( s >= 0 && d->matches[ s ] ) { end = from; }
+    size_t i = from;
+    while ( s >= 0 && i < n ) {
+        if ( skip && end == SIZE_MAX && s == d->starts[ 0 ][ 0 ] ) {
+            // No match is under way, so skip to where one could start:
+            i = stringc__find( xs, prefix, i );
+            if ( i == SIZE_MAX ) { return false; }
+        }
+        s = dfa__next( d, s, ( unsigned char ) xs.e[ i++ ] );
+        if ( s >= 0 && d->matches[ s ] ) { end = i; }
+    }
+    if ( s == DFA_ERROR ) {
+        errno = ENOMEM;
+        return false;
+    }
+    if ( s >= 0 && dfa__matches_at_end( d, s, n == 0 ) ) { end = n; }
+    if ( end == SIZE_MAX ) { return false; }
+    // Find where it starts, by matching the reverse regex backwards:
+    Dfa * const r = lazy_dfa( &re->reverser, &re->reverse, true, 0, 0 );
+    if ( r == NULL ) { return false; }
+    s = dfa__start( r, 0, end == n );
+    size_t start = end;
+    i = end;
+    while ( s >= 0 && i > from ) {
+        s = dfa__next( r, s, ( unsigned char ) xs.e[ --i ] );
+        if ( s >= 0 && r->matches[ s ] ) { start = i; }
+    }
+    if ( s == DFA_ERROR ) {
+        errno = ENOMEM;
+        return false;
+    }
+    if ( s >= 0 && i == 0 && dfa__matches_at_end( r, s, n == 0 ) ) {
+        start = 0;
+    }
+    if ( found != NULL ) {
+        *found = ( StringC ){ .e = xs.e + start, .length = end - start };
+    }
+    return true;
+}
+
+
+bool
+stringregex__captures(
+        StringRegex * const re,
+        StringC const xs,
+        size_t const from,
+        StringC * const groups )
+{
+    ASSERT( re != NULL, stringc__is_valid( xs ), from <= xs.length,
+            groups != NULL );
+
+    StringC match;
+    if ( !stringregex__find( re, xs, from, &match ) ) { return false; }
+    size_t const start = ( size_t ) ( match.e - xs.e );
+    size_t const slots = 2 * ( re->groups + 1 );
+    size_t * const caps = malloc( slots * sizeof *caps );
+    Vm vm;
+    if ( caps == NULL || !vm__init( &vm, &re->forward, slots ) ) {
+        free( caps );
+        errno = ENOMEM;
+        return false;
+    }
+    vm__run( &vm, PC_ANCHORED, xs, start, start + match.length, caps );
+    vm__free( &vm );
+    for ( size_t g = 0; g <= re->groups; g++ ) {
+        size_t const lo = caps[ 2 * g ];
+        size_t const hi = caps[ 2 * g + 1 ];
+        groups[ g ] = ( lo == SIZE_MAX || hi == SIZE_MAX )
+                          ? ( StringC ){ .e = NULL, .length = 0 }
+                          : ( StringC ){ .e = xs.e + lo, .length = hi - lo };
+    }
+    free( caps );
+    return true;
+}
@@ -0,0 +1,105 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_REGEX_H
+#define LIBSTRING_STRING_REGEX_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// A compiled regular expression, matched against the bytes of a `StringC`
+// in time linear in the length of the string. The supported syntax is:
+//
+//     x  .  [xyz]  [^a-z]  \d \D \w \W \s \S  \n \t \r \f \v  \xHH
+//     xy  x|y  (x)  (?:x)  x*  x+  x?  x{m}  x{m,}  x{m,n}
+//     ^  $  (the start and end of the string)
+//
+// and quantifiers followed by `?` are lazy. A `.` matches any byte but `\n`,
+// and other punctuation (like `{`) is matched literally when escaped.
+// Matches are leftmost-first, as in Perl. Searching runs a lazily-built DFA
+// whose state cache is bounded by `STRING_REGEX_CACHE_SIZE` bytes (it's
+// flushed when it fills up). Capture groups are only computed when asked
+// for. A `StringRegex` caches DFA states as it's used, so it mustn't be used
+// by more than one thread at a time. If memory can't be allocated while
+// matching, the matching functions set `errno` to `ENOMEM` and return false.
+typedef struct stringregex StringRegex;
+
+
+// The bytes of DFA states that each of a regex's automatons may cache.
+#ifndef STRING_REGEX_CACHE_SIZE
+#define STRING_REGEX_CACHE_SIZE ( 2 * 1024 * 1024 )
+#endif
+
+
+// Compiles `pattern`. If it's invalid, this sets `errno` to `EINVAL`, sets
+// `*error_index` (if `error_index` isn't `NULL`) to the index of the byte at
+// which it's invalid, and returns `NULL`. If memory can't be allocated, this
+// sets `errno` to `ENOMEM` and returns `NULL`.
+StringRegex *
+stringregex__new(
+        StringC pattern,
+        size_t * error_index );
+
+
+void
+stringregex__free(
+        StringRegex * );
+
+
+// Returns the number of capture groups in the regex.
+size_t
+stringregex__groups(
+        StringRegex const * );
+
+
+// Returns true if the regex matches the entire string.
+bool
+stringregex__match(
+        StringRegex *,
+        StringC );
+
+
+// Finds the leftmost match starting at or after `from`, and sets `*found`
+// (if `found` isn't `NULL`) to the view of it. Returns false if there's no
+// such match. To find every match, search again from the end of each match,
+// or from one past it if the match was empty.
+bool
+stringregex__find(
+        StringRegex *,
+        StringC,
+        size_t from,
+        StringC * found );
+
+
+// Like `stringregex__find()`, but sets `groups[ 0 ]` to the view of the
+// match, and `groups[ i ]` to the view of what the `i`th capture group
+// matched, or to a view with `NULL` elements if it didn't participate in the
+// match. `groups` must have room for `stringregex__groups( re ) + 1` views.
+bool
+stringregex__captures(
+        StringRegex *,
+        StringC,
+        size_t from,
+        StringC * groups );
+
+
+#endif
@@ -0,0 +1,946 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-suffix.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>     // memcmp, memcpy
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/logic.h>     // IMPLIES
+#include <libmacro/minmax.h>    // MIN, MAX
+
+
+struct stringsuffixarray {
+    StringC text;
+    size_t * sa;
+};
+
+
+// A bit-vector with a directory of the number of set bits before every
+// block of `RANK_BLOCK_WORDS` words, to count them in constant time.
+typedef struct bits {
+    uint64_t * words;
+    uint64_t * blocks;
+    size_t length;
+} Bits;
+
+#define RANK_BLOCK_WORDS 8
+
+
+// A node of a wavelet tree: its bits (the next bit of the code of each byte
+// that reaches it) are those from `offset` in the tree's bit-vector, with
+// `ones_before` set bits before them. Its children are nodes if they're
+// positive, and otherwise leaves for the byte `-child - 1`.
+typedef struct wavelet_node {
+    size_t offset;
+    size_t ones_before;
+    int child[ 2 ];
+} WaveletNode;
+
+
+struct stringfmindex {
+    size_t length;
+    // The row of the sorted rotations of the text and its end marker that
+    // ends with the end marker, which isn't stored in the tree:
+    size_t primary;
+    // The number of rows starting with the end marker or a byte less than
+    // each byte:
+    size_t starts[ UCHAR_MAX + 1 ];
+    // The wavelet tree of the rest of the last column, with the Huffman
+    // codes of its bytes (most significant bit first):
+    Bits tree;
+    WaveletNode nodes[ UCHAR_MAX + 1 ];
+    uint64_t codes[ UCHAR_MAX + 1 ];
+    unsigned char code_lengths[ UCHAR_MAX + 1 ];
+    // Which rows are sampled, and the text positions of those rows in order:
+    size_t sample_rate;
+    Bits sampled;
+    size_t * samples;
+};
+
+
+
+///////////////////////////////////
+/// SA-IS
+///////////////////////////////////
+
+
+// SA-IS works on the text, and then recursively on strings of names of its
+// substrings, so symbols are read from whichever of these isn't `NULL`.
+typedef struct symbols {
+    unsigned char const * bytes;
+    size_t const * wide;
+} Symbols;
+
+
+static
+size_t
+symbol(
+        Symbols const s,
+        size_t const i )
+{
+    return ( s.bytes != NULL ) ? s.bytes[ i ] : s.wide[ i ];
+}
+
+
+static
+bool
+bit_get(
+        uint64_t const * const ws,
+        size_t const i )
+{
+    return ( ws[ i / 64 ] >> ( i % 64 ) ) & 1;
+}
+
+
+static
+void
+bit_set(
+        uint64_t * const ws,
+        size_t const i )
+{
+    ws[ i / 64 ] |= UINT64_C( 1 ) << ( i % 64 );
+}
+
+
+typedef struct sais {
+    Symbols s;
+    size_t n;
+    size_t upper;
+    size_t * sa;
+    // Whether each suffix is S-type (less than the suffix after it):
+    uint64_t * stype;
+    // The start of each symbol's bucket, and of the S-type part of it:
+    size_t * l_starts;
+    size_t * s_starts;
+    size_t * buf;
+    // The index of each LMS suffix (an S-type suffix after an L-type one)
+    // among them, or `SIZE_MAX` for the other suffixes:
+    size_t * lms_map;
+    // Room for each of the LMS suffixes, of which there are `m`:
+    size_t m;
+    size_t * lms;
+    size_t * sorted;
+    size_t * names;
+    size_t * names_sa;
+} Sais;
+
+
+static
+bool
+sais(
+        Symbols s,
+        size_t n,
+        size_t upper,
+        size_t * sa );
+
+
+// Induces the order of all the suffixes from the order of the LMS suffixes
+// given by `lms`.
+static
+void
+sais__induce(
+        Sais const * const st,
+        size_t const * const lms )
+{
+    size_t const n = st->n;
+    size_t * const sa = st->sa;
+    for ( size_t i = 0; i < n; i++ ) {
+        sa[ i ] = SIZE_MAX;
+    }
+    memcpy( st->buf, st->s_starts, ( st->upper + 1 ) * sizeof *st->buf );
+    for ( size_t i = 0; i < st->m; i++ ) {
+        sa[ st->buf[ symbol( st->s, lms[ i ] ) ]++ ] = lms[ i ];
+    }
+    memcpy( st->buf, st->l_starts, ( st->upper + 1 ) * sizeof *st->buf );
+    sa[ st->buf[ symbol( st->s, n - 1 ) ]++ ] = n - 1;
+    for ( size_t i = 0; i < n; i++ ) {
+        size_t const v = sa[ i ];
+        if ( v != SIZE_MAX && v > 0 && !bit_get( st->stype, v - 1 ) ) {
+            sa[ st->buf[ symbol( st->s, v - 1 ) ]++ ] = v - 1;
+        }
+    }
+    memcpy( st->buf, st->l_starts, ( st->upper + 2 ) * sizeof *st->buf );
+    for ( size_t i = n; i-- > 0; ) {
+        size_t const v = sa[ i ];
+        if ( v != SIZE_MAX && v > 0 && bit_get( st->stype, v - 1 ) ) {
+            sa[ --st->buf[ symbol( st->s, v - 1 ) + 1 ] ] = v - 1;
+        }
+    }
+}
+
+
+// Returns the end of the LMS substring at `i`: the start of the next LMS
+// suffix, or the end of the string.
+static
+size_t
+sais__lms_end(
+        Sais const * const st,
+        size_t const i )
+{
+    size_t const next = st->lms_map[ i ] + 1;
+    return ( next < st->m ) ? st->lms[ next ] : st->n;
+}
+
+
+static
+bool
+sais__same_lms(
+        Sais const * const st,
+        size_t l,
+        size_t r )
+{
+    size_t const end_l = sais__lms_end( st, l );
+    if ( end_l - l != sais__lms_end( st, r ) - r ) {
+        return false;
+    }
+    while ( l < end_l && symbol( st->s, l ) == symbol( st->s, r ) ) {
+        l++;
+        r++;
+    }
+    return l != st->n && symbol( st->s, l ) == symbol( st->s, r );
+}
+
+
+// Sorts the suffixes with the working memory of `st` allocated. Returns
+// false if memory couldn't be allocated for the recursion.
+static
+bool
+sais__sort(
+        Sais * const st )
+{
+    Symbols const s = st->s;
+    size_t const n = st->n;
+    for ( size_t i = n - 1; i-- > 0; ) {
+        size_t const x = symbol( s, i );
+        size_t const y = symbol( s, i + 1 );
+        if ( x < y || ( x == y && bit_get( st->stype, i + 1 ) ) ) {
+            bit_set( st->stype, i );
+        }
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( bit_get( st->stype, i ) ) {
+            st->l_starts[ symbol( s, i ) + 1 ]++;
+        } else {
+            st->s_starts[ symbol( s, i ) ]++;
+        }
+    }
+    for ( size_t c = 0; c <= st->upper; c++ ) {
+        st->s_starts[ c ] += st->l_starts[ c ];
+        st->l_starts[ c + 1 ] += st->s_starts[ c ];
+    }
+    st->lms_map[ 0 ] = SIZE_MAX;
+    for ( size_t i = 1; i < n; i++ ) {
+        if ( !bit_get( st->stype, i - 1 ) && bit_get( st->stype, i ) ) {
+            st->lms_map[ i ] = st->m;
+            st->lms[ st->m++ ] = i;
+        } else {
+            st->lms_map[ i ] = SIZE_MAX;
+        }
+    }
+    sais__induce( st, st->lms );
+    if ( st->m == 0 ) {
+        return true;
+    }
+    // Name the LMS substrings by their order, and sort the string of names
+    // to find the order of the LMS suffixes:
+    size_t k = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( st->lms_map[ st->sa[ i ] ] != SIZE_MAX ) {
+            st->sorted[ k++ ] = st->sa[ i ];
+        }
+    }
+    size_t upper = 0;
+    st->names[ st->lms_map[ st->sorted[ 0 ] ] ] = 0;
+    for ( size_t i = 1; i < st->m; i++ ) {
+        if ( !sais__same_lms( st, st->sorted[ i - 1 ], st->sorted[ i ] ) ) {
+            upper++;
+        }
+        st->names[ st->lms_map[ st->sorted[ i ] ] ] = upper;
+    }
+    if ( !sais( ( Symbols ){ .wide = st->names }, st->m, upper,
+                st->names_sa ) ) {
+        return false;
+    }
+    for ( size_t i = 0; i < st->m; i++ ) {
+        st->sorted[ i ] = st->lms[ st->names_sa[ i ] ];
+    }
+    sais__induce( st, st->sorted );
+    return true;
+}
+
+
+// Sets `sa` to the suffix array of the `n` symbols of `s`, which are each
+// at most `upper`. This works as if there were a unique least symbol after
+// the last. Returns false if memory couldn't be allocated.
+static
+bool
+sais(
+        Symbols const s,
+        size_t const n,
+        size_t const upper,
+        size_t * const sa )
+{
+    if ( n <= 2 ) {
+        bool const swap = n == 2 && symbol( s, 0 ) >= symbol( s, 1 );
+        for ( size_t i = 0; i < n; i++ ) {
+            sa[ i ] = swap ? n - 1 - i : i;
+        }
+        return true;
+    }
+    // There's at most one LMS suffix for every two symbols:
+    size_t const max_lms = n / 2 + 1;
+    Sais st = {
+        .s = s, .n = n, .upper = upper, .sa = sa,
+        .stype = calloc( n / 64 + 1, sizeof *st.stype ),
+        .l_starts = calloc( upper + 2, sizeof *st.l_starts ),
+        .s_starts = calloc( upper + 2, sizeof *st.s_starts ),
+        .buf = malloc( ( upper + 2 ) * sizeof *st.buf ),
+        .lms_map = malloc( n * sizeof *st.lms_map ),
+        .lms = malloc( 4 * max_lms * sizeof *st.lms )
+    };
+    bool ok = st.stype != NULL && st.l_starts != NULL
+           && st.s_starts != NULL && st.buf != NULL
+           && st.lms_map != NULL && st.lms != NULL;
+    if ( ok ) {
+        st.sorted = st.lms + max_lms;
+        st.names = st.sorted + max_lms;
+        st.names_sa = st.names + max_lms;
+        ok = sais__sort( &st );
+    }
+    free( st.stype );
+    free( st.l_starts );
+    free( st.s_starts );
+    free( st.buf );
+    free( st.lms_map );
+    free( st.lms );
+    return ok;
+}
+
+
+
+///////////////////////////////////
+/// SUFFIX ARRAYS
+///////////////////////////////////
+
+
+StringSuffixArray *
+stringsuffixarray__new(
+        StringC const text )
+{
+    ASSERT( stringc__is_valid( text ) );
+
+    StringSuffixArray * const sa = malloc( sizeof *sa );
+    size_t * const xs = malloc( MAX( text.length, 1 ) * sizeof *xs );
+    if ( sa == NULL || xs == NULL
+      || !sais( ( Symbols ){ .bytes = ( unsigned char const * ) text.e },
+                text.length, UCHAR_MAX, xs ) ) {
+        free( sa );
+        free( xs );
+        errno = ENOMEM;
+        return NULL;
+    }
+    *sa = ( StringSuffixArray ){ .text = text, .sa = xs };
+    return sa;
+}
+
+
+void
+stringsuffixarray__free(
+        StringSuffixArray * const sa )
+{
+    if ( sa != NULL ) {
+        free( sa->sa );
+        free( sa );
+    }
+}
+
+
+StringC
+stringsuffixarray__text(
+        StringSuffixArray const * const sa )
+{
+    ASSERT( sa != NULL );
+
+    return sa->text;
+}
+
+
+// Compares the suffix at `pos` of `text` with `pattern`, considering only as
+// much of the suffix as the pattern is long.
+static
+int
+compare_prefix(
+        StringC const text,
+        size_t const pos,
+        StringC const pattern )
+{
+    size_t const len = MIN( text.length - pos, pattern.length );
+    int const c = memcmp( text.e + pos, pattern.e, len );
+    if ( c != 0 ) {
+        return c;
+    }
+    return ( len < pattern.length ) ? -1 : 0;
+}
+
+
+// Returns the first index of the suffix array whose suffix compares greater
+// than or equal to `pattern` by `compare_prefix()` (or greater than it, if
+// `after`).
+static
+size_t
+bound(
+        StringSuffixArray const * const sa,
+        StringC const pattern,
+        bool const after )
+{
+    size_t lo = 0;
+    size_t hi = sa->text.length;
+    while ( lo < hi ) {
+        size_t const mid = lo + ( hi - lo ) / 2;
+        int const c = compare_prefix( sa->text, sa->sa[ mid ], pattern );
+        if ( c < 0 || ( after && c == 0 ) ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+size_t
+stringsuffixarray__count(
+        StringSuffixArray const * const sa,
+        StringC const pattern )
+{
+    ASSERT( sa != NULL, stringc__is_valid( pattern ),
+            stringc__isnt_empty( pattern ) );
+
+    return bound( sa, pattern, true ) - bound( sa, pattern, false );
+}
+
+
+size_t
+stringsuffixarray__locate(
+        StringSuffixArray const * const sa,
+        StringC const pattern,
+        size_t * const positions,
+        size_t const max )
+{
+    ASSERT( sa != NULL, stringc__is_valid( pattern ),
+            stringc__isnt_empty( pattern ),
+            IMPLIES( max > 0, positions != NULL ) );
+
+    size_t const first = bound( sa, pattern, false );
+    size_t const end = bound( sa, pattern, true );
+    for ( size_t i = first; i < end && i - first < max; i++ ) {
+        positions[ i - first ] = sa->sa[ i ];
+    }
+    return end - first;
+}
+
+
+
+///////////////////////////////////
+/// BIT-VECTORS
+///////////////////////////////////
+
+
+static
+unsigned
+popcount(
+        uint64_t x )
+{
+    x = x - ( ( x >> 1 ) & UINT64_C( 0x5555555555555555 ) );
+    x = ( x & UINT64_C( 0x3333333333333333 ) )
+      + ( ( x >> 2 ) & UINT64_C( 0x3333333333333333 ) );
+    x = ( x + ( x >> 4 ) ) & UINT64_C( 0x0F0F0F0F0F0F0F0F );
+    return ( unsigned ) ( ( x * UINT64_C( 0x0101010101010101 ) ) >> 56 );
+}
+
+
+// Allocates `b` for `length` bits, all clear. Returns false if memory
+// couldn't be allocated.
+static
+bool
+bits__init(
+        Bits * const b,
+        size_t const length )
+{
+    size_t const words = length / 64 + 1;
+    *b = ( Bits ){
+        .words = calloc( words, sizeof *b->words ),
+        .blocks = malloc( ( words / RANK_BLOCK_WORDS + 1 )
+                          * sizeof *b->blocks ),
+        .length = length
+    };
+    return b->words != NULL && b->blocks != NULL;
+}
+
+
+static
+void
+bits__free(
+        Bits * const b )
+{
+    free( b->words );
+    free( b->blocks );
+}
+
+
+// Fills in the rank directory of `b`, once its bits are set.
+static
+void
+bits__index(
+        Bits * const b )
+{
+    size_t const words = b->length / 64 + 1;
+    uint64_t ones = 0;
+    for ( size_t w = 0; w < words; w++ ) {
+        if ( w % RANK_BLOCK_WORDS == 0 ) {
+            b->blocks[ w / RANK_BLOCK_WORDS ] = ones;
+        }
+        ones += popcount( b->words[ w ] );
+    }
+}
+
+
+// Returns the number of set bits before `i`.
+static
+size_t
+bits__rank(
+        Bits const * const b,
+        size_t const i )
+{
+    size_t const w = i / 64;
+    size_t r = b->blocks[ w / RANK_BLOCK_WORDS ];
+    for ( size_t v = w - w % RANK_BLOCK_WORDS; v < w; v++ ) {
+        r += popcount( b->words[ v ] );
+    }
+    if ( i % 64 != 0 ) {
+        r += popcount( b->words[ w ] << ( 64 - i % 64 ) );
+    }
+    return r;
+}
+
+
+
+///////////////////////////////////
+/// WAVELET TREES
+///////////////////////////////////
+
+
+// Sets the Huffman code lengths of the bytes with the given frequencies, or
+// returns false if some code would be longer than 64 bits. A byte that's
+// the only one present is given a code of one bit.
+static
+bool
+huffman_lengths(
+        size_t const * const freqs,
+        unsigned char * const lengths )
+{
+    // The nodes of the Huffman tree are the bytes and then the internal
+    // nodes, each with its weight and its parent:
+    size_t weights[ 2 * ( UCHAR_MAX + 1 ) ];
+    size_t parents[ 2 * ( UCHAR_MAX + 1 ) ];
+    bool done[ 2 * ( UCHAR_MAX + 1 ) ];
+    size_t n = 0;
+    for ( size_t c = 0; c <= UCHAR_MAX; c++ ) {
+        weights[ c ] = freqs[ c ];
+        parents[ c ] = SIZE_MAX;
+        done[ c ] = freqs[ c ] == 0;
+        n += freqs[ c ] > 0;
+        lengths[ c ] = 0;
+    }
+    size_t nodes = UCHAR_MAX + 1;
+    for ( size_t joins = 1; joins < n; joins++ ) {
+        size_t least[ 2 ] = { SIZE_MAX, SIZE_MAX };
+        for ( size_t i = 0; i < nodes; i++ ) {
+            if ( done[ i ] ) {
+                continue;
+            } else if ( least[ 0 ] == SIZE_MAX
+                     || weights[ i ] < weights[ least[ 0 ] ] ) {
+                least[ 1 ] = least[ 0 ];
+                least[ 0 ] = i;
+            } else if ( least[ 1 ] == SIZE_MAX
+                     || weights[ i ] < weights[ least[ 1 ] ] ) {
+                least[ 1 ] = i;
+            }
+        }
+        weights[ nodes ] = weights[ least[ 0 ] ] + weights[ least[ 1 ] ];
+        parents[ nodes ] = SIZE_MAX;
+        done[ nodes ] = false;
+        parents[ least[ 0 ] ] = parents[ least[ 1 ] ] = nodes;
+        done[ least[ 0 ] ] = done[ least[ 1 ] ] = true;
+        nodes++;
+    }
+    for ( size_t c = 0; c <= UCHAR_MAX; c++ ) {
+        if ( freqs[ c ] == 0 ) {
+            continue;
+        }
+        size_t length = 0;
+        for ( size_t i = c; parents[ i ] != SIZE_MAX; i = parents[ i ] ) {
+            length++;
+        }
+        if ( length > 64 ) {
+            return false;
+        }
+        lengths[ c ] = ( unsigned char ) MAX( length, 1 );
+    }
+    return true;
+}
+
+
+// Sets the codes of `fm` from its code lengths, as canonical Huffman codes,
+// and builds the (empty) nodes that they need, with the number of bits
+// each node will hold in its `offset`. Returns the number of nodes.
+static
+size_t
+build_codes(
+        StringFMIndex * const fm,
+        size_t const * const freqs )
+{
+    uint64_t code = 0;
+    unsigned prev = 0;
+    size_t nodes = 1;
+    fm->nodes[ 0 ] = ( WaveletNode ){ .child = { 0, 0 } };
+    for ( unsigned len = 1; len <= 64; len++ ) {
+        for ( size_t c = 0; c <= UCHAR_MAX; c++ ) {
+            if ( fm->code_lengths[ c ] != len ) {
+                continue;
+            }
+            code = ( prev == 0 ) ? 0 : ( code + 1 ) << ( len - prev );
+            prev = len;
+            fm->codes[ c ] = code;
+            size_t node = 0;
+            for ( unsigned d = 0; d < len; d++ ) {
+                int const b = ( code >> ( len - 1 - d ) ) & 1;
+                fm->nodes[ node ].offset += freqs[ c ];
+                if ( d + 1 == len ) {
+                    fm->nodes[ node ].child[ b ] = -( int ) c - 1;
+                } else {
+                    if ( fm->nodes[ node ].child[ b ] == 0 ) {
+                        fm->nodes[ nodes ] = ( WaveletNode ){ 0 };
+                        fm->nodes[ node ].child[ b ] = ( int ) nodes++;
+                    }
+                    node = ( size_t ) fm->nodes[ node ].child[ b ];
+                }
+            }
+        }
+    }
+    return nodes;
+}
+
+
+// Returns the byte at index `i` of the last column (without the end
+// marker), and sets `*rank` to the number of times it occurs before `i`.
+static
+unsigned char
+wavelet_access(
+        StringFMIndex const * const fm,
+        size_t i,
+        size_t * const rank )
+{
+    WaveletNode const * node = &fm->nodes[ 0 ];
+    for ( ;; ) {
+        bool const b = bit_get( fm->tree.words, node->offset + i );
+        size_t const ones = bits__rank( &fm->tree, node->offset + i )
+                          - node->ones_before;
+        i = b ? ones : i - ones;
+        int const child = node->child[ b ];
+        if ( child < 0 ) {
+            *rank = i;
+            return ( unsigned char ) ( -child - 1 );
+        }
+        node = &fm->nodes[ child ];
+    }
+}
+
+
+// Returns the number of times that `c` occurs before index `i` of the last
+// column (without the end marker).
+static
+size_t
+wavelet_rank(
+        StringFMIndex const * const fm,
+        unsigned char const c,
+        size_t i )
+{
+    unsigned const len = fm->code_lengths[ c ];
+    WaveletNode const * node = &fm->nodes[ 0 ];
+    for ( unsigned d = 0; d < len; d++ ) {
+        int const b = ( fm->codes[ c ] >> ( len - 1 - d ) ) & 1;
+        size_t const ones = bits__rank( &fm->tree, node->offset + i )
+                          - node->ones_before;
+        i = b ? ones : i - ones;
+        if ( d + 1 < len ) {
+            node = &fm->nodes[ node->child[ b ] ];
+        }
+    }
+    return i;
+}
+
+
+// Returns the number of rows before `row` whose last byte is `c`.
+static
+size_t
+fm_rank(
+        StringFMIndex const * const fm,
+        unsigned char const c,
+        size_t const row )
+{
+    if ( fm->code_lengths[ c ] == 0 ) {
+        return 0;
+    }
+    return wavelet_rank( fm, c, row - ( row > fm->primary ) );
+}
+
+
+
+///////////////////////////////////
+/// FM-INDEXES
+///////////////////////////////////
+
+
+// Builds the wavelet tree of the last column of `fm`, returning false if
+// memory couldn't be allocated.
+static
+bool
+build_tree(
+        StringFMIndex * const fm,
+        StringSuffixArray const * const sa )
+{
+    StringC const text = sa->text;
+    size_t const n = text.length;
+    size_t freqs[ UCHAR_MAX + 1 ] = { 0 };
+    for ( size_t i = 0; i < n; i++ ) {
+        freqs[ ( unsigned char ) text.e[ i ] ]++;
+    }
+    size_t total = 1;
+    for ( size_t c = 0; c <= UCHAR_MAX; c++ ) {
+        fm->starts[ c ] = total;
+        total += freqs[ c ];
+    }
+    if ( !huffman_lengths( freqs, fm->code_lengths ) ) {
+        // Fall back to the byte values as codes:
+        for ( size_t c = 0; c <= UCHAR_MAX; c++ ) {
+            fm->code_lengths[ c ] = ( freqs[ c ] == 0 ) ? 0 : 8;
+        }
+    }
+    size_t const nodes = build_codes( fm, freqs );
+    size_t bits = 0;
+    for ( size_t i = 0; i < nodes; i++ ) {
+        size_t const length = fm->nodes[ i ].offset;
+        fm->nodes[ i ].offset = bits;
+        bits += length;
+    }
+    if ( !bits__init( &fm->tree, bits ) ) {
+        return false;
+    }
+    size_t * const fill = malloc( MAX( nodes, 1 ) * sizeof *fill );
+    if ( fill == NULL ) {
+        return false;
+    }
+    for ( size_t i = 0; i < nodes; i++ ) {
+        fill[ i ] = fm->nodes[ i ].offset;
+    }
+    // The last column, in row order: row 0 is the rotation starting with
+    // the end marker, and row `r + 1` is the rotation starting with the
+    // `r`th suffix in the suffix array.
+    for ( size_t r = 0; r <= n; r++ ) {
+        size_t const pos = ( r == 0 ) ? n : sa->sa[ r - 1 ];
+        if ( pos == 0 ) {
+            fm->primary = r;
+            continue;
+        }
+        unsigned char const c = ( unsigned char ) text.e[ pos - 1 ];
+        unsigned const len = fm->code_lengths[ c ];
+        size_t node = 0;
+        for ( unsigned d = 0; d < len; d++ ) {
+            int const b = ( fm->codes[ c ] >> ( len - 1 - d ) ) & 1;
+            if ( b ) {
+                bit_set( fm->tree.words, fill[ node ] );
+            }
+            fill[ node ]++;
+            node = ( size_t ) fm->nodes[ node ].child[ b ];
+        }
+    }
+    free( fill );
+    bits__index( &fm->tree );
+    for ( size_t i = 0; i < nodes; i++ ) {
+        fm->nodes[ i ].ones_before = bits__rank( &fm->tree,
+                                                 fm->nodes[ i ].offset );
+    }
+    return true;
+}
+
+
+// Samples the rows of the text positions that are multiples of the sample
+// rate, returning false if memory couldn't be allocated.
+static
+bool
+build_samples(
+        StringFMIndex * const fm,
+        StringSuffixArray const * const sa )
+{
+    size_t const n = sa->text.length;
+    if ( !bits__init( &fm->sampled, n + 1 ) ) {
+        return false;
+    }
+    fm->samples = malloc( ( n / fm->sample_rate + 1 ) * sizeof *fm->samples );
+    if ( fm->samples == NULL ) {
+        return false;
+    }
+    size_t k = 0;
+    for ( size_t r = 0; r <= n; r++ ) {
+        size_t const pos = ( r == 0 ) ? n : sa->sa[ r - 1 ];
+        if ( pos % fm->sample_rate == 0 ) {
+            bit_set( fm->sampled.words, r );
+            fm->samples[ k++ ] = pos;
+        }
+    }
+    bits__index( &fm->sampled );
+    return true;
+}
+
+
+StringFMIndex *
+stringfmindex__new(
+        StringSuffixArray const * const sa,
+        size_t const sample_rate )
+{
+    ASSERT( sa != NULL, sample_rate > 0 );
+
+    StringFMIndex * const fm = calloc( 1, sizeof *fm );
+    if ( fm == NULL ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    fm->length = sa->text.length;
+    fm->sample_rate = sample_rate;
+    if ( !build_tree( fm, sa ) || !build_samples( fm, sa ) ) {
+        stringfmindex__free( fm );
+        errno = ENOMEM;
+        return NULL;
+    }
+    return fm;
+}
+
+
+void
+stringfmindex__free(
+        StringFMIndex * const fm )
+{
+    if ( fm != NULL ) {
+        bits__free( &fm->tree );
+        bits__free( &fm->sampled );
+        free( fm->samples );
+        free( fm );
+    }
+}
+
+
+size_t
+stringfmindex__length(
+        StringFMIndex const * const fm )
+{
+    ASSERT( fm != NULL );
+
+    return fm->length;
+}
+
+
+// Sets `*first` and `*end` to the range of rows starting with `pattern`.
+static
+void
+backward_search(
+        StringFMIndex const * const fm,
+        StringC const pattern,
+        size_t * const first,
+        size_t * const end )
+{
+    size_t f = 0;
+    size_t e = fm->length + 1;
+    for ( size_t i = pattern.length; i-- > 0 && f < e; ) {
+        unsigned char const c = ( unsigned char ) pattern.e[ i ];
+        f = fm->starts[ c ] + fm_rank( fm, c, f );
+        e = fm->starts[ c ] + fm_rank( fm, c, e );
+    }
+    *first = f;
+    *end = MAX( f, e );
+}
+
+
+size_t
+stringfmindex__count(
+        StringFMIndex const * const fm,
+        StringC const pattern )
+{
+    ASSERT( fm != NULL, stringc__is_valid( pattern ),
+            stringc__isnt_empty( pattern ) );
+
+    size_t first;
+    size_t end;
+    backward_search( fm, pattern, &first, &end );
+    return end - first;
+}
+
+
+// Returns the text position of the suffix of `row`, by stepping back
+// through the text until reaching a sampled position.
+static
+size_t
+locate_row(
+        StringFMIndex const * const fm,
+        size_t row )
+{
+    size_t steps = 0;
+    while ( !bit_get( fm->sampled.words, row ) ) {
+        size_t rank;
+        unsigned char const c = wavelet_access(
+            fm, row - ( row > fm->primary ), &rank );
+        row = fm->starts[ c ] + rank;
+        steps++;
+    }
+    return fm->samples[ bits__rank( &fm->sampled, row ) ] + steps;
+}
+
+
+size_t
+stringfmindex__locate(
+        StringFMIndex const * const fm,
+        StringC const pattern,
+        size_t * const positions,
+        size_t const max )
+{
+    ASSERT( fm != NULL, stringc__is_valid( pattern ),
+            stringc__isnt_empty( pattern ),
+            IMPLIES( max > 0, positions != NULL ) );
+
+    size_t first;
+    size_t end;
+    backward_search( fm, pattern, &first, &end );
+    for ( size_t r = first; r < end && r - first < max; r++ ) {
+        positions[ r - first ] = locate_row( fm, r );
+    }
+    return end - first;
+}
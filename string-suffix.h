@@ -0,0 +1,120 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_SUFFIX_H
+#define LIBSTRING_STRING_SUFFIX_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// The suffix array of a text: the starting positions of all of its suffixes,
+// in byte-wise order, built in linear time with SA-IS. It views the text
+// rather than copying it, so the text must outlive it. Queries take
+// `O( m log n )` time for a pattern of `m` bytes in a text of `n` bytes.
+typedef struct stringsuffixarray StringSuffixArray;
+
+
+// An FM-index of a text, built from its suffix array: its Burrows-Wheeler
+// transform, stored in a wavelet tree shaped by the Huffman codes of its
+// bytes, along with a sample of the suffix array. It doesn't need the text
+// or the suffix array once built. Counting takes `O( m * H )` time for a
+// pattern of `m` bytes, where `H` is the average length of the Huffman
+// codes (at most 8 for most texts), independent of the length of the text,
+// and locating takes `O( sample_rate * H )` more for each occurrence.
+typedef struct stringfmindex StringFMIndex;
+
+
+// Builds the suffix array of `text`. If memory can't be allocated, this
+// sets `errno` to `ENOMEM` and returns `NULL`.
+StringSuffixArray *
+stringsuffixarray__new(
+        StringC text );
+
+
+void
+stringsuffixarray__free(
+        StringSuffixArray * );
+
+
+// Returns the text that the suffix array is of.
+StringC
+stringsuffixarray__text(
+        StringSuffixArray const * );
+
+
+// Returns the number of (possibly overlapping) occurrences of `pattern` in
+// the text.
+size_t
+stringsuffixarray__count(
+        StringSuffixArray const *,
+        StringC pattern );
+
+
+// Sets the first `max` elements of `positions` to the positions of the
+// occurrences of `pattern` in the text, in byte-wise order of the suffixes
+// starting there, and returns how many occurrences there are in total.
+size_t
+stringsuffixarray__locate(
+        StringSuffixArray const *,
+        StringC pattern,
+        size_t * positions,
+        size_t max );
+
+
+// Builds an FM-index of the text of `sa` that samples every `sample_rate`th
+// position of the suffix array, so that it takes about `n / sample_rate`
+// words more than the transformed text itself. If memory can't be
+// allocated, this sets `errno` to `ENOMEM` and returns `NULL`.
+StringFMIndex *
+stringfmindex__new(
+        StringSuffixArray const * sa,
+        size_t sample_rate );
+
+
+void
+stringfmindex__free(
+        StringFMIndex * );
+
+
+// Returns the length of the indexed text.
+size_t
+stringfmindex__length(
+        StringFMIndex const * );
+
+
+// Like `stringsuffixarray__count()`.
+size_t
+stringfmindex__count(
+        StringFMIndex const *,
+        StringC pattern );
+
+
+// Like `stringsuffixarray__locate()`.
+size_t
+stringfmindex__locate(
+        StringFMIndex const *,
+        StringC pattern,
+        size_t * positions,
+        size_t max );
+
+
+#endif
@@ -0,0 +1,605 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-symbols.h"
+
+#include <errno.h>
+#include <limits.h>     // UCHAR_MAX
+#include <stdlib.h>
+#include <string.h>     // memcmp, memcpy, memset
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/logic.h>     // IMPLIES
+#include <libmacro/minmax.h>    // MIN
+
+
+// The code that says the next byte is a literal, and so the most symbols
+// that a table may have.
+#define ESCAPE 255
+
+#define SYMBOL_LENGTH_MAX 8
+
+// Training compresses a sample of about this many bytes of the strings,
+// and then builds a table from the symbols and pairs of adjacent symbols
+// that saved the most, this many times over.
+#define SAMPLE_BYTES ( 64 * 1024 )
+#define GENERATIONS  5
+
+// The codes counted while training: those of the symbols, and then one for
+// each literal byte.
+#define TRAINING_CODES ( 2 * ( UCHAR_MAX + 1 ) )
+
+// The slots of the hash table of symbols of three bytes or more, which must
+// be a power of two.
+#define LONG_SLOTS 1024
+
+// The entries of the tables of symbols of one and two bytes say how many
+// bytes a code takes in the top byte, and the code in the bottom byte.
+#define SHORT_NONE 0xFFFF
+
+
+typedef struct symbol {
+    char bytes[ SYMBOL_LENGTH_MAX ];
+    size_t length;
+} Symbol;
+
+
+typedef struct long_slot {
+    bool used;
+    unsigned char code;
+    uint32_t prefix;
+} LongSlot;
+
+
+struct stringsymboltable {
+    size_t count;
+    Symbol symbols[ ESCAPE ];
+    // The symbols of three bytes or more, by their first three bytes (of
+    // which no two symbols have the same):
+    LongSlot slots[ LONG_SLOTS ];
+    // The longest symbol of at most two bytes at the start of each pair of
+    // bytes (the first in the low byte of the index), and of each byte:
+    uint16_t short_codes[ 1 << 16 ];
+    uint16_t byte_codes[ UCHAR_MAX + 1 ];
+};
+
+
+
+///////////////////////////////////
+/// TABLES
+///////////////////////////////////
+
+
+static
+uint32_t
+prefix_of(
+        unsigned char const * const xs )
+{
+    return ( uint32_t ) xs[ 0 ]
+         | ( uint32_t ) xs[ 1 ] << 8
+         | ( uint32_t ) xs[ 2 ] << 16;
+}
+
+
+// Returns the slot holding the symbol starting with `prefix`, or the empty
+// slot where it would go.
+static
+LongSlot *
+find_slot(
+        StringSymbolTable * const t,
+        uint32_t const prefix )
+{
+    size_t i = ( prefix * UINT32_C( 2654435761 ) ) >> 22;
+    while ( t->slots[ i ].used && t->slots[ i ].prefix != prefix ) {
+        i = ( i + 1 ) % LONG_SLOTS;
+    }
+    return &t->slots[ i ];
+}
+
+
+static
+void
+table__clear(
+        StringSymbolTable * const t )
+{
+    t->count = 0;
+    memset( t->slots, 0, sizeof t->slots );
+    for ( size_t i = 0; i < ( 1 << 16 ); i++ ) {
+        t->short_codes[ i ] = SHORT_NONE;
+    }
+    for ( size_t i = 0; i <= UCHAR_MAX; i++ ) {
+        t->byte_codes[ i ] = SHORT_NONE;
+    }
+}
+
+
+// Adds `s` to the table, unless it's full or already has a symbol that
+// can't be told apart from `s` by its lookup tables. Returns true if `s`
+// was added.
+static
+bool
+table__add(
+        StringSymbolTable * const t,
+        Symbol const s )
+{
+    if ( t->count == ESCAPE ) {
+        return false;
+    }
+    unsigned char const * const xs = ( unsigned char const * ) s.bytes;
+    unsigned char const code = ( unsigned char ) t->count;
+    if ( s.length >= 3 ) {
+        LongSlot * const slot = find_slot( t, prefix_of( xs ) );
+        if ( slot->used ) {
+            return false;
+        }
+        *slot = ( LongSlot ){ .used = true, .code = code,
+                              .prefix = prefix_of( xs ) };
+    } else {
+        uint16_t * const e = ( s.length == 2 )
+                           ? &t->short_codes[ xs[ 0 ] | xs[ 1 ] << 8 ]
+                           : &t->byte_codes[ xs[ 0 ] ];
+        if ( *e != SHORT_NONE ) {
+            return false;
+        }
+        *e = ( uint16_t ) ( s.length << 8 | code );
+    }
+    t->symbols[ t->count++ ] = s;
+    return true;
+}
+
+
+// Fills in the gaps of the tables of short symbols, once all of the
+// symbols have been added.
+static
+void
+table__finish(
+        StringSymbolTable * const t )
+{
+    for ( size_t i = 0; i <= UCHAR_MAX; i++ ) {
+        if ( t->byte_codes[ i ] == SHORT_NONE ) {
+            t->byte_codes[ i ] = 1 << 8 | ESCAPE;
+        }
+    }
+    for ( size_t i = 0; i < ( 1 << 16 ); i++ ) {
+        if ( t->short_codes[ i ] == SHORT_NONE ) {
+            t->short_codes[ i ] = t->byte_codes[ i & 0xFF ];
+        }
+    }
+}
+
+
+// Returns the code of the longest symbol at the start of the `n` bytes of
+// `xs` (or `ESCAPE` if there is none), and sets `*length` to its length.
+static
+unsigned char
+table__match(
+        StringSymbolTable const * const t,
+        unsigned char const * const xs,
+        size_t const n,
+        size_t * const length )
+{
+    if ( n >= 3 ) {
+        LongSlot const * const slot = find_slot(
+            ( StringSymbolTable * ) t, prefix_of( xs ) );
+        if ( slot->used ) {
+            Symbol const * const s = &t->symbols[ slot->code ];
+            if ( s->length <= n
+              && memcmp( s->bytes + 3, xs + 3, s->length - 3 ) == 0 ) {
+                *length = s->length;
+                return slot->code;
+            }
+        }
+    }
+    uint16_t const e = ( n >= 2 ) ? t->short_codes[ xs[ 0 ] | xs[ 1 ] << 8 ]
+                                  : t->byte_codes[ xs[ 0 ] ];
+    *length = e >> 8;
+    return e & 0xFF;
+}
+
+
+// Writes the compressed form of `x` to `out`, which must have room for
+// `STRING_SYMBOLS_COMPRESSED_MAX( x.length )` bytes, and returns its length.
+static
+size_t
+compress_into(
+        StringSymbolTable const * const t,
+        StringC const x,
+        unsigned char * const out )
+{
+    unsigned char const * const xs = ( unsigned char const * ) x.e;
+    size_t j = 0;
+    for ( size_t i = 0; i < x.length; ) {
+        size_t length;
+        unsigned char const code = table__match( t, xs + i, x.length - i,
+                                                 &length );
+        out[ j++ ] = code;
+        if ( code == ESCAPE ) {
+            out[ j++ ] = xs[ i ];
+        }
+        i += length;
+    }
+    return j;
+}
+
+
+
+///////////////////////////////////
+/// TRAINING
+///////////////////////////////////
+
+
+typedef struct candidate {
+    Symbol symbol;
+    uint64_t gain;
+} Candidate;
+
+
+static
+int
+candidate__compare_symbols(
+        void const * const x,
+        void const * const y )
+{
+    Symbol const * const a = &( ( Candidate const * ) x )->symbol;
+    Symbol const * const b = &( ( Candidate const * ) y )->symbol;
+    if ( a->length != b->length ) {
+        return ( a->length < b->length ) ? -1 : 1;
+    }
+    return memcmp( a->bytes, b->bytes, a->length );
+}
+
+
+// Orders candidates by decreasing gain, and then longest first.
+static
+int
+candidate__compare_gains(
+        void const * const x,
+        void const * const y )
+{
+    Candidate const * const a = x;
+    Candidate const * const b = y;
+    if ( a->gain != b->gain ) {
+        return ( a->gain > b->gain ) ? -1 : 1;
+    } else if ( a->symbol.length != b->symbol.length ) {
+        return ( a->symbol.length > b->symbol.length ) ? -1 : 1;
+    }
+    return memcmp( a->symbol.bytes, b->symbol.bytes, a->symbol.length );
+}
+
+
+// Returns the symbol of a training code.
+static
+Symbol
+training_symbol(
+        StringSymbolTable const * const t,
+        size_t const code )
+{
+    if ( code < ESCAPE ) {
+        return t->symbols[ code ];
+    }
+    Symbol s = { .length = 1 };
+    s.bytes[ 0 ] = ( char ) ( code - ( UCHAR_MAX + 1 ) );
+    return s;
+}
+
+
+// Counts how often each code, and each pair of adjacent codes, occurs in
+// the compressed forms of the sampled strings. Singles are counted in the
+// last row of `counts`.
+static
+void
+count_codes(
+        StringSymbolTable const * const t,
+        StringC const * const xs,
+        size_t const n,
+        size_t const stride,
+        uint32_t * const counts )
+{
+    uint32_t * const singles = counts + TRAINING_CODES * TRAINING_CODES;
+    for ( size_t k = 0; k < n; k += stride ) {
+        unsigned char const * const x = ( unsigned char const * ) xs[ k ].e;
+        size_t prev = SIZE_MAX;
+        for ( size_t i = 0; i < xs[ k ].length; ) {
+            size_t length;
+            size_t code = table__match( t, x + i, xs[ k ].length - i,
+                                        &length );
+            if ( code == ESCAPE ) {
+                code = UCHAR_MAX + 1 + x[ i ];
+            }
+            singles[ code ]++;
+            if ( prev != SIZE_MAX ) {
+                counts[ prev * TRAINING_CODES + code ]++;
+            }
+            prev = code;
+            i += length;
+        }
+    }
+}
+
+
+// Sets `cands` to the symbols that the counted codes and pairs of codes
+// would make, with how many bytes they'd have saved, merging duplicates.
+// Returns how many candidates there are.
+static
+size_t
+find_candidates(
+        StringSymbolTable const * const t,
+        uint32_t const * const counts,
+        Candidate * const cands )
+{
+    uint32_t const * const singles = counts + TRAINING_CODES * TRAINING_CODES;
+    size_t n = 0;
+    for ( size_t a = 0; a < TRAINING_CODES; a++ ) {
+        if ( singles[ a ] == 0 ) {
+            continue;
+        }
+        Symbol const sa = training_symbol( t, a );
+        cands[ n++ ] = ( Candidate ){ .symbol = sa,
+                                      .gain = singles[ a ] * sa.length };
+        for ( size_t b = 0; b < TRAINING_CODES; b++ ) {
+            uint32_t const count = counts[ a * TRAINING_CODES + b ];
+            if ( count == 0 ) {
+                continue;
+            }
+            Symbol const sb = training_symbol( t, b );
+            if ( sa.length + sb.length > SYMBOL_LENGTH_MAX ) {
+                continue;
+            }
+            Candidate c = { .symbol = sa };
+            memcpy( c.symbol.bytes + sa.length, sb.bytes, sb.length );
+            c.symbol.length += sb.length;
+            c.gain = ( uint64_t ) count * c.symbol.length;
+            cands[ n++ ] = c;
+        }
+    }
+    qsort( cands, n, sizeof *cands, candidate__compare_symbols );
+    size_t merged = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( merged > 0 && candidate__compare_symbols( &cands[ merged - 1 ],
+                                                       &cands[ i ] ) == 0 ) {
+            cands[ merged - 1 ].gain += cands[ i ].gain;
+        } else {
+            cands[ merged++ ] = cands[ i ];
+        }
+    }
+    return merged;
+}
+
+
+// Trains `t` on every `stride`th string of `xs`, of which there are
+// `sampled` bytes. Returns false if memory couldn't be allocated.
+static
+bool
+train(
+        StringSymbolTable * const t,
+        StringC const * const xs,
+        size_t const n,
+        size_t const stride,
+        size_t const sampled )
+{
+    uint32_t * const counts = malloc( ( TRAINING_CODES + 1 ) * TRAINING_CODES
+                                      * sizeof *counts );
+    // Each code takes at least one byte, so there are at most `sampled`
+    // distinct pairs of codes:
+    Candidate * const cands = malloc( ( sampled + TRAINING_CODES )
+                                      * sizeof *cands );
+    bool const ok = counts != NULL && cands != NULL;
+    for ( size_t g = 0; ok && g < GENERATIONS; g++ ) {
+        memset( counts, 0, ( TRAINING_CODES + 1 ) * TRAINING_CODES
+                           * sizeof *counts );
+        count_codes( t, xs, n, stride, counts );
+        size_t const m = find_candidates( t, counts, cands );
+        qsort( cands, m, sizeof *cands, candidate__compare_gains );
+        table__clear( t );
+        for ( size_t i = 0; i < m && t->count < ESCAPE; i++ ) {
+            table__add( t, cands[ i ].symbol );
+        }
+        table__finish( t );
+    }
+    free( counts );
+    free( cands );
+    return ok;
+}
+
+
+StringSymbolTable *
+stringsymboltable__train(
+        StringC const * const xs,
+        size_t const n )
+{
+    ASSERT( IMPLIES( xs == NULL, n == 0 ) );
+
+    size_t total = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        ASSERT( stringc__is_valid( xs[ i ] ) );
+        total = ( total > SIZE_MAX - xs[ i ].length ) ? SIZE_MAX
+                                                      : total + xs[ i ].length;
+    }
+    size_t const stride = total / SAMPLE_BYTES + 1;
+    size_t sampled = 0;
+    for ( size_t i = 0; i < n; i += stride ) {
+        sampled += xs[ i ].length;
+    }
+    StringSymbolTable * const t = malloc( sizeof *t );
+    if ( t == NULL ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    table__clear( t );
+    table__finish( t );
+    if ( !train( t, xs, n, stride, sampled ) ) {
+        free( t );
+        errno = ENOMEM;
+        return NULL;
+    }
+    return t;
+}
+
+
+void
+stringsymboltable__free(
+        StringSymbolTable * const t )
+{
+    free( t );
+}
+
+
+
+///////////////////////////////////
+/// COMPRESSING
+///////////////////////////////////
+
+
+void
+stringsymboltable__compress(
+        StringSymbolTable const * const t,
+        StringC const x,
+        StringM * const out )
+{
+    ASSERT( t != NULL, stringc__is_valid( x ), out != NULL,
+            stringm__is_valid( *out ), x.length <= SIZE_MAX / 2 );
+
+    errno = 0;
+    stringm__grow_capacity_for( out,
+                                STRING_SYMBOLS_COMPRESSED_MAX( x.length ) );
+    if ( errno ) { return; }
+    out->length += compress_into( t, x, ( unsigned char * ) out->e
+                                        + out->length );
+#ifdef STRING_RESERVE_NULL
+    stringm__terminate( out );
+#endif
+}
+
+
+size_t
+stringsymboltable__decompressed_length(
+        StringSymbolTable const * const t,
+        StringC const compressed )
+{
+    ASSERT( t != NULL, stringc__is_valid( compressed ) );
+
+    unsigned char const * const cs = ( unsigned char const * ) compressed.e;
+    size_t length = 0;
+    for ( size_t i = 0; i < compressed.length; i++ ) {
+        if ( cs[ i ] == ESCAPE ) {
+            i++;
+            length++;
+        } else {
+            length += t->symbols[ cs[ i ] ].length;
+        }
+    }
+    return length;
+}
+
+
+void
+stringsymboltable__decompress(
+        StringSymbolTable const * const t,
+        StringC const compressed,
+        StringM * const out )
+{
+    ASSERT( t != NULL, stringc__is_valid( compressed ), out != NULL,
+            stringm__is_valid( *out ) );
+
+    size_t const length = stringsymboltable__decompressed_length(
+                              t, compressed );
+    errno = 0;
+    stringm__grow_capacity_for( out, length );
+    if ( errno ) { return; }
+    stringsymboltable__decompress_into( t, compressed,
+                                        out->e + out->length, length );
+    out->length += length;
+#ifdef STRING_RESERVE_NULL
+    stringm__terminate( out );
+#endif
+}
+
+
+size_t
+stringsymboltable__decompress_into(
+        StringSymbolTable const * const t,
+        StringC const compressed,
+        char * const buf,
+        size_t const size )
+{
+    ASSERT( t != NULL, stringc__is_valid( compressed ),
+            IMPLIES( size > 0, buf != NULL ) );
+
+    unsigned char const * const cs = ( unsigned char const * ) compressed.e;
+    size_t j = 0;
+    size_t i = 0;
+    // Copy whole symbols while there's room for any of them:
+    while ( i < compressed.length && j + SYMBOL_LENGTH_MAX <= size ) {
+        if ( cs[ i ] == ESCAPE ) {
+            buf[ j++ ] = ( char ) cs[ i + 1 ];
+            i += 2;
+        } else {
+            Symbol const * const s = &t->symbols[ cs[ i++ ] ];
+            memcpy( buf + j, s->bytes, SYMBOL_LENGTH_MAX );
+            j += s->length;
+        }
+    }
+    for ( ; i < compressed.length; i++ ) {
+        if ( cs[ i ] == ESCAPE ) {
+            i++;
+            if ( j < size ) {
+                buf[ j ] = ( char ) cs[ i ];
+            }
+            j++;
+        } else {
+            Symbol const * const s = &t->symbols[ cs[ i ] ];
+            if ( j < size ) {
+                memcpy( buf + j, s->bytes, MIN( s->length, size - j ) );
+            }
+            j += s->length;
+        }
+    }
+    return j;
+}
+
+
+bool
+stringsymboltable__equal(
+        StringSymbolTable const * const t,
+        StringC const compressed,
+        StringC const x )
+{
+    ASSERT( t != NULL, stringc__is_valid( compressed ),
+            stringc__is_valid( x ) );
+
+    unsigned char const * const cs = ( unsigned char const * ) compressed.e;
+    size_t j = 0;
+    for ( size_t i = 0; i < compressed.length; i++ ) {
+        if ( cs[ i ] == ESCAPE ) {
+            i++;
+            if ( j == x.length || x.e[ j ] != ( char ) cs[ i ] ) {
+                return false;
+            }
+            j++;
+        } else {
+            Symbol const * const s = &t->symbols[ cs[ i ] ];
+            if ( s->length > x.length - j
+              || memcmp( s->bytes, x.e + j, s->length ) != 0 ) {
+                return false;
+            }
+            j += s->length;
+        }
+    }
+    return j == x.length;
+}
@@ -0,0 +1,107 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_SYMBOLS_H
+#define LIBSTRING_STRING_SYMBOLS_H
+
+
+#include <libtypes/types.h>
+
+#include "string.h"
+
+
+// A table of up to 255 symbols of one to eight bytes each, trained on a
+// collection of strings, for compressing many short strings one at a time
+// (as FSST does). Each symbol is coded as one byte, and a byte without a
+// symbol is coded as an escape byte followed by itself. Strings compress
+// and decompress independently of each other, so any one of them can be
+// decompressed on its own, and a table is immutable once trained, so it
+// can be used by any number of threads at once.
+//
+// Compression is deterministic, so two strings compressed with the same
+// table are equal if and only if their compressed forms are: compare them
+// with `stringc__equal()`.
+typedef struct stringsymboltable StringSymbolTable;
+
+
+// The most bytes that compressing a string of `length` bytes can give.
+#define STRING_SYMBOLS_COMPRESSED_MAX( length ) ( 2 * ( length ) )
+
+
+// Trains a symbol table on a sample of the `n` strings of `xs`. If memory
+// can't be allocated, this sets `errno` to `ENOMEM` and returns `NULL`.
+StringSymbolTable *
+stringsymboltable__train(
+        StringC const * xs,
+        size_t n );
+
+
+void
+stringsymboltable__free(
+        StringSymbolTable * );
+
+
+// Appends the compressed form of `x` to `*out`, growing its capacity at
+// most once. If it can't grow, this sets `errno` and leaves `*out` as it
+// was.
+void
+stringsymboltable__compress(
+        StringSymbolTable const *,
+        StringC x,
+        StringM * out );
+
+
+// Returns the length of the string that `compressed` decompresses to.
+size_t
+stringsymboltable__decompressed_length(
+        StringSymbolTable const *,
+        StringC compressed );
+
+
+// Appends the decompressed form of `compressed` to `*out`, growing its
+// capacity at most once. If it can't grow, this sets `errno` and leaves
+// `*out` as it was.
+void
+stringsymboltable__decompress(
+        StringSymbolTable const *,
+        StringC compressed,
+        StringM * out );
+
+
+// Writes as much of the decompressed form of `compressed` as fits into the
+// `size` bytes of `buf`, and returns the length of all of it, like
+// `snprintf()` (but without a null terminator).
+size_t
+stringsymboltable__decompress_into(
+        StringSymbolTable const *,
+        StringC compressed,
+        char * buf,
+        size_t size );
+
+
+// Returns true if `compressed` decompresses to `x`, decompressing only as
+// much of it as it takes to tell.
+bool
+stringsymboltable__equal(
+        StringSymbolTable const *,
+        StringC compressed,
+        StringC x );
+
+
+#endif
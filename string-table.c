@@ -0,0 +1,291 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-table.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>     // memcpy, memmove
+
+#include <libmacro/assert.h>    // ASSERT
+#include <libmacro/logic.h>     // ALL, IMPLIES
+
+#include <libvec/vec-size.h>
+
+
+static
+size_t
+start_of(
+        StringTable const t,
+        size_t const index )
+{
+    return ( index == 0 ) ? 0 : t.offsets.e[ index - 1 ];
+}
+
+
+bool
+stringtable__is_valid(
+        StringTable const t )
+{
+    return stringm__is_valid( t.blob )
+        && vec_size__is_valid( t.offsets )
+        && ALL( STRINGTABLE_INVARIANTS( t ) );
+}
+
+
+StringTable
+stringtable__new_empty(
+        size_t const capacity,
+        size_t const blob_capacity )
+{
+    errno = 0;
+    StringTable t = { .blob = stringm__new_empty( blob_capacity ) };
+    if ( errno ) { return t; }
+    t.offsets = vec_size__new_empty( capacity );
+    if ( errno ) {
+        int const err = errno;
+        stringm__free( &t.blob );
+        errno = err;
+    }
+    return t;
+}
+
+
+void
+stringtable__free(
+        StringTable * const t )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ) );
+
+    stringm__free( &t->blob );
+    vec_size__free( &t->offsets );
+}
+
+
+void
+stringtable__freev(
+        StringTable t )
+{
+    ASSERT( stringtable__is_valid( t ) );
+
+    stringtable__free( &t );
+}
+
+
+size_t
+stringtable__length(
+        StringTable const t )
+{
+    ASSERT( stringtable__is_valid( t ) );
+
+    return t.offsets.length;
+}
+
+
+bool
+stringtable__is_empty(
+        StringTable const t )
+{
+    ASSERT( stringtable__is_valid( t ) );
+
+    return stringtable__length( t ) == 0;
+}
+
+
+StringC
+stringtable__get(
+        StringTable const t,
+        size_t const index )
+{
+    ASSERT( stringtable__is_valid( t ), index < stringtable__length( t ) );
+
+    size_t const start = start_of( t, index );
+    return stringc__new( t.blob.e + start, t.offsets.e[ index ] - start );
+}
+
+
+StringC
+stringtable__blob(
+        StringTable const t )
+{
+    ASSERT( stringtable__is_valid( t ) );
+
+    return stringc__view( t.blob );
+}
+
+
+void
+stringtable__append(
+        StringTable * const t,
+        StringC const s )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ), stringc__is_valid( s ) );
+
+    stringtable__extend( t, &s, 1 );
+}
+
+
+void
+stringtable__extend(
+        StringTable * const t,
+        StringC const * const xs,
+        size_t const n )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ),
+            IMPLIES( xs == NULL, n == 0 ) );
+
+    size_t total = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        ASSERT( stringc__is_valid( xs[ i ] ) );
+        total += xs[ i ].length;
+    }
+    errno = 0;
+    stringm__grow_capacity_for( &t->blob, total );
+    if ( errno ) { return; }
+    vec_size__grow_capacity_for( &t->offsets, n );
+    if ( errno ) { return; }
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( xs[ i ].length > 0 ) {
+            memcpy( t->blob.e + t->blob.length, xs[ i ].e, xs[ i ].length );
+            t->blob.length += xs[ i ].length;
+        }
+        t->offsets.e[ t->offsets.length++ ] = t->blob.length;
+    }
+#ifdef STRING_RESERVE_NULL
+    stringm__terminate( &t->blob );
+#endif
+}
+
+
+void
+stringtable__sort_order(
+        StringTable const t,
+        size_t * const order )
+{
+    ASSERT( stringtable__is_valid( t ),
+            IMPLIES( order == NULL, stringtable__is_empty( t ) ) );
+
+    size_t const n = stringtable__length( t );
+    if ( n == 0 ) { return; }
+    errno = 0;
+    StringC * const xs = malloc( n * sizeof *xs );
+    if ( xs == NULL ) {
+        errno = ENOMEM;
+        return;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        xs[ i ] = stringtable__get( t, i );
+    }
+    stringc__sort_order( xs, n, order );
+    int const err = errno;
+    free( xs );
+    errno = err;
+}
+
+
+void
+stringtable__permute(
+        StringTable * const t,
+        size_t const * const order )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ),
+            IMPLIES( order == NULL, stringtable__is_empty( *t ) ) );
+
+    size_t const n = stringtable__length( *t );
+    if ( n == 0 ) { return; }
+    errno = 0;
+    StringTable u = stringtable__new_empty( n, t->blob.length );
+    if ( errno ) { return; }
+    for ( size_t i = 0; i < n; i++ ) {
+        ASSERT( order[ i ] < n );
+        StringC const s = stringtable__get( *t, order[ i ] );
+        if ( s.length > 0 ) {
+            memcpy( u.blob.e + u.blob.length, s.e, s.length );
+            u.blob.length += s.length;
+        }
+        u.offsets.e[ i ] = u.blob.length;
+    }
+    u.offsets.length = n;
+#ifdef STRING_RESERVE_NULL
+    stringm__terminate( &u.blob );
+#endif
+    stringtable__free( t );
+    *t = u;
+}
+
+
+void
+stringtable__sort(
+        StringTable * const t )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ) );
+
+    size_t const n = stringtable__length( *t );
+    if ( n == 0 ) { return; }
+    errno = 0;
+    size_t * const order = malloc( n * sizeof *order );
+    if ( order == NULL ) {
+        errno = ENOMEM;
+        return;
+    }
+    stringtable__sort_order( *t, order );
+    if ( !errno ) {
+        stringtable__permute( t, order );
+    }
+    int const err = errno;
+    free( order );
+    errno = err;
+}
+
+
+void
+stringtable__compact(
+        StringTable * const t,
+        bool ( * const keep )( StringC x ) )
+{
+    ASSERT( t != NULL, stringtable__is_valid( *t ) );
+
+    if ( keep != NULL ) {
+        size_t const n = stringtable__length( *t );
+        size_t start = 0;
+        size_t kept = 0;
+        size_t blob_length = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            size_t const end = t->offsets.e[ i ];
+            StringC const s = stringc__new( t->blob.e + start, end - start );
+            if ( keep( s ) ) {
+                if ( s.length > 0 && blob_length != start ) {
+                    memmove( t->blob.e + blob_length, s.e, s.length );
+                }
+                blob_length += s.length;
+                t->offsets.e[ kept++ ] = blob_length;
+            }
+            start = end;
+        }
+        t->blob.length = blob_length;
+        t->offsets.length = kept;
+#ifdef STRING_RESERVE_NULL
+        stringm__terminate( &t->blob );
+#endif
+    }
+    errno = 0;
+    stringm__free_spare_capacity( &t->blob );
+    if ( errno ) { return; }
+    vec_size__free_spare_capacity( &t->offsets );
+}
@@ -0,0 +1,115 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_TABLE_H
+#define LIBSTRING_STRING_TABLE_H
+
+
+#include <libtypes/types.h>
+
+#include "def/string-table.h"
+#include "string.h"
+
+
+bool
+stringtable__is_valid(
+        StringTable );
+
+
+StringTable
+stringtable__new_empty(
+        size_t capacity,
+        size_t blob_capacity );
+
+
+void
+stringtable__free(
+        StringTable * );
+
+
+void
+stringtable__freev(
+        StringTable );
+
+
+size_t
+stringtable__length(
+        StringTable );
+
+
+bool
+stringtable__is_empty(
+        StringTable );
+
+
+StringC
+stringtable__get(
+        StringTable,
+        size_t index );
+
+
+StringC
+stringtable__blob(
+        StringTable );
+
+
+void
+stringtable__append(
+        StringTable *,
+        StringC );
+
+
+void
+stringtable__extend(
+        StringTable *,
+        StringC const * xs,
+        size_t n );
+
+
+// Sets `order[ i ]` to the index of the string that belongs at index `i` when
+// the table is sorted in byte-wise order. `order` must have room for
+// `stringtable__length( table )` elements.
+void
+stringtable__sort_order(
+        StringTable,
+        size_t * order );
+
+
+// Rebuilds the table so that the string at index `i` is the one that was at
+// index `order[ i ]`; `order` must be a permutation of the table's indices.
+void
+stringtable__permute(
+        StringTable *,
+        size_t const * order );
+
+
+void
+stringtable__sort(
+        StringTable * );
+
+
+// Removes the strings for which `keep` returns false (if `keep` is not
+// `NULL`), moving the rest down in place, and then frees the spare capacity.
+void
+stringtable__compact(
+        StringTable *,
+        bool ( * keep )( StringC x ) );
+
+
+#endif
@@ -0,0 +1,300 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#include "string-trace.h"
+
+
+#ifndef STRING_TRACE
+
+
+void
+stringtrace__dump(
+        FILE * const f )
+{
+}
+
+
+void
+stringtrace__reset( void )
+{
+}
+
+
+#else
+
+
+#include <stdlib.h>     // qsort
+#include <threads.h>    // call_once, mtx_*, tss_*
+#include <time.h>       // timespec_get
+
+#include <libmacro/assert.h>    // ASSERT
+
+
+// The most functions that can be traced; any beyond these aren't counted.
+#define MAX_SITES 256
+
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define TICKS_UNIT "cycles"
+#else
+#define TICKS_UNIT "ns"
+#endif
+
+
+// Each slot is only written by the thread that owns it, so it's counted
+// into with plain loads and stores, which are atomic only so that
+// `stringtrace__dump()` can read them from another thread.
+typedef struct slot {
+    atomic_uint_least64_t calls;
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t ticks;
+} Slot;
+
+
+typedef struct thread_slots {
+    Slot slots[ MAX_SITES ];
+    struct thread_slots * prev;
+    struct thread_slots * next;
+    bool registered;
+} ThreadSlots;
+
+
+typedef struct total {
+    char const * name;
+    uint_least64_t calls;
+    uint_least64_t bytes;
+    uint_least64_t ticks;
+} Total;
+
+
+static _Thread_local ThreadSlots thread_slots;
+
+// The registered threads' slots, the totals of the threads that have
+// exited, and the traced sites, all guarded by `lock`:
+static ThreadSlots * threads;
+static Total exited[ MAX_SITES ];
+static StringTraceSite * sites[ MAX_SITES ];
+static size_t site_count;
+
+static mtx_t lock;
+static tss_t thread_key;
+static bool initialized;
+static once_flag init_flag = ONCE_FLAG_INIT;
+
+
+
+static
+void
+add(
+        atomic_uint_least64_t * const x,
+        uint_least64_t const n )
+{
+    atomic_store_explicit( x, atomic_load_explicit( x, memory_order_relaxed )
+                              + n,
+                           memory_order_relaxed );
+}
+
+
+static
+void
+slot__clear(
+        Slot * const slot )
+{
+    atomic_store_explicit( &slot->calls, 0, memory_order_relaxed );
+    atomic_store_explicit( &slot->bytes, 0, memory_order_relaxed );
+    atomic_store_explicit( &slot->ticks, 0, memory_order_relaxed );
+}
+
+
+static
+void
+unregister_thread(
+        void * const slots )
+{
+    ThreadSlots * const t = slots;
+    mtx_lock( &lock );
+    for ( size_t i = 0; i < site_count; i++ ) {
+        exited[ i ].calls += t->slots[ i ].calls;
+        exited[ i ].bytes += t->slots[ i ].bytes;
+        exited[ i ].ticks += t->slots[ i ].ticks;
+    }
+    if ( t->prev != NULL ) {
+        t->prev->next = t->next;
+    } else {
+        threads = t->next;
+    }
+    if ( t->next != NULL ) {
+        t->next->prev = t->prev;
+    }
+    mtx_unlock( &lock );
+    // In case the thread traces more in another destructor:
+    for ( size_t i = 0; i < MAX_SITES; i++ ) {
+        slot__clear( &t->slots[ i ] );
+    }
+    t->registered = false;
+}
+
+
+static
+void
+init( void )
+{
+    if ( mtx_init( &lock, mtx_plain ) != thrd_success ) { return; }
+    if ( tss_create( &thread_key, unregister_thread ) != thrd_success ) {
+        mtx_destroy( &lock );
+        return;
+    }
+    initialized = true;
+}
+
+
+// Registers the calling thread's slots, and gives `site` an ID if it doesn't
+// have one yet. Returns false if either couldn't be done.
+static
+bool
+register_site(
+        StringTraceSite * const site )
+{
+    call_once( &init_flag, init );
+    if ( !initialized ) {
+        return false;
+    }
+    mtx_lock( &lock );
+    if ( !thread_slots.registered
+         && tss_set( thread_key, &thread_slots ) == thrd_success ) {
+        thread_slots.registered = true;
+        thread_slots.prev = NULL;
+        thread_slots.next = threads;
+        if ( threads != NULL ) {
+            threads->prev = &thread_slots;
+        }
+        threads = &thread_slots;
+    }
+    if ( atomic_load_explicit( &site->id, memory_order_relaxed ) == 0
+         && site_count < MAX_SITES ) {
+        sites[ site_count++ ] = site;
+        atomic_store_explicit( &site->id, site_count, memory_order_release );
+    }
+    mtx_unlock( &lock );
+    return thread_slots.registered
+           && atomic_load_explicit( &site->id, memory_order_relaxed ) != 0;
+}
+
+
+uint64_t
+stringtrace__ticks( void )
+{
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec t;
+    timespec_get( &t, TIME_UTC );
+    return ( uint64_t ) t.tv_sec * 1000000000 + ( uint64_t ) t.tv_nsec;
+#endif
+}
+
+
+void
+stringtrace__record(
+        StringTraceSite * const site,
+        size_t const bytes,
+        uint64_t const ticks )
+{
+    ASSERT( site != NULL );
+
+    size_t id = atomic_load_explicit( &site->id, memory_order_acquire );
+    if ( id == 0 || !thread_slots.registered ) {
+        if ( !register_site( site ) ) { return; }
+        id = atomic_load_explicit( &site->id, memory_order_relaxed );
+    }
+    Slot * const slot = &thread_slots.slots[ id - 1 ];
+    add( &slot->calls, 1 );
+    add( &slot->bytes, bytes );
+    add( &slot->ticks, ticks );
+}
+
+
+static
+int
+total__compare_ticks(
+        void const * const x,
+        void const * const y )
+{
+    Total const * const a = x;
+    Total const * const b = y;
+    return ( a->ticks < b->ticks ) - ( a->ticks > b->ticks );
+}
+
+
+void
+stringtrace__dump(
+        FILE * const f )
+{
+    ASSERT( f != NULL );
+
+    call_once( &init_flag, init );
+    if ( !initialized ) { return; }
+    Total totals[ MAX_SITES ];
+    mtx_lock( &lock );
+    size_t const n = site_count;
+    for ( size_t i = 0; i < n; i++ ) {
+        totals[ i ] = exited[ i ];
+        totals[ i ].name = sites[ i ]->name;
+        for ( ThreadSlots * t = threads; t != NULL; t = t->next ) {
+            totals[ i ].calls += atomic_load_explicit(
+                &t->slots[ i ].calls, memory_order_relaxed );
+            totals[ i ].bytes += atomic_load_explicit(
+                &t->slots[ i ].bytes, memory_order_relaxed );
+            totals[ i ].ticks += atomic_load_explicit(
+                &t->slots[ i ].ticks, memory_order_relaxed );
+        }
+    }
+    mtx_unlock( &lock );
+    qsort( totals, n, sizeof *totals, total__compare_ticks );
+    fprintf( f, "%-36s %12s %16s %16s %12s\n", "function", "calls", "bytes",
+             TICKS_UNIT, TICKS_UNIT "/call" );
+    for ( size_t i = 0; i < n; i++ ) {
+        Total const t = totals[ i ];
+        fprintf( f, "%-36s %12ju %16ju %16ju %12.1f\n", t.name,
+                 ( uintmax_t ) t.calls, ( uintmax_t ) t.bytes,
+                 ( uintmax_t ) t.ticks,
+                 ( t.calls == 0 ) ? 0.0 : ( double ) t.ticks / t.calls );
+    }
+}
+
+
+void
+stringtrace__reset( void )
+{
+    call_once( &init_flag, init );
+    if ( !initialized ) { return; }
+    mtx_lock( &lock );
+    for ( size_t i = 0; i < MAX_SITES; i++ ) {
+        exited[ i ] = ( Total ){ .name = NULL };
+    }
+    for ( ThreadSlots * t = threads; t != NULL; t = t->next ) {
+        for ( size_t i = 0; i < MAX_SITES; i++ ) {
+            slot__clear( &t->slots[ i ] );
+        }
+    }
+    mtx_unlock( &lock );
+}
+
+
+#endif
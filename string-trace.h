@@ -0,0 +1,93 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+#ifndef LIBSTRING_STRING_TRACE_H
+#define LIBSTRING_STRING_TRACE_H
+
+
+#include <stdio.h>
+
+#include <libtypes/types.h>
+
+
+// When libstring is built with `STRING_TRACE` defined, its main functions
+// count their calls, the bytes they're given, and the time they take (in
+// CPU cycles where the time-stamp counter can be read directly, or
+// nanoseconds otherwise). Each thread counts into slots of its own, without
+// locking, and `stringtrace__dump()` adds them all up. Without
+// `STRING_TRACE`, the tracing macros expand to no code (though the byte
+// count given to `STRING_TRACE_END()` is still evaluated, so that it may
+// name a variable that's only used for tracing), and the functions below
+// do nothing.
+//
+// The macros can trace functions outside of libstring, too:
+// `STRING_TRACE_BEGIN;` at the start of a function, and
+// `STRING_TRACE_END( bytes );` before it returns.
+
+#ifdef STRING_TRACE
+
+#include <stdatomic.h>
+
+typedef struct stringtracesite {
+    char const * name;
+    atomic_size_t id;
+} StringTraceSite;
+
+
+uint64_t
+stringtrace__ticks( void );
+
+
+void
+stringtrace__record(
+        StringTraceSite * site,
+        size_t bytes,
+        uint64_t ticks );
+
+
+#define STRING_TRACE_BEGIN \
+    static StringTraceSite string_trace_site_ = { .name = __func__ }; \
+    uint64_t const string_trace_start_ = stringtrace__ticks()
+
+#define STRING_TRACE_END( bytes ) \
+    stringtrace__record( &string_trace_site_, ( bytes ), \
+                         stringtrace__ticks() - string_trace_start_ )
+
+#else
+
+#define STRING_TRACE_BEGIN ( void ) 0
+#define STRING_TRACE_END( bytes ) ( ( void ) ( bytes ) )
+
+#endif
+
+
+// Writes a table of the traced functions to `f`, with their calls, bytes
+// and ticks summed over every thread, in order of most ticks first. The
+// counts of threads that are still running may be a little behind.
+void
+stringtrace__dump(
+        FILE * f );
+
+
+// Zeroes the counts of every traced function.
+void
+stringtrace__reset( void );
+
+
+#endif
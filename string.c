@@ -18,11 +18,14 @@
 
 
 #include "string.h"
+#include "string-trace.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdatomic.h>  // atomic_*
 #include <stdlib.h>
-#include <string.h>     // strlen
+#include <string.h>     // memcmp, memcpy, memmove, strlen
+#include <threads.h>    // thrd_*
 
 #include <libmacro/assert.h>    // ASSERT
 #include <libmacro/logic.h>     // IMPLIES
@@ -33,6 +36,51 @@
 #include <libvec/vec-char.h>
 
 
+#ifdef STRING_RESERVE_NULL
+#define RESERVED 1
+#else
+#define RESERVED 0
+#endif
+
+
+// Returns the capacity needed to hold `n` elements along with the reserved
+// null byte, if there is one.
+static
+size_t
+with_null(
+        size_t const n )
+{
+    return ( n < SIZE_MAX ) ? n + RESERVED : n;
+}
+
+
+// Writes the reserved null byte past the elements of `*s`, first growing it
+// if a change has left no room for one.
+static
+void
+keep_null(
+        StringM * const s )
+{
+    if ( RESERVED && s->capacity > 0 ) {
+        stringm__terminate( s );
+    }
+}
+
+
+// Like `keep_null()`, but for changes that have shrunk the capacity: makes
+// room for the reserved null byte by dropping the last element if needs be.
+static
+void
+fit_null(
+        StringM * const s )
+{
+    if ( RESERVED && s->capacity > 0 ) {
+        s->length = MIN( s->length, s->capacity - 1 );
+        s->e[ s->length ] = '\0';
+    }
+}
+
+
 static
 size_t
 strlen_null(
@@ -62,6 +110,236 @@ char_equal_i(
 }
 
 
+// SWAR ("SIMD within a register") helpers, working on eight bytes at a time.
+// The masks they return have the high bit set in each byte that matches, and
+// they're exact: there are no false positives from carries between bytes.
+
+#define SWAR_ONES  UINT64_C( 0x0101010101010101 )
+#define SWAR_HIGHS UINT64_C( 0x8080808080808080 )
+#define SWAR_LOWS  UINT64_C( 0x7F7F7F7F7F7F7F7F )
+
+
+static
+uint64_t
+swar_load(
+        char const * const p )
+{
+    uint64_t w;
+    memcpy( &w, p, sizeof w );
+    return w;
+}
+
+
+static
+uint64_t
+swar_eq(
+        uint64_t const w,
+        unsigned char const c )
+{
+    uint64_t const x = w ^ ( SWAR_ONES * c );
+    return ~( ( ( x & SWAR_LOWS ) + SWAR_LOWS ) | x | SWAR_LOWS );
+}
+
+
+// Bytes less than `n`, for `n` at most 128.
+static
+uint64_t
+swar_lt(
+        uint64_t const w,
+        unsigned char const n )
+{
+    return ~( ( ( w & SWAR_LOWS ) + SWAR_ONES * ( 128 - n ) ) | w )
+           & SWAR_HIGHS;
+}
+
+
+// Bytes between `lo` and `hi` inclusive, for `hi` less than 128.
+static
+uint64_t
+swar_in_range(
+        uint64_t const w,
+        unsigned char const lo,
+        unsigned char const hi )
+{
+    return swar_lt( w, hi + 1 ) & ~swar_lt( w, lo );
+}
+
+
+static
+uint64_t
+swar_space(
+        uint64_t const w )
+{
+    return swar_eq( w, ' ' ) | swar_in_range( w, '\t', '\r' );
+}
+
+
+static
+bool
+is_space(
+        char const c )
+{
+    return c == ' ' || ( c >= '\t' && c <= '\r' );
+}
+
+
+static
+size_t
+space_prefix_length(
+        char const * const xs,
+        size_t const n )
+{
+    size_t i = 0;
+    while ( i + 8 <= n && swar_space( swar_load( xs + i ) ) == SWAR_HIGHS ) {
+        i += 8;
+    }
+    while ( i < n && is_space( xs[ i ] ) ) {
+        i++;
+    }
+    return i;
+}
+
+
+static
+size_t
+space_suffix_length(
+        char const * const xs,
+        size_t const n )
+{
+    size_t i = 0;
+    while ( i + 8 <= n
+            && swar_space( swar_load( xs + n - i - 8 ) ) == SWAR_HIGHS ) {
+        i += 8;
+    }
+    while ( i < n && is_space( xs[ n - i - 1 ] ) ) {
+        i++;
+    }
+    return i;
+}
+
+
+typedef struct byte_set {
+    bool has[ UCHAR_MAX + 1 ];
+} ByteSet;
+
+
+static
+ByteSet
+byte_set__new(
+        StringC const set )
+{
+    ByteSet bs = { .has = { false } };
+    for ( size_t i = 0; i < set.length; i++ ) {
+        bs.has[ ( unsigned char ) set.e[ i ] ] = true;
+    }
+    return bs;
+}
+
+
+static
+size_t
+set_prefix_length(
+        char const * const xs,
+        size_t const n,
+        StringC const set )
+{
+    ByteSet const bs = byte_set__new( set );
+    size_t i = 0;
+    while ( i < n && bs.has[ ( unsigned char ) xs[ i ] ] ) {
+        i++;
+    }
+    return i;
+}
+
+
+static
+size_t
+set_suffix_length(
+        char const * const xs,
+        size_t const n,
+        StringC const set )
+{
+    ByteSet const bs = byte_set__new( set );
+    size_t i = 0;
+    while ( i < n && bs.has[ ( unsigned char ) xs[ n - i - 1 ] ] ) {
+        i++;
+    }
+    return i;
+}
+
+
+// The most threads that `run_chunked()` will split work across; requests for
+// more are clamped to this.
+#define PARALLEL_MAX_THREADS 64
+
+
+typedef struct chunk_job {
+    void ( * f )( void * ctx, size_t begin, size_t end );
+    void * ctx;
+    size_t begin;
+    size_t end;
+} ChunkJob;
+
+
+static
+int
+chunk_job__run(
+        void * const arg )
+{
+    ChunkJob const * const job = arg;
+    job->f( job->ctx, job->begin, job->end );
+    return 0;
+}
+
+
+// Calls `f` over consecutive ranges covering `[0, length)`, with each range
+// on its own thread. The ranges are at least `min_chunk` long, and there are
+// at most `threads` of them. The first range runs on the calling thread, as
+// does any range whose thread fails to start.
+static
+void
+run_chunked(
+        size_t const length,
+        size_t const min_chunk,
+        size_t const threads,
+        void ( * const f )( void * ctx, size_t begin, size_t end ),
+        void * const ctx )
+{
+    ASSERT( min_chunk > 0, f != NULL );
+
+    size_t n = MIN( MIN( threads, length / min_chunk ),
+                    ( size_t ) PARALLEL_MAX_THREADS );
+    if ( n <= 1 ) {
+        f( ctx, 0, length );
+        return;
+    }
+    ChunkJob jobs[ PARALLEL_MAX_THREADS ];
+    thrd_t ts[ PARALLEL_MAX_THREADS ];
+    bool started[ PARALLEL_MAX_THREADS ] = { false };
+    size_t const chunk = length / n;
+    for ( size_t i = 0; i < n; i++ ) {
+        jobs[ i ] = ( ChunkJob ){
+            .f = f,
+            .ctx = ctx,
+            .begin = i * chunk,
+            .end = ( i == n - 1 ) ? length : ( i + 1 ) * chunk
+        };
+    }
+    for ( size_t i = 1; i < n; i++ ) {
+        started[ i ] = thrd_create( &ts[ i ], chunk_job__run, &jobs[ i ] )
+                       == thrd_success;
+    }
+    chunk_job__run( &jobs[ 0 ] );
+    for ( size_t i = 1; i < n; i++ ) {
+        if ( started[ i ] ) {
+            thrd_join( ts[ i ], NULL );
+        } else {
+            chunk_job__run( &jobs[ i ] );
+        }
+    }
+}
+
+
 
 
 ///////////////////////////////////
@@ -200,6 +478,17 @@ stringc__isnt_empty(
 }
 
 
+static
+bool
+equal(
+        StringC const x,
+        StringC const y )
+{
+    return arrayc_char__equal( arrayc_char__view_stringc( x ),
+                               arrayc_char__view_stringc( y ) );
+}
+
+
 bool
 stringc__is_empty0(
         StringC const s )
@@ -207,7 +496,7 @@ stringc__is_empty0(
     ASSERT( stringc__is_valid( s ) );
 
     return stringc__is_empty( s )
-        || stringc__equal( s, stringc__view_str0( "" ) );
+        || equal( s, stringc__view_str0( "" ) );
 }
 
 
@@ -312,8 +601,10 @@ stringc__equal_stringc(
 {
     ASSERT( stringc__is_valid( x ), stringc__is_valid( y ) );
 
-    return arrayc_char__equal( arrayc_char__view_stringc( x ),
-                               arrayc_char__view_stringc( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, y );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
@@ -324,7 +615,10 @@ stringc__equal_stringm(
 {
     ASSERT( stringc__is_valid( x ), stringm__is_valid( y ) );
 
-    return stringc__equal_stringc( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
@@ -335,7 +629,10 @@ stringc__equal_arrayc(
 {
     ASSERT( stringc__is_valid( x ), arrayc_char__is_valid( y ) );
 
-    return stringc__equal_stringc( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
@@ -346,7 +643,10 @@ stringc__equal_arraym(
 {
     ASSERT( stringc__is_valid( x ), arraym_char__is_valid( y ) );
 
-    return stringc__equal_stringc( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
@@ -357,7 +657,10 @@ stringc__equal_vec(
 {
     ASSERT( stringc__is_valid( x ), vec_char__is_valid( y ) );
 
-    return stringc__equal_stringc( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
@@ -368,861 +671,3510 @@ stringc__equal_str(
 {
     ASSERT( stringc__is_valid( x ), y != NULL );
 
-    return stringc__equal_stringc( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( x, stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
-StringM
-stringc__replaced_by(
-        StringC const xs,
-        char const el,
-        char const repl,
-        bool ( * const eq )( char x, char el ) )
+static
+size_t
+find_in(
+        StringC const s,
+        StringC const needle,
+        size_t const from )
 {
-    ASSERT( stringc__is_valid( xs ), eq != NULL );
-
-    return stringm__view(
-               arrayc_char__replaced_by( arrayc_char__view_stringc( xs ),
-                                         el, repl, eq ) );
+    size_t const n = needle.length;
+    if ( from > s.length || s.length - from < n ) { return SIZE_MAX; }
+    char const first = needle.e[ 0 ];
+    char const last = needle.e[ n - 1 ];
+    // The last index that a match could start at:
+    size_t const end = s.length - n;
+    for ( size_t i = from; i <= end; i++ ) {
+        char const * const p = memchr( s.e + i, first, end - i + 1 );
+        if ( p == NULL ) { return SIZE_MAX; }
+        i = ( size_t )( p - s.e );
+        if ( p[ n - 1 ] == last && memcmp( p, needle.e, n ) == 0 ) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
 }
 
 
-StringM
-stringc__replaced(
-        StringC const xs,
-        char const el,
-        char const repl )
+size_t
+stringc__find(
+        StringC const s,
+        StringC const needle,
+        size_t const from )
 {
-    ASSERT( stringc__is_valid( xs ) );
+    ASSERT( stringc__is_valid( s ), stringc__is_valid( needle ),
+            stringc__isnt_empty( needle ) );
 
-    return stringc__replaced_by( xs, el, repl, char_equal );
+    STRING_TRACE_BEGIN;
+    size_t const i = find_in( s, needle, from );
+    STRING_TRACE_END( ( from < s.length ) ? s.length - from : 0 );
+    return i;
 }
 
 
-StringM
-stringc__replaced_i(
-        StringC const xs,
-        char const el,
-        char const repl )
+static
+size_t
+count_in(
+        StringC const s,
+        StringC const needle )
 {
-    ASSERT( stringc__is_valid( xs ) );
-
-    return stringc__replaced_by( xs, el, repl, char_equal_i );
+    size_t count = 0;
+    for ( size_t i = find_in( s, needle, 0 );
+          i != SIZE_MAX;
+          i = find_in( s, needle, i + needle.length ) ) {
+        count++;
+    }
+    return count;
 }
 
 
-StringM
-stringc__replacedf(
-        StringC const xs,
-        bool ( * const f )( char x ),
-        char const repl )
+size_t
+stringc__count(
+        StringC const s,
+        StringC const needle )
 {
-    ASSERT( stringc__is_valid( xs ), f != NULL );
+    ASSERT( stringc__is_valid( s ), stringc__is_valid( needle ),
+            stringc__isnt_empty( needle ) );
 
-    return stringm__view(
-               arrayc_char__replacedf( arrayc_char__view_stringc( xs ),
-                                       f, repl ) );
+    STRING_TRACE_BEGIN;
+    size_t const count = count_in( s, needle );
+    STRING_TRACE_END( s.length );
+    return count;
 }
 
 
+// Every byte of a word of per-byte counts can hold this many more ones
+// before it overflows.
+#define SWAR_COUNT_WORDS UCHAR_MAX
 
 
-
-///////////////////////////////////
-/// STRINGM FUNCTIONS
-///////////////////////////////////
+// Returns the sum of the bytes of `w`.
+static
+size_t
+swar_sum(
+        uint64_t const w )
+{
+    uint64_t const pairs = ( w & UINT64_C( 0x00FF00FF00FF00FF ) )
+                         + ( ( w >> 8 ) & UINT64_C( 0x00FF00FF00FF00FF ) );
+    return ( pairs * UINT64_C( 0x0001000100010001 ) ) >> 48;
+}
 
 
-bool
-stringm__is_valid(
-        StringM const s )
+static
+size_t
+count_byte(
+        StringC const s,
+        char const c )
 {
-    return ALL( STRINGM_INVARIANTS( s ) );
+    size_t count = 0;
+    size_t i = 0;
+    // Add one into each byte of `counts` for each match in that byte of a
+    // word, and only sum those bytes up before they could overflow:
+    while ( i + 8 <= s.length ) {
+        uint64_t counts = 0;
+        size_t const words = MIN( ( s.length - i ) / 8, SWAR_COUNT_WORDS );
+        for ( size_t w = 0; w < words; w++, i += 8 ) {
+            counts += swar_eq( swar_load( s.e + i ),
+                               ( unsigned char ) c ) >> 7;
+        }
+        count += swar_sum( counts );
+    }
+    for ( ; i < s.length; i++ ) {
+        count += s.e[ i ] == c;
+    }
+    return count;
 }
 
 
-void
-stringm__free(
-        StringM * const s )
+size_t
+stringc__count_byte(
+        StringC const s,
+        char const c )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( stringc__is_valid( s ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__free( &v );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    size_t const count = count_byte( s, c );
+    STRING_TRACE_END( s.length );
+    return count;
 }
 
 
-void
-stringm__freev(
-        StringM const s )
+size_t
+stringc__count_lines(
+        StringC const s )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringc__is_valid( s ) );
 
-    vec_char__freev( vec_char__view_stringm( s ) );
+    STRING_TRACE_BEGIN;
+    size_t const count = ( s.length == 0 )
+                       ? 0
+                       : count_byte( s, '\n' )
+                         + ( s.e[ s.length - 1 ] != '\n' );
+    STRING_TRACE_END( s.length );
+    return count;
 }
 
 
-StringM
-stringm__new(
-        char const * const str,
-        size_t const length,
-        size_t const capacity )
+// The histogram is counted over this many tables, so that consecutive
+// bytes of the same value (as are common) don't wait on each other's
+// increments.
+#define HISTOGRAM_TABLES 4
+
+// The most bytes that are counted into the 32-bit tables before they're
+// added to the result.
+#define HISTOGRAM_CHUNK ( UINT32_C( 1 ) << 30 )
+
+
+void
+stringc__byte_histogram(
+        StringC const s,
+        size_t * const counts )
 {
-    ASSERT( IMPLIES( str == NULL, length == 0 ), length <= capacity );
+    ASSERT( stringc__is_valid( s ), counts != NULL );
 
-    return stringm__view_vec( vec_char__new( str, length, capacity ) );
+    STRING_TRACE_BEGIN;
+    for ( size_t b = 0; b <= UCHAR_MAX; b++ ) {
+        counts[ b ] = 0;
+    }
+    for ( size_t from = 0; from < s.length; from += HISTOGRAM_CHUNK ) {
+        uint32_t tables[ HISTOGRAM_TABLES ][ UCHAR_MAX + 1 ] = { { 0 } };
+        size_t const to = from + MIN( s.length - from, HISTOGRAM_CHUNK );
+        size_t i = from;
+        for ( ; i + 8 <= to; i += 8 ) {
+            uint64_t const w = swar_load( s.e + i );
+            tables[ 0 ][ w & 0xFF ]++;
+            tables[ 1 ][ ( w >> 8 ) & 0xFF ]++;
+            tables[ 2 ][ ( w >> 16 ) & 0xFF ]++;
+            tables[ 3 ][ ( w >> 24 ) & 0xFF ]++;
+            tables[ 0 ][ ( w >> 32 ) & 0xFF ]++;
+            tables[ 1 ][ ( w >> 40 ) & 0xFF ]++;
+            tables[ 2 ][ ( w >> 48 ) & 0xFF ]++;
+            tables[ 3 ][ w >> 56 ]++;
+        }
+        for ( ; i < to; i++ ) {
+            tables[ 0 ][ ( unsigned char ) s.e[ i ] ]++;
+        }
+        for ( size_t t = 0; t < HISTOGRAM_TABLES; t++ ) {
+            for ( size_t b = 0; b <= UCHAR_MAX; b++ ) {
+                counts[ b ] += tables[ t ][ b ];
+            }
+        }
+    }
+    STRING_TRACE_END( s.length );
 }
 
 
-StringM
-stringm__new_empty(
-        size_t const capacity )
+static
+int
+compare(
+        StringC const x,
+        StringC const y )
 {
-    return stringm__view_vec( vec_char__new_empty( capacity ) );
+    size_t const len = MIN( x.length, y.length );
+    int const c = ( len == 0 ) ? 0 : memcmp( x.e, y.e, len );
+    if ( c != 0 ) {
+        return c;
+    } else {
+        return ( x.length < y.length ) ? -1 : ( x.length > y.length );
+    }
 }
 
 
-StringM
-stringm__view_strm(
-        char * const str )
+int
+stringc__compare(
+        StringC const x,
+        StringC const y )
 {
-    ASSERT( str != NULL );
+    ASSERT( stringc__is_valid( x ), stringc__is_valid( y ) );
 
-    size_t const len = strlen_null( str );
-    return ( StringM ){ .e = str, .length = len, .capacity = len };
+    STRING_TRACE_BEGIN;
+    int const r = compare( x, y );
+    STRING_TRACE_END( MIN( x.length, y.length ) );
+    return r;
 }
 
 
-StringM
-stringm__view_arraym(
-        ArrayM_char const xs )
-{
-    ASSERT( arraym_char__is_valid( xs ) );
+// The edit distance functions below take the shorter string as the pattern
+// `p` and the longer as the text `t`, and return their distance if it's at
+// most `k`, or otherwise some larger lower bound on it. They give up early
+// once the score can't come back down to `k`: each remaining byte of the
+// text can lower it by one at most.
+//
+// The bit-parallel ones are Myers' algorithm in Hyyrö's formulation: the
+// vertical deltas of a column of the distance matrix are held as bit-vectors
+// of positive and negative ones, and a whole column is advanced per byte of
+// the text.
 
-    return stringm__view_vec( vec_char__view_arraym( xs ) );
+#define DISTANCE_WORD_BITS 64
+
+// The bounded distance is worked out over a band of `2 * k + 1` cells per
+// row, rather than with bit-vectors, when that's fewer than this many cells
+// per word of the bit-vectors.
+#define DISTANCE_BAND_CELLS_PER_WORD 8
+
+
+// Advances a 64-row block of a column over a text byte whose pattern
+// matches are `eq`, given the horizontal delta `hin` coming into its top
+// row. Returns the horizontal delta leaving the row marked by `out`.
+static
+int
+distance_advance(
+        uint64_t * const pv,
+        uint64_t * const mv,
+        uint64_t eq,
+        int const hin,
+        uint64_t const out )
+{
+    uint64_t const xv = eq | *mv;
+    if ( hin < 0 ) {
+        eq |= 1;
+    }
+    uint64_t const xh = ( ( ( eq & *pv ) + *pv ) ^ *pv ) | eq;
+    uint64_t ph = *mv | ~( xh | *pv );
+    uint64_t mh = *pv & xh;
+    int const hout = ( ph & out ) ? 1 : ( mh & out ) ? -1 : 0;
+    ph = ( ph << 1 ) | ( hin > 0 );
+    mh = ( mh << 1 ) | ( hin < 0 );
+    *pv = mh | ~( xv | ph );
+    *mv = ph & xv;
+    return hout;
 }
 
 
-StringM
-stringm__view_vec(
-        Vec_char const v )
+static
+size_t
+distance_word(
+        StringC const p,
+        StringC const t,
+        size_t const k )
 {
-    ASSERT( vec_char__is_valid( v ) );
+    uint64_t peq[ UCHAR_MAX + 1 ] = { 0 };
+    for ( size_t i = 0; i < p.length; i++ ) {
+        peq[ ( unsigned char ) p.e[ i ] ] |= UINT64_C( 1 ) << i;
+    }
+    uint64_t const out = UINT64_C( 1 ) << ( p.length - 1 );
+    uint64_t pv = ~UINT64_C( 0 );
+    uint64_t mv = 0;
+    size_t score = p.length;
+    for ( size_t j = 0; j < t.length; j++ ) {
+        uint64_t const eq = peq[ ( unsigned char ) t.e[ j ] ];
+        score += distance_advance( &pv, &mv, eq, 1, out );
+        size_t const rest = t.length - j - 1;
+        if ( score > k && score - k > rest ) {
+            return score - rest;
+        }
+    }
+    return score;
+}
 
-    return ( StringM ){ .e = v.e, .length = v.length, .capacity = v.capacity };
+
+static
+size_t
+distance_blocks(
+        StringC const p,
+        StringC const t,
+        size_t const k )
+{
+    size_t const words = ( p.length - 1 ) / DISTANCE_WORD_BITS + 1;
+    if ( words > SIZE_MAX / sizeof ( uint64_t ) / ( UCHAR_MAX + 3 ) ) {
+        errno = ENOBUFS;
+        return SIZE_MAX;
+    }
+    // The match masks for each byte value, followed by the positive and
+    // negative vertical deltas:
+    uint64_t * const peq = calloc( words * ( UCHAR_MAX + 3 ),
+                                   sizeof ( uint64_t ) );
+    if ( peq == NULL ) {
+        errno = ENOMEM;
+        return SIZE_MAX;
+    }
+    uint64_t * const pv = peq + words * ( UCHAR_MAX + 1 );
+    uint64_t * const mv = pv + words;
+    for ( size_t i = 0; i < p.length; i++ ) {
+        peq[ ( unsigned char ) p.e[ i ] * words + i / DISTANCE_WORD_BITS ]
+            |= UINT64_C( 1 ) << ( i % DISTANCE_WORD_BITS );
+    }
+    for ( size_t b = 0; b < words; b++ ) {
+        pv[ b ] = ~UINT64_C( 0 );
+    }
+    uint64_t const high = UINT64_C( 1 ) << ( DISTANCE_WORD_BITS - 1 );
+    uint64_t const out = UINT64_C( 1 )
+                      << ( ( p.length - 1 ) % DISTANCE_WORD_BITS );
+    size_t score = p.length;
+    for ( size_t j = 0; j < t.length; j++ ) {
+        uint64_t const * const eq = peq + ( unsigned char ) t.e[ j ] * words;
+        int h = 1;
+        for ( size_t b = 0; b + 1 < words; b++ ) {
+            h = distance_advance( pv + b, mv + b, eq[ b ], h, high );
+        }
+        score += distance_advance( pv + words - 1, mv + words - 1,
+                                   eq[ words - 1 ], h, out );
+        size_t const rest = t.length - j - 1;
+        if ( score > k && score - k > rest ) {
+            score -= rest;
+            break;
+        }
+    }
+    free( peq );
+    return score;
 }
 
 
-StringM
-stringm__view_strm0(
-        char * const str )
+// Works out the distance over the diagonal band of cells `( i, j )` with
+// `| i - j | <= k`, since every cell outside it is more than `k`. Each row
+// of the band is indexed by `j - i + k`, and every value over `k` is
+// clamped to `k + 1`. This requires `t.length - p.length <= k`.
+static
+size_t
+distance_banded(
+        StringC const p,
+        StringC const t,
+        size_t const k )
 {
-    ASSERT( str != NULL );
+    size_t const width = 2 * k + 1;
+    size_t * const prev = malloc( 2 * width * sizeof ( size_t ) );
+    if ( prev == NULL ) {
+        errno = ENOMEM;
+        return SIZE_MAX;
+    }
+    size_t * cur = prev + width;
+    size_t * last = prev;
+    for ( size_t d = 0; d < width; d++ ) {
+        last[ d ] = ( d >= k && d - k <= t.length ) ? d - k : k + 1;
+    }
+    size_t result = k + 1;
+    for ( size_t i = 1; i <= p.length; i++ ) {
+        size_t row_min = k + 1;
+        for ( size_t d = 0; d < width; d++ ) {
+            if ( i + d < k || i + d - k > t.length ) {
+                cur[ d ] = k + 1;
+                continue;
+            }
+            size_t const j = i + d - k;
+            if ( j == 0 ) {
+                cur[ d ] = i;
+            } else {
+                size_t v = last[ d ] + ( p.e[ i - 1 ] != t.e[ j - 1 ] );
+                if ( d + 1 < width ) {
+                    v = MIN( v, last[ d + 1 ] + 1 );
+                }
+                if ( d > 0 ) {
+                    v = MIN( v, cur[ d - 1 ] + 1 );
+                }
+                cur[ d ] = MIN( v, k + 1 );
+            }
+            row_min = MIN( row_min, cur[ d ] );
+        }
+        size_t * const swap = last;
+        last = cur;
+        cur = swap;
+        if ( row_min > k ) {
+            break;
+        }
+        if ( i == p.length ) {
+            result = last[ t.length - p.length + k ];
+        }
+    }
+    free( prev );
+    return result;
+}
 
-    size_t const len = strlen_null( str );
-    return ( StringM ){ .e = str, .length = len + 1, .capacity = len + 1 };
+
+static
+size_t
+edit_distance(
+        StringC a,
+        StringC b,
+        size_t const k )
+{
+    while ( a.length > 0 && b.length > 0 && a.e[ 0 ] == b.e[ 0 ] ) {
+        a = stringc__new( a.e + 1, a.length - 1 );
+        b = stringc__new( b.e + 1, b.length - 1 );
+    }
+    while ( a.length > 0 && b.length > 0
+         && a.e[ a.length - 1 ] == b.e[ b.length - 1 ] ) {
+        a.length--;
+        b.length--;
+    }
+    StringC const p = ( a.length <= b.length ) ? a : b;
+    StringC const t = ( a.length <= b.length ) ? b : a;
+    if ( p.length == 0 ) {
+        return t.length;
+    } else if ( t.length - p.length > k ) {
+        return t.length - p.length;
+    } else if ( p.length <= DISTANCE_WORD_BITS ) {
+        return distance_word( p, t, k );
+    }
+    size_t const words = ( p.length - 1 ) / DISTANCE_WORD_BITS + 1;
+    if ( k < words * DISTANCE_BAND_CELLS_PER_WORD / 2 ) {
+        return distance_banded( p, t, k );
+    } else {
+        return distance_blocks( p, t, k );
+    }
 }
 
 
-StringM
-stringm__copy_stringc(
+size_t
+stringc__levenshtein(
+        StringC const a,
+        StringC const b )
+{
+    ASSERT( stringc__is_valid( a ), stringc__is_valid( b ) );
+
+    STRING_TRACE_BEGIN;
+    size_t const d = edit_distance( a, b, SIZE_MAX );
+    STRING_TRACE_END( a.length + b.length );
+    return d;
+}
+
+
+bool
+stringc__within_distance(
+        StringC const a,
+        StringC const b,
+        size_t const k )
+{
+    ASSERT( stringc__is_valid( a ), stringc__is_valid( b ) );
+
+    STRING_TRACE_BEGIN;
+    bool const within = k >= MAX( a.length, b.length )
+                     || edit_distance( a, b, k ) <= k;
+    STRING_TRACE_END( a.length + b.length );
+    return within;
+}
+
+
+// The sorting functions work on items holding a key for the string at
+// `index`, made of the seven bytes at the current depth followed by one byte
+// saying how many of them were present, or 8 if the string goes on past them.
+// Comparing keys as integers thus orders the strings by those seven bytes,
+// with strings that end there sorting first.
+typedef struct sort_item {
+    uint64_t key;
+    size_t index;
+} SortItem;
+
+
+#define SORT_KEY_BYTES 7
+
+#define SORT_INSERTION_MAX 16
+
+
+static
+uint64_t
+sort_key(
+        StringC const s,
+        size_t const depth )
+{
+    size_t const rem = ( s.length > depth ) ? s.length - depth : 0;
+    size_t const m = MIN( rem, ( size_t ) SORT_KEY_BYTES );
+    uint64_t key = MIN( rem, ( size_t ) SORT_KEY_BYTES + 1 );
+    for ( size_t i = 0; i < m; i++ ) {
+        key |= ( uint64_t )( unsigned char ) s.e[ depth + i ]
+               << ( 56 - 8 * i );
+    }
+    return key;
+}
+
+
+static
+bool
+sort_key__ends(
+        uint64_t const key )
+{
+    return ( key & 0xFF ) <= SORT_KEY_BYTES;
+}
+
+
+static
+void
+sort_items__load_keys(
+        StringC const * const xs,
+        SortItem * const items,
+        size_t const n,
+        size_t const depth )
+{
+    for ( size_t i = 0; i < n; i++ ) {
+        items[ i ].key = sort_key( xs[ items[ i ].index ], depth );
+    }
+}
+
+
+static
+bool
+sort_items__less(
+        StringC const * const xs,
+        SortItem const x,
+        SortItem const y,
+        size_t const depth )
+{
+    if ( x.key != y.key ) {
+        return x.key < y.key;
+    } else if ( sort_key__ends( x.key ) ) {
+        return false;
+    } else {
+        size_t const d = depth + SORT_KEY_BYTES;
+        StringC const a = xs[ x.index ];
+        StringC const b = xs[ y.index ];
+        return compare( stringc__new( a.e + d, a.length - d ),
+                        stringc__new( b.e + d, b.length - d ) ) < 0;
+    }
+}
+
+
+static
+uint64_t
+median3(
+        uint64_t const a,
+        uint64_t const b,
+        uint64_t const c )
+{
+    return ( a < b ) ? ( ( b < c ) ? b : ( a < c ) ? c : a )
+                     : ( ( a < c ) ? a : ( b < c ) ? c : b );
+}
+
+
+// Multikey quicksort: a three-way partition on the keys at `depth`, and then
+// the items with keys equal to the pivot are sorted on their next seven
+// bytes. The keys must already be loaded for `depth`.
+static
+void
+sort_items(
+        StringC const * const xs,
+        SortItem * items,
+        size_t n,
+        size_t depth )
+{
+    while ( n > 1 ) {
+        if ( n <= SORT_INSERTION_MAX ) {
+            for ( size_t i = 1; i < n; i++ ) {
+                SortItem const x = items[ i ];
+                size_t j = i;
+                for ( ; j > 0 && sort_items__less( xs, x, items[ j - 1 ],
+                                                   depth ); j-- ) {
+                    items[ j ] = items[ j - 1 ];
+                }
+                items[ j ] = x;
+            }
+            return;
+        }
+        uint64_t const p = median3( items[ 0 ].key, items[ n / 2 ].key,
+                                    items[ n - 1 ].key );
+        size_t lt = 0;
+        size_t gt = n;
+        for ( size_t i = 0; i < gt; ) {
+            SortItem const x = items[ i ];
+            if ( x.key < p ) {
+                items[ i++ ] = items[ lt ];
+                items[ lt++ ] = x;
+            } else if ( x.key > p ) {
+                items[ i ] = items[ --gt ];
+                items[ gt ] = x;
+            } else {
+                i++;
+            }
+        }
+        // Recurse into the two smaller parts and loop on the largest, so
+        // that each recursion is on at most half of the items, and the stack
+        // stays logarithmic in depth whatever the keys:
+        size_t const below = lt;
+        size_t const above = n - gt;
+        size_t const equal = sort_key__ends( p ) ? 0 : gt - lt;
+        if ( equal >= below && equal >= above ) {
+            sort_items( xs, items, below, depth );
+            sort_items( xs, items + gt, above, depth );
+            items += lt;
+            n = equal;
+            depth += SORT_KEY_BYTES;
+            sort_items__load_keys( xs, items, n, depth );
+            continue;
+        }
+        if ( equal > 1 ) {
+            sort_items__load_keys( xs, items + lt, equal,
+                                   depth + SORT_KEY_BYTES );
+            sort_items( xs, items + lt, equal, depth + SORT_KEY_BYTES );
+        }
+        if ( below < above ) {
+            sort_items( xs, items, below, depth );
+            items += gt;
+            n = above;
+        } else {
+            sort_items( xs, items + gt, above, depth );
+            n = below;
+        }
+    }
+}
+
+
+// Permutes `xs` in place so that `xs[ i ]` becomes the old
+// `xs[ items[ i ].index ]`, following each cycle of the permutation once.
+static
+void
+sort_items__apply(
+        StringC * const xs,
+        SortItem * const items,
+        size_t const n )
+{
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( items[ i ].index == i ) { continue; }
+        StringC const first = xs[ i ];
+        size_t j = i;
+        while ( items[ j ].index != i ) {
+            size_t const k = items[ j ].index;
+            xs[ j ] = xs[ k ];
+            items[ j ].index = j;
+            j = k;
+        }
+        xs[ j ] = first;
+        items[ j ].index = j;
+    }
+}
+
+
+static
+SortItem *
+sort_items__new(
+        StringC const * const xs,
+        size_t const n )
+{
+    errno = 0;
+    SortItem * const items = malloc( n * sizeof *items );
+    if ( items == NULL ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        items[ i ] = ( SortItem ){ .key = sort_key( xs[ i ], 0 ), .index = i };
+    }
+    return items;
+}
+
+
+static
+int
+compare_ptrs(
+        void const * const x,
+        void const * const y )
+{
+    return compare( *( StringC const * ) x, *( StringC const * ) y );
+}
+
+
+static
+void
+sort_all(
+        StringC * const xs,
+        size_t const n )
+{
+    if ( n <= 1 ) { return; }
+    SortItem * const items = sort_items__new( xs, n );
+    if ( items == NULL ) {
+        qsort( xs, n, sizeof *xs, compare_ptrs );
+        errno = 0;
+        return;
+    }
+    sort_items( xs, items, n, 0 );
+    sort_items__apply( xs, items, n );
+    free( items );
+}
+
+
+void
+stringc__sort(
+        StringC * const xs,
+        size_t const n )
+{
+    ASSERT( IMPLIES( xs == NULL, n == 0 ) );
+
+    STRING_TRACE_BEGIN;
+    sort_all( xs, n );
+    STRING_TRACE_END( n * sizeof *xs );
+}
+
+
+static
+void
+sort_order(
+        StringC const * const xs,
+        size_t const n,
+        size_t * const order )
+{
+    if ( n == 0 ) { return; }
+    SortItem * const items = sort_items__new( xs, n );
+    if ( items == NULL ) { return; }
+    sort_items( xs, items, n, 0 );
+    for ( size_t i = 0; i < n; i++ ) {
+        order[ i ] = items[ i ].index;
+    }
+    free( items );
+}
+
+
+void
+stringc__sort_order(
+        StringC const * const xs,
+        size_t const n,
+        size_t * const order )
+{
+    ASSERT( IMPLIES( xs == NULL || order == NULL, n == 0 ) );
+
+    STRING_TRACE_BEGIN;
+    sort_order( xs, n, order );
+    STRING_TRACE_END( n * sizeof *xs );
+}
+
+
+// The parallel sort distributes the items into buckets by the first two bytes
+// of their keys, and then the threads take buckets off a shared counter and
+// sort them until none are left.
+#define SORT_BUCKETS ( 1 << 16 )
+
+
+typedef struct sort_buckets_job {
+    StringC const * xs;
+    SortItem * items;
+    size_t const * starts;
+    atomic_size_t next;
+} SortBucketsJob;
+
+
+static
+void
+sort_buckets_job__run(
+        void * const ctx,
+        size_t const begin,
+        size_t const end )
+{
+    SortBucketsJob * const job = ctx;
+    for ( size_t b = atomic_fetch_add( &job->next, 1 );
+          b < SORT_BUCKETS;
+          b = atomic_fetch_add( &job->next, 1 ) ) {
+        size_t const start = job->starts[ b ];
+        sort_items( job->xs, job->items + start,
+                    job->starts[ b + 1 ] - start, 0 );
+    }
+}
+
+
+static
+void
+sort_parallel(
+        StringC * const xs,
+        size_t const n,
+        size_t const threads )
+{
+    if ( threads <= 1 || n * sizeof *xs < STRING_PARALLEL_MIN_CHUNK ) {
+        sort_all( xs, n );
+        return;
+    }
+    errno = 0;
+    size_t * const starts = calloc( SORT_BUCKETS + 1, sizeof *starts );
+    SortItem * const items = malloc( n * sizeof *items );
+    SortItem * const src = sort_items__new( xs, n );
+    if ( starts == NULL || items == NULL || src == NULL ) {
+        free( starts );
+        free( items );
+        free( src );
+        sort_all( xs, n );
+        return;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        starts[ ( src[ i ].key >> 48 ) + 1 ]++;
+    }
+    for ( size_t b = 0; b < SORT_BUCKETS; b++ ) {
+        starts[ b + 1 ] += starts[ b ];
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        items[ starts[ src[ i ].key >> 48 ]++ ] = src[ i ];
+    }
+    free( src );
+    for ( size_t b = SORT_BUCKETS; b > 0; b-- ) {
+        starts[ b ] = starts[ b - 1 ];
+    }
+    starts[ 0 ] = 0;
+    SortBucketsJob job = { .xs = xs, .items = items, .starts = starts };
+    atomic_init( &job.next, 0 );
+    run_chunked( threads, 1, threads, sort_buckets_job__run, &job );
+    sort_items__apply( xs, items, n );
+    free( items );
+    free( starts );
+}
+
+
+void
+stringc__sort_parallel(
+        StringC * const xs,
+        size_t const n,
+        size_t const threads )
+{
+    ASSERT( IMPLIES( xs == NULL, n == 0 ) );
+
+    STRING_TRACE_BEGIN;
+    sort_parallel( xs, n, threads );
+    STRING_TRACE_END( n * sizeof *xs );
+}
+
+
+static
+char * *
+copy_argv(
+        StringC const * const xs,
+        size_t const n,
+        size_t * const block_length )
+{
+    if ( n >= SIZE_MAX / sizeof ( char * ) ) {
+        errno = ENOBUFS;
+        return NULL;
+    }
+    size_t const table = ( n + 1 ) * sizeof ( char * );
+    size_t block = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        ASSERT( stringc__is_valid( xs[ i ] ) );
+        if ( xs[ i ].length >= SIZE_MAX - table - block ) {
+            errno = ENOBUFS;
+            return NULL;
+        }
+        block += xs[ i ].length + 1;
+    }
+    char * * const argv = malloc( table + block );
+    if ( argv == NULL ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    char * str = ( char * ) argv + table;
+    for ( size_t i = 0; i < n; i++ ) {
+        argv[ i ] = str;
+        if ( xs[ i ].length > 0 ) {
+            memcpy( str, xs[ i ].e, xs[ i ].length );
+        }
+        str[ xs[ i ].length ] = '\0';
+        str += xs[ i ].length + 1;
+    }
+    argv[ n ] = NULL;
+    if ( block_length != NULL ) { *block_length = block; }
+    return argv;
+}
+
+
+char * *
+stringc__copy_argv(
+        StringC const * const xs,
+        size_t const n,
+        size_t * const block_length )
+{
+    ASSERT( IMPLIES( xs == NULL, n == 0 ) );
+
+    STRING_TRACE_BEGIN;
+    size_t block = 0;
+    char * * const argv = copy_argv( xs, n, &block );
+    if ( argv != NULL && block_length != NULL ) { *block_length = block; }
+    STRING_TRACE_END( block );
+    return argv;
+}
+
+
+StringC
+stringc__trim(
         StringC const s )
 {
     ASSERT( stringc__is_valid( s ) );
 
-    return stringm__new( s.e, s.length, s.length );
+    STRING_TRACE_BEGIN;
+    size_t const l = space_prefix_length( s.e, s.length );
+    size_t const r = space_suffix_length( s.e + l, s.length - l );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e + l, s.length - l - r );
 }
 
 
-StringM
-stringm__copy_stringm(
-        StringM const s )
+StringC
+stringc__trim_left(
+        StringC const s )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringc__is_valid( s ) );
 
-    return stringm__new( s.e, s.length, s.capacity );
+    STRING_TRACE_BEGIN;
+    size_t const n = space_prefix_length( s.e, s.length );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e + n, s.length - n );
 }
 
 
-StringM
-stringm__copy_arrayc(
-        ArrayC_char const xs )
+StringC
+stringc__trim_right(
+        StringC const s )
 {
-    ASSERT( arrayc_char__is_valid( xs ) );
+    ASSERT( stringc__is_valid( s ) );
 
-    return stringm__new( xs.e, xs.length, xs.length );
+    STRING_TRACE_BEGIN;
+    size_t const n = space_suffix_length( s.e, s.length );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e, s.length - n );
 }
 
 
-StringM
-stringm__copy_arraym(
-        ArrayM_char const xs )
+StringC
+stringc__trim_set(
+        StringC const s,
+        StringC const set )
 {
-    ASSERT( arraym_char__is_valid( xs ) );
+    ASSERT( stringc__is_valid( s ), stringc__is_valid( set ) );
 
-    return stringm__new( xs.e, xs.length, xs.length );
+    STRING_TRACE_BEGIN;
+    size_t const l = set_prefix_length( s.e, s.length, set );
+    size_t const r = set_suffix_length( s.e + l, s.length - l, set );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e + l, s.length - l - r );
 }
 
 
-StringM
-stringm__copy_vec(
-        Vec_char const v )
+StringC
+stringc__trim_left_set(
+        StringC const s,
+        StringC const set )
 {
-    ASSERT( vec_char__is_valid( v ) );
+    ASSERT( stringc__is_valid( s ), stringc__is_valid( set ) );
 
-    return stringm__new( v.e, v.length, v.capacity );
+    STRING_TRACE_BEGIN;
+    size_t const n = set_prefix_length( s.e, s.length, set );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e + n, s.length - n );
 }
 
 
-StringM
-stringm__copy_str(
-        char const * str )
+StringC
+stringc__trim_right_set(
+        StringC const s,
+        StringC const set )
 {
-    ASSERT( str != NULL );
+    ASSERT( stringc__is_valid( s ), stringc__is_valid( set ) );
 
-    size_t const len = strlen_null( str );
-    return stringm__new( str, len, len );
+    STRING_TRACE_BEGIN;
+    size_t const n = set_suffix_length( s.e, s.length, set );
+    STRING_TRACE_END( s.length );
+    return stringc__new( s.e, s.length - n );
+}
+
+
+StringM
+stringc__replaced_by(
+        StringC const xs,
+        char const el,
+        char const repl,
+        bool ( * const eq )( char x, char el ) )
+{
+    ASSERT( stringc__is_valid( xs ), eq != NULL );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__view(
+        arrayc_char__replaced_by( arrayc_char__view_stringc( xs ),
+                                  el, repl, eq ) );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringc__replaced(
+        StringC const xs,
+        char const el,
+        char const repl )
+{
+    ASSERT( stringc__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__view(
+        arrayc_char__replaced_by( arrayc_char__view_stringc( xs ),
+                                  el, repl, char_equal ) );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringc__replaced_i(
+        StringC const xs,
+        char const el,
+        char const repl )
+{
+    ASSERT( stringc__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__view(
+        arrayc_char__replaced_by( arrayc_char__view_stringc( xs ),
+                                  el, repl, char_equal_i ) );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringc__replacedf(
+        StringC const xs,
+        bool ( * const f )( char x ),
+        char const repl )
+{
+    ASSERT( stringc__is_valid( xs ), f != NULL );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__view(
+        arrayc_char__replacedf( arrayc_char__view_stringc( xs ), f, repl ) );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+
+// Writes `xs` with every occurrence of `needle` replaced to `out`, and
+// returns the number of bytes written. This is safe for `out` to overlap
+// `xs.e` as long as every byte is written after it's read: i.e., when `out`
+// is at or before `xs.e`, and growth from the replacements so far never
+// reaches past `xs.e` minus `out`.
+static
+size_t
+replace_all_into(
+        StringC const xs,
+        StringC const needle,
+        StringC const repl,
+        char * const out )
+{
+    size_t w = 0;
+    size_t i = 0;
+    for ( size_t j = find_in( xs, needle, 0 );
+          j != SIZE_MAX;
+          j = find_in( xs, needle, i ) ) {
+        if ( j > i ) {
+            memmove( out + w, xs.e + i, j - i );
+            w += j - i;
+        }
+        if ( repl.length > 0 ) {
+            memcpy( out + w, repl.e, repl.length );
+            w += repl.length;
+        }
+        i = j + needle.length;
+    }
+    if ( xs.length > i ) {
+        memmove( out + w, xs.e + i, xs.length - i );
+        w += xs.length - i;
+    }
+    return w;
+}
+
+
+static
+StringM
+replaced_all(
+        StringC const xs,
+        StringC const needle,
+        StringC const repl )
+{
+    size_t const count = count_in( xs, needle );
+    size_t const len = xs.length - count * needle.length
+                                 + count * repl.length;
+    errno = 0;
+    StringM r = stringm__new_empty( len );
+    if ( errno ) { return r; }
+    r.length = replace_all_into( xs, needle, repl, r.e );
+    keep_null( &r );
+    return r;
+}
+
+
+StringM
+stringc__replaced_all(
+        StringC const xs,
+        StringC const needle,
+        StringC const repl )
+{
+    ASSERT( stringc__is_valid( xs ), stringc__is_valid( needle ),
+            stringc__isnt_empty( needle ), stringc__is_valid( repl ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = replaced_all( xs, needle, repl );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+// Writes the `n` bytes of `xs` to `out` (which may be `xs`) with those
+// between `lo` and `hi` switched to the other ASCII case. Whole words with
+// none of them are copied as they are, and bytes outside ASCII are never
+// in range.
+static
+void
+switch_case_into(
+        char const * const xs,
+        size_t const n,
+        char * const out,
+        unsigned char const lo,
+        unsigned char const hi )
+{
+    size_t i = 0;
+    for ( ; i + 8 <= n; i += 8 ) {
+        uint64_t const w = swar_load( xs + i );
+        // The high bit of each matching byte, shifted down to the case bit:
+        uint64_t const flip = swar_in_range( w, lo, hi ) >> 2;
+        if ( flip != 0 || out != xs ) {
+            uint64_t const r = w ^ flip;
+            memcpy( out + i, &r, sizeof r );
+        }
+    }
+    for ( ; i < n; i++ ) {
+        unsigned char const c = ( unsigned char ) xs[ i ];
+        out[ i ] = ( c >= lo && c <= hi ) ? ( char ) ( c ^ 0x20 )
+                                          : ( char ) c;
+    }
+}
+
+
+static
+StringM
+switched_case(
+        StringC const xs,
+        unsigned char const lo,
+        unsigned char const hi )
+{
+    errno = 0;
+    StringM r = stringm__new_empty( xs.length );
+    if ( errno ) { return r; }
+    switch_case_into( xs.e, xs.length, r.e, lo, hi );
+    r.length = xs.length;
+    keep_null( &r );
+    return r;
+}
+
+
+StringM
+stringc__lowered(
+        StringC const xs )
+{
+    ASSERT( stringc__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = switched_case( xs, 'A', 'Z' );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringc__uppered(
+        StringC const xs )
+{
+    ASSERT( stringc__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = switched_case( xs, 'a', 'z' );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+
+///////////////////////////////////
+/// STRINGM FUNCTIONS
+///////////////////////////////////
+
+
+bool
+stringm__is_valid(
+        StringM const s )
+{
+    return ALL( STRINGM_INVARIANTS( s ) );
+}
+
+
+void
+stringm__free(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__free( &v );
+    *s = stringm__view_vec( v );
+}
+
+
+void
+stringm__freev(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    vec_char__freev( vec_char__view_stringm( s ) );
+}
+
+
+StringM
+stringm__new(
+        char const * const str,
+        size_t const length,
+        size_t const capacity )
+{
+    ASSERT( IMPLIES( str == NULL, length == 0 ), length <= capacity );
+
+    StringM s = stringm__view_vec(
+        vec_char__new( str, length, with_null( capacity ) ) );
+    keep_null( &s );
+    return s;
+}
+
+
+StringM
+stringm__new_empty(
+        size_t const capacity )
+{
+    StringM s = stringm__view_vec(
+        vec_char__new_empty( with_null( capacity ) ) );
+    keep_null( &s );
+    return s;
+}
+
+
+StringM
+stringm__view_strm(
+        char * const str )
+{
+    ASSERT( str != NULL );
+
+    size_t const len = strlen_null( str );
+    return ( StringM ){ .e = str, .length = len, .capacity = len + RESERVED };
+}
+
+
+StringM
+stringm__view_arraym(
+        ArrayM_char const xs )
+{
+    ASSERT( arraym_char__is_valid( xs ) );
+
+    return stringm__view_vec( vec_char__view_arraym( xs ) );
+}
+
+
+StringM
+stringm__view_vec(
+        Vec_char const v )
+{
+    ASSERT( vec_char__is_valid( v ) );
+
+    return ( StringM ){ .e = v.e, .length = v.length, .capacity = v.capacity };
+}
+
+
+StringM
+stringm__view_strm0(
+        char * const str )
+{
+    ASSERT( str != NULL );
+
+    size_t const len = strlen_null( str );
+    return ( StringM ){ .e = str, .length = len + 1, .capacity = len + 1 };
+}
+
+
+StringM
+stringm__adopt(
+        char * const str,
+        size_t const length,
+        size_t const capacity )
+{
+    ASSERT( length <= capacity, IMPLIES( capacity > 0, str != NULL ) );
+
+    StringM s = { .e = str, .length = length, .capacity = capacity };
+    keep_null( &s );
+    return s;
+}
+
+
+StringM
+stringm__copy_stringc(
+        StringC const s )
+{
+    ASSERT( stringc__is_valid( s ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__new( s.e, s.length, s.length );
+    STRING_TRACE_END( s.length );
+    return r;
+}
+
+
+StringM
+stringm__copy_stringm(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__new( s.e, s.length, s.capacity );
+    STRING_TRACE_END( s.length );
+    return r;
+}
+
+
+StringM
+stringm__copy_arrayc(
+        ArrayC_char const xs )
+{
+    ASSERT( arrayc_char__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__new( xs.e, xs.length, xs.length );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringm__copy_arraym(
+        ArrayM_char const xs )
+{
+    ASSERT( arraym_char__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__new( xs.e, xs.length, xs.length );
+    STRING_TRACE_END( xs.length );
+    return r;
+}
+
+
+StringM
+stringm__copy_vec(
+        Vec_char const v )
+{
+    ASSERT( vec_char__is_valid( v ) );
+
+    STRING_TRACE_BEGIN;
+    StringM const r = stringm__new( v.e, v.length, v.capacity );
+    STRING_TRACE_END( v.length );
+    return r;
+}
+
+
+StringM
+stringm__copy_str(
+        char const * str )
+{
+    ASSERT( str != NULL );
+
+    STRING_TRACE_BEGIN;
+    size_t const len = strlen_null( str );
+    StringM const r = stringm__new( str, len, len );
+    STRING_TRACE_END( len );
+    return r;
+}
+
+
+static
+void
+extend_arrayc(
+        StringM * const s,
+        ArrayC_char const ext )
+{
+    if ( RESERVED ) {
+        errno = 0;
+        stringm__grow_capacity_for( s, ext.length );
+        if ( errno ) { return; }
+    }
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__extend_arrayc( &v, ext );
+    *s = stringm__view_vec( v );
+    keep_null( s );
+}
+
+
+static
+void
+copy_into(
+        StringC const from,
+        StringM * const to )
+{
+    stringm__empty( to );
+    extend_arrayc( to, arrayc_char__view_stringc( from ) );
+}
+
+
+void
+stringm__copy_stringc_into(
+        StringC const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ),
+            stringc__is_valid( from ) );
+
+    STRING_TRACE_BEGIN;
+    copy_into( from, to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__copy_stringm_into(
+        StringM const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ),
+            stringm__is_valid( from ) );
+
+    STRING_TRACE_BEGIN;
+    copy_into( stringc__view( from ), to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__copy_arrayc_into(
+        ArrayC_char const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ),
+            arrayc_char__is_valid( from ) );
+
+    STRING_TRACE_BEGIN;
+    copy_into( stringc__view( from ), to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__copy_arraym_into(
+        ArrayM_char const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ),
+            arraym_char__is_valid( from ) );
+
+    STRING_TRACE_BEGIN;
+    copy_into( stringc__view( from ), to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__copy_vec_into(
+        Vec_char const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ),
+            vec_char__is_valid( from ) );
+
+    STRING_TRACE_BEGIN;
+    copy_into( stringc__view( from ), to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__copy_str_into(
+        char const * const from,
+        StringM * const to )
+{
+    ASSERT( to != NULL, stringm__is_valid( *to ), from != NULL );
+
+    STRING_TRACE_BEGIN;
+    StringC const x = stringc__view( from );
+    copy_into( x, to );
+    STRING_TRACE_END( x.length );
+}
+
+
+void
+stringm__into_stringm(
+        StringM const from,
+        StringM * const to )
+{
+    ASSERT( stringm__is_valid( from ), to != NULL, stringm__is_valid( *to ) );
+
+    STRING_TRACE_BEGIN;
+    Vec_char to_vec = vec_char__view_stringm( *to );
+    vec_char__into_vec( vec_char__view_stringm( from ), &to_vec );
+    *to = stringm__view( to_vec );
+    keep_null( to );
+    STRING_TRACE_END( from.length );
+}
+
+
+void
+stringm__into_vec(
+        StringM const from,
+        Vec_char * const to )
+{
+    ASSERT( stringm__is_valid( from ), to != NULL, vec_char__is_valid( *to ) );
+
+    STRING_TRACE_BEGIN;
+    vec_char__into_vec( vec_char__view_stringm( from ), to );
+    STRING_TRACE_END( from.length );
+}
+
+
+char *
+stringm__into_str(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    if ( s->length < s->capacity ) {
+        s->e[ s->length ] = '\0';
+    } else if ( stringm__is_empty( *s ) || stringm__last_isnt_null( *s ) ) {
+        if ( s->length == SIZE_MAX ) {
+            errno = ENOBUFS;
+            return NULL;
+        }
+        errno = 0;
+        stringm__realloc( s, s->length + 1 );
+        if ( errno ) { return NULL; }
+        s->e[ s->length ] = '\0';
+    }
+    char * const str = s->e;
+    *s = ( StringM ){ .e = NULL, .length = 0, .capacity = 0 };
+    return str;
+}
+
+
+char const *
+stringm__cstr(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ),
+            IMPLIES( s.capacity > 0, s.length < s.capacity
+                                     && s.e[ s.length ] == '\0' ) );
+
+    return ( s.capacity == 0 ) ? "" : s.e;
+}
+
+
+void
+stringm__terminate(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    if ( s->length == s->capacity ) {
+        if ( s->length == SIZE_MAX ) {
+            errno = ENOBUFS;
+            return;
+        }
+        Vec_char v = vec_char__view_stringm( *s );
+        errno = 0;
+        vec_char__grow_capacity_for( &v, 1 );
+        if ( errno ) { return; }
+        *s = stringm__view_vec( v );
+    }
+    s->e[ s->length ] = '\0';
+}
+
+
+void
+stringm__realloc(
+        StringM * const s,
+        size_t const new_capacity )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__realloc( &v, ( new_capacity == 0 ) ? 0
+                                                 : with_null( new_capacity ) );
+    *s = stringm__view_vec( v );
+    fit_null( s );
+}
+
+
+void
+stringm__grow_capacity(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__grow_capacity( &v );
+    *s = stringm__view_vec( v );
+    keep_null( s );
+}
+
+
+void
+stringm__grow_capacity_by(
+        StringM * const s,
+        size_t const to_grow )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__grow_capacity_by( &v, to_grow );
+    *s = stringm__view_vec( v );
+    keep_null( s );
+}
+
+
+void
+stringm__grow_capacity_for(
+        StringM * const s,
+        size_t const req_space )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__grow_capacity_for( &v, with_null( req_space ) );
+    *s = stringm__view_vec( v );
+    keep_null( s );
+}
+
+
+void
+stringm__ensure_capacity(
+        StringM * const s,
+        size_t const min_capacity )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__ensure_capacity( &v, with_null( min_capacity ) );
+    *s = stringm__view_vec( v );
+    keep_null( s );
+}
+
+
+void
+stringm__shrink_capacity(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__shrink_capacity( &v );
+    *s = stringm__view_vec( v );
+    fit_null( s );
+}
+
+
+void
+stringm__shrink_capacity_to(
+        StringM * const s,
+        size_t const max_capacity )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__shrink_capacity_to( &v, with_null( max_capacity ) );
+    *s = stringm__view_vec( v );
+    fit_null( s );
+}
+
+
+void
+stringm__shrink_capacity_by(
+        StringM * const s,
+        size_t const to_shrink )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__shrink_capacity_by( &v, to_shrink );
+    *s = stringm__view_vec( v );
+    fit_null( s );
+}
+
+
+void
+stringm__free_spare_capacity(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    if ( RESERVED ) {
+        stringm__realloc( s, s->length );
+        return;
+    }
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__free_spare_capacity( &v );
+    *s = stringm__view( v );
+}
+
+
+char *
+stringm__elements(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return s.e;
+}
+
+
+size_t
+stringm__length(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return s.length;
+}
+
+
+bool
+stringm__same(
+        StringM const s,
+        StringM const t )
+{
+    ASSERT( stringm__is_valid( s ), stringm__is_valid( t ) );
+
+    return vec_char__same( vec_char__view_stringm( s ),
+                           vec_char__view_stringm( t ) );
+}
+
+
+bool
+stringm__is_empty(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return stringm__length( s ) == 0;
+}
+
+
+bool
+stringm__isnt_empty(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return !stringm__is_empty( s );
+}
+
+
+bool
+stringm__is_empty0(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return stringm__is_empty( s )
+        || equal( stringc__view( s ), stringc__view_str0( "" ) );
+}
+
+
+bool
+stringm__isnt_empty0(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return !stringm__is_empty0( s );
+}
+
+
+char
+stringm__get(
+        StringM const s,
+        size_t const index )
+{
+    ASSERT( stringm__is_valid( s ), index < stringm__length( s ) );
+
+    return *( stringm__get_ptr( s, index ) );
+}
+
+
+char *
+stringm__get_ptr(
+        StringM const s,
+        size_t const index )
+{
+    ASSERT( stringm__is_valid( s ), index < stringm__length( s ) );
+
+    return stringm__elements( s ) + index;
+}
+
+
+char
+stringm__first(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ), stringm__isnt_empty( s ) );
+
+    return *( stringm__first_ptr( s ) );
+}
+
+
+char *
+stringm__first_ptr(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return stringm__is_empty( s ) ? NULL : stringm__elements( s );
+}
+
+
+char
+stringm__last(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ), stringm__isnt_empty( s ) );
+
+    return *( stringm__last_ptr( s ) );
+}
+
+
+char *
+stringm__last_ptr(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return stringm__is_empty( s )
+               ? NULL
+               : stringm__get_ptr( s, stringm__length( s ) - 1 );
+}
+
+
+bool
+stringm__last_is_null(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return stringm__isnt_empty( s ) && stringm__last( s ) == '\0';
+}
+
+
+bool
+stringm__last_isnt_null(
+        StringM const s )
+{
+    ASSERT( stringm__is_valid( s ) );
+
+    return !stringm__last_is_null( s );
+}
+
+
+void
+stringm__append(
+        StringM * const s,
+        char const c )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__append( &v, c );
+    *s = stringm__view( v );
+    keep_null( s );
+}
+
+
+void
+stringm__nullterm(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    if ( stringm__last_isnt_null( *s ) ) {
+        stringm__append( s, '\0' );
+    }
+}
+
+
+char
+stringm__pop(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    char const r = vec_char__pop( &v );
+    *s = stringm__view( v );
+    keep_null( s );
+    return r;
+}
+
+
+void
+stringm__popn(
+        StringM * const s,
+        size_t const n )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__popn( &v, n );
+    *s = stringm__view( v );
+    keep_null( s );
+}
+
+
+bool
+stringm__pop_null(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+
+    if ( stringm__last_is_null( *s ) ) {
+        stringm__pop( s );
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+void
+stringm__empty(
+        StringM * const s )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+
+    Vec_char v = vec_char__view_stringm( *s );
+    vec_char__empty( &v );
+    *s = stringm__view( v );
+    keep_null( s );
+}
+
+
+void
+stringm__extend_stringc(
+        StringM * const s,
+        StringC const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( ext ) );
+
+    STRING_TRACE_BEGIN;
+    extend_arrayc( s, arrayc_char__view_stringc( ext ) );
+    STRING_TRACE_END( ext.length );
+}
+
+
+void
+stringm__extend_stringm(
+        StringM * const s,
+        StringM const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__is_valid( ext ) );
+
+    STRING_TRACE_BEGIN;
+    extend_arrayc( s, arrayc_char__view_stringm( ext ) );
+    STRING_TRACE_END( ext.length );
+}
+
+
+void
+stringm__extend_arrayc(
+        StringM * const s,
+        ArrayC_char const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), arrayc_char__is_valid( ext ) );
+
+    STRING_TRACE_BEGIN;
+    extend_arrayc( s, ext );
+    STRING_TRACE_END( ext.length );
+}
+
+
+void
+stringm__extend_arraym(
+        StringM * const s,
+        ArrayM_char const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), arraym_char__is_valid( ext ) );
+
+    STRING_TRACE_BEGIN;
+    extend_arrayc( s, arrayc_char__view_arraym( ext ) );
+    STRING_TRACE_END( ext.length );
+}
+
+
+void
+stringm__extend_vec(
+        StringM * const s,
+        Vec_char const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), vec_char__is_valid( ext ) );
+
+    STRING_TRACE_BEGIN;
+    extend_arrayc( s, arrayc_char__view_vec( ext ) );
+    STRING_TRACE_END( ext.length );
+}
+
+
+void
+stringm__extend_str(
+        StringM * const s,
+        char const * const ext )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), ext != NULL );
+
+    STRING_TRACE_BEGIN;
+    StringC const x = stringc__view( ext );
+    extend_arrayc( s, arrayc_char__view_stringc( x ) );
+    STRING_TRACE_END( x.length );
+}
+
+
+static
+int
+hex_value(
+        char const c )
+{
+    if ( c >= '0' && c <= '9' ) {
+        return c - '0';
+    } else if ( c >= 'a' && c <= 'f' ) {
+        return c - 'a' + 10;
+    } else if ( c >= 'A' && c <= 'F' ) {
+        return c - 'A' + 10;
+    } else {
+        return -1;
+    }
+}
+
+
+static char const hex_digits_upper[] = "0123456789ABCDEF";
+
+
+// Writes the UTF-8 encoding of the given code point to `out`, and returns
+// the number of bytes written.
+static
+size_t
+utf8_encode(
+        uint32_t const cp,
+        char * const out )
+{
+    if ( cp < 0x80 ) {
+        out[ 0 ] = ( char ) cp;
+        return 1;
+    } else if ( cp < 0x800 ) {
+        out[ 0 ] = ( char )( 0xC0 | ( cp >> 6 ) );
+        out[ 1 ] = ( char )( 0x80 | ( cp & 0x3F ) );
+        return 2;
+    } else if ( cp < 0x10000 ) {
+        out[ 0 ] = ( char )( 0xE0 | ( cp >> 12 ) );
+        out[ 1 ] = ( char )( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        out[ 2 ] = ( char )( 0x80 | ( cp & 0x3F ) );
+        return 3;
+    } else {
+        out[ 0 ] = ( char )( 0xF0 | ( cp >> 18 ) );
+        out[ 1 ] = ( char )( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+        out[ 2 ] = ( char )( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        out[ 3 ] = ( char )( 0x80 | ( cp & 0x3F ) );
+        return 4;
+    }
+}
+
+
+// An escaper describes which bytes need escaping, both eight at a time and
+// one at a time, and how to escape them. Escaping is done in two passes over
+// the input: one to size the output, and one to write it. Both passes skip
+// over runs of bytes that don't need escaping eight bytes at a time.
+typedef struct escaper {
+    uint64_t ( * special8 )( uint64_t w );
+    bool ( * special )( char c );
+    size_t ( * escaped_length )( char c );
+    size_t ( * escape )( char c, char * out );
+} Escaper;
+
+
+static
+size_t
+escaper__clean_length(
+        Escaper const * const esc,
+        char const * const xs,
+        size_t const n )
+{
+    size_t i = 0;
+    while ( i + 8 <= n && esc->special8( swar_load( xs + i ) ) == 0 ) {
+        i += 8;
+    }
+    while ( i < n && !esc->special( xs[ i ] ) ) {
+        i++;
+    }
+    return i;
+}
+
+
+static
+void
+extend_escaped(
+        StringM * const s,
+        StringC const xs,
+        Escaper const * const esc )
+{
+    size_t len = 0;
+    for ( size_t i = 0; i < xs.length; ) {
+        size_t const clean = escaper__clean_length( esc, xs.e + i,
+                                                    xs.length - i );
+        len += clean;
+        i += clean;
+        if ( i < xs.length ) {
+            len += esc->escaped_length( xs.e[ i ] );
+            i++;
+        }
+    }
+    errno = 0;
+    stringm__grow_capacity_for( s, len );
+    if ( errno ) { return; }
+    char * out = s->e + s->length;
+    for ( size_t i = 0; i < xs.length; ) {
+        size_t const clean = escaper__clean_length( esc, xs.e + i,
+                                                    xs.length - i );
+        if ( clean > 0 ) {
+            memcpy( out, xs.e + i, clean );
+            out += clean;
+            i += clean;
+        }
+        if ( i < xs.length ) {
+            out += esc->escape( xs.e[ i ], out );
+            i++;
+        }
+    }
+    s->length += len;
+    keep_null( s );
+}
+
+
+// An unescaper describes the byte that starts an escape sequence, and how to
+// decode the sequence starting at `xs.e[ 0 ]`: it sets `*consumed` to the
+// length of the sequence, writes its decoding to `out` (which has room for
+// four bytes) and returns the length of that, or returns `SIZE_MAX` if the
+// sequence is invalid. Runs of other bytes are found with `memchr`.
+typedef struct unescaper {
+    char start;
+    size_t ( * unescape )( StringC xs, size_t * consumed, char * out );
+} Unescaper;
+
+
+static
+void
+extend_unescaped(
+        StringM * const s,
+        StringC const xs,
+        Unescaper const * const unesc )
+{
+    char buf[ 4 ];
+    size_t len = 0;
+    for ( size_t i = 0; i < xs.length; ) {
+        char const * const p = memchr( xs.e + i, unesc->start,
+                                       xs.length - i );
+        size_t const clean = ( p == NULL ) ? xs.length - i
+                                           : ( size_t )( p - xs.e ) - i;
+        len += clean;
+        i += clean;
+        if ( i < xs.length ) {
+            size_t consumed;
+            size_t const n = unesc->unescape(
+                stringc__new( xs.e + i, xs.length - i ), &consumed, buf );
+            if ( n == SIZE_MAX ) {
+                errno = EINVAL;
+                return;
+            }
+            len += n;
+            i += consumed;
+        }
+    }
+    errno = 0;
+    stringm__grow_capacity_for( s, len );
+    if ( errno ) { return; }
+    char * out = s->e + s->length;
+    for ( size_t i = 0; i < xs.length; ) {
+        char const * const p = memchr( xs.e + i, unesc->start,
+                                       xs.length - i );
+        size_t const clean = ( p == NULL ) ? xs.length - i
+                                           : ( size_t )( p - xs.e ) - i;
+        if ( clean > 0 ) {
+            memcpy( out, xs.e + i, clean );
+            out += clean;
+            i += clean;
+        }
+        if ( i < xs.length ) {
+            size_t consumed;
+            size_t const n = unesc->unescape(
+                stringc__new( xs.e + i, xs.length - i ), &consumed, buf );
+            memcpy( out, buf, n );
+            out += n;
+            i += consumed;
+        }
+    }
+    s->length += len;
+    keep_null( s );
+}
+
+
+static
+uint64_t
+json_special8(
+        uint64_t const w )
+{
+    return swar_eq( w, '"' ) | swar_eq( w, '\\' ) | swar_lt( w, 0x20 );
+}
+
+
+static
+bool
+json_special(
+        char const c )
+{
+    return c == '"' || c == '\\' || ( unsigned char ) c < 0x20;
+}
+
+
+static
+char
+json_short_escape(
+        char const c )
+{
+    switch ( c ) {
+        case '"':  return '"';
+        case '\\': return '\\';
+        case '\b': return 'b';
+        case '\f': return 'f';
+        case '\n': return 'n';
+        case '\r': return 'r';
+        case '\t': return 't';
+        default:   return '\0';
+    }
+}
+
+
+static
+size_t
+json_escaped_length(
+        char const c )
+{
+    return ( json_short_escape( c ) != '\0' ) ? 2 : 6;
+}
+
+
+static
+size_t
+json_escape(
+        char const c,
+        char * const out )
+{
+    char const e = json_short_escape( c );
+    out[ 0 ] = '\\';
+    if ( e != '\0' ) {
+        out[ 1 ] = e;
+        return 2;
+    } else {
+        memcpy( out + 1, "u00", 3 );
+        out[ 4 ] = hex_digits_upper[ ( unsigned char ) c >> 4 ];
+        out[ 5 ] = hex_digits_upper[ ( unsigned char ) c & 0xF ];
+        return 6;
+    }
+}
+
+
+// Parses the four hex digits of a `\uXXXX` escape starting at `xs.e[ i ]`,
+// or returns -1 if there aren't four hex digits there.
+static
+long
+json_hex4(
+        StringC const xs,
+        size_t const i )
+{
+    if ( xs.length < i + 4 ) { return -1; }
+    long v = 0;
+    for ( size_t j = i; j < i + 4; j++ ) {
+        int const h = hex_value( xs.e[ j ] );
+        if ( h < 0 ) { return -1; }
+        v = v * 16 + h;
+    }
+    return v;
+}
+
+
+static
+size_t
+json_unescape(
+        StringC const xs,
+        size_t * const consumed,
+        char * const out )
+{
+    if ( xs.length < 2 ) { return SIZE_MAX; }
+    *consumed = 2;
+    switch ( xs.e[ 1 ] ) {
+        case '"':  out[ 0 ] = '"';  return 1;
+        case '\\': out[ 0 ] = '\\'; return 1;
+        case '/':  out[ 0 ] = '/';  return 1;
+        case 'b':  out[ 0 ] = '\b'; return 1;
+        case 'f':  out[ 0 ] = '\f'; return 1;
+        case 'n':  out[ 0 ] = '\n'; return 1;
+        case 'r':  out[ 0 ] = '\r'; return 1;
+        case 't':  out[ 0 ] = '\t'; return 1;
+        case 'u':  break;
+        default:   return SIZE_MAX;
+    }
+    long const hi = json_hex4( xs, 2 );
+    *consumed = 6;
+    if ( hi < 0 || ( hi >= 0xDC00 && hi <= 0xDFFF ) ) {
+        return SIZE_MAX;
+    } else if ( hi < 0xD800 || hi > 0xDBFF ) {
+        return utf8_encode( ( uint32_t ) hi, out );
+    }
+    if ( xs.length < 12 || xs.e[ 6 ] != '\\' || xs.e[ 7 ] != 'u' ) {
+        return SIZE_MAX;
+    }
+    long const lo = json_hex4( xs, 8 );
+    if ( lo < 0xDC00 || lo > 0xDFFF ) { return SIZE_MAX; }
+    *consumed = 12;
+    return utf8_encode( 0x10000 + ( ( ( uint32_t ) hi - 0xD800 ) << 10 )
+                                + ( ( uint32_t ) lo - 0xDC00 ), out );
+}
+
+
+static Escaper const json_escaper = {
+    .special8 = json_special8,
+    .special = json_special,
+    .escaped_length = json_escaped_length,
+    .escape = json_escape
+};
+
+
+static Unescaper const json_unescaper = {
+    .start = '\\',
+    .unescape = json_unescape
+};
+
+
+static
+uint64_t
+url_special8(
+        uint64_t const w )
+{
+    uint64_t const clean = swar_in_range( w, '0', '9' )
+                         | swar_in_range( w, 'A', 'Z' )
+                         | swar_in_range( w, 'a', 'z' )
+                         | swar_eq( w, '-' ) | swar_eq( w, '.' )
+                         | swar_eq( w, '_' ) | swar_eq( w, '~' );
+    return ~clean & SWAR_HIGHS;
+}
+
+
+static
+bool
+url_special(
+        char const c )
+{
+    return !( ( c >= '0' && c <= '9' )
+           || ( c >= 'A' && c <= 'Z' )
+           || ( c >= 'a' && c <= 'z' )
+           || c == '-' || c == '.' || c == '_' || c == '~' );
+}
+
+
+static
+size_t
+url_escaped_length(
+        char const c )
+{
+    return 3;
 }
 
 
-void
-stringm__copy_stringc_into(
-        StringC const from,
-        StringM * const to )
+static
+size_t
+url_escape(
+        char const c,
+        char * const out )
 {
-    ASSERT( to != NULL, stringm__is_valid( *to ),
-            stringc__is_valid( from ) );
-
-    stringm__empty( to );
-    stringm__extend( to, from );
+    out[ 0 ] = '%';
+    out[ 1 ] = hex_digits_upper[ ( unsigned char ) c >> 4 ];
+    out[ 2 ] = hex_digits_upper[ ( unsigned char ) c & 0xF ];
+    return 3;
 }
 
 
-void
-stringm__copy_stringm_into(
-        StringM const from,
-        StringM * const to )
+static
+size_t
+url_unescape(
+        StringC const xs,
+        size_t * const consumed,
+        char * const out )
 {
-    ASSERT( to != NULL, stringm__is_valid( *to ),
-            stringm__is_valid( from ) );
-
-    stringm__copy_stringc_into( stringc__view( from ), to );
+    if ( xs.length < 3 ) { return SIZE_MAX; }
+    int const hi = hex_value( xs.e[ 1 ] );
+    int const lo = hex_value( xs.e[ 2 ] );
+    if ( hi < 0 || lo < 0 ) { return SIZE_MAX; }
+    *consumed = 3;
+    out[ 0 ] = ( char )( hi * 16 + lo );
+    return 1;
 }
 
 
-void
-stringm__copy_arrayc_into(
-        ArrayC_char const from,
-        StringM * const to )
-{
-    ASSERT( to != NULL, stringm__is_valid( *to ),
-            arrayc_char__is_valid( from ) );
+static Escaper const url_escaper = {
+    .special8 = url_special8,
+    .special = url_special,
+    .escaped_length = url_escaped_length,
+    .escape = url_escape
+};
 
-    stringm__copy_stringc_into( stringc__view( from ), to );
-}
 
+static Unescaper const url_unescaper = {
+    .start = '%',
+    .unescape = url_unescape
+};
 
-void
-stringm__copy_arraym_into(
-        ArrayM_char const from,
-        StringM * const to )
-{
-    ASSERT( to != NULL, stringm__is_valid( *to ),
-            arraym_char__is_valid( from ) );
 
-    stringm__copy_stringc_into( stringc__view( from ), to );
+static
+uint64_t
+html_special8(
+        uint64_t const w )
+{
+    return swar_eq( w, '&' ) | swar_eq( w, '<' ) | swar_eq( w, '>' )
+         | swar_eq( w, '"' ) | swar_eq( w, '\'' );
 }
 
 
-void
-stringm__copy_vec_into(
-        Vec_char const from,
-        StringM * const to )
+static
+bool
+html_special(
+        char const c )
 {
-    ASSERT( to != NULL, stringm__is_valid( *to ),
-            vec_char__is_valid( from ) );
-
-    stringm__copy_stringc_into( stringc__view( from ), to );
+    return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
 }
 
 
-void
-stringm__copy_str_into(
-        char const * const from,
-        StringM * const to )
+static
+char const *
+html_reference(
+        char const c )
 {
-    ASSERT( to != NULL, stringm__is_valid( *to ), from != NULL );
-
-    stringm__copy_stringc_into( stringc__view( from ), to );
+    switch ( c ) {
+        case '&':  return "&amp;";
+        case '<':  return "&lt;";
+        case '>':  return "&gt;";
+        case '"':  return "&quot;";
+        default:   return "&#39;";
+    }
 }
 
 
-void
-stringm__into_stringm(
-        StringM const from,
-        StringM * const to )
+static
+size_t
+html_escaped_length(
+        char const c )
 {
-    ASSERT( stringm__is_valid( from ), to != NULL, stringm__is_valid( *to ) );
-
-    Vec_char to_vec = vec_char__view_stringm( *to );
-    vec_char__into_vec( vec_char__view_stringm( from ), &to_vec );
-    *to = stringm__view( to_vec );
+    return strlen( html_reference( c ) );
 }
 
 
-void
-stringm__into_vec(
-        StringM const from,
-        Vec_char * const to )
+static
+size_t
+html_escape(
+        char const c,
+        char * const out )
 {
-    ASSERT( stringm__is_valid( from ), to != NULL, vec_char__is_valid( *to ) );
-
-    vec_char__into_vec( vec_char__view_stringm( from ), to );
+    char const * const ref = html_reference( c );
+    size_t const len = strlen( ref );
+    memcpy( out, ref, len );
+    return len;
 }
 
 
-void
-stringm__realloc(
-        StringM * const s,
-        size_t const new_capacity )
-{
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+// The longest character reference that HTML unescaping will recognize:
+// `&#x10FFFF;`, or `&#1114111;`.
+#define HTML_REFERENCE_MAX 10
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__realloc( &v, new_capacity );
-    *s = stringm__view_vec( v );
+
+static
+size_t
+html_unescape(
+        StringC const xs,
+        size_t * const consumed,
+        char * const out )
+{
+    static struct { char const * name; char c; } const named[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' },
+        { "&quot;", '"' }, { "&apos;", '\'' }
+    };
+    char const * const semi = memchr( xs.e, ';',
+                                      MIN( xs.length, HTML_REFERENCE_MAX ) );
+    *consumed = 1;
+    out[ 0 ] = '&';
+    if ( semi == NULL ) { return 1; }
+    StringC const ref = stringc__new( xs.e, ( size_t )( semi - xs.e ) + 1 );
+    for ( size_t i = 0; i < sizeof named / sizeof named[ 0 ]; i++ ) {
+        if ( equal( ref, stringc__view( named[ i ].name ) ) ) {
+            *consumed = ref.length;
+            out[ 0 ] = named[ i ].c;
+            return 1;
+        }
+    }
+    if ( ref.length < 4 || ref.e[ 1 ] != '#' ) { return 1; }
+    bool const hex = ref.e[ 2 ] == 'x' || ref.e[ 2 ] == 'X';
+    size_t const first = hex ? 3 : 2;
+    if ( first == ref.length - 1 ) { return 1; }
+    uint32_t cp = 0;
+    for ( size_t i = first; i < ref.length - 1; i++ ) {
+        int const d = hex ? hex_value( ref.e[ i ] )
+                          : ( ref.e[ i ] >= '0' && ref.e[ i ] <= '9' )
+                                ? ref.e[ i ] - '0' : -1;
+        if ( d < 0 ) { return 1; }
+        cp = cp * ( hex ? 16 : 10 ) + ( uint32_t ) d;
+    }
+    if ( cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) ) { return 1; }
+    *consumed = ref.length;
+    return utf8_encode( cp, out );
 }
 
 
-void
-stringm__grow_capacity(
-        StringM * const s )
-{
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+static Escaper const html_escaper = {
+    .special8 = html_special8,
+    .special = html_special,
+    .escaped_length = html_escaped_length,
+    .escape = html_escape
+};
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__grow_capacity( &v );
-    *s = stringm__view_vec( v );
-}
+
+static Unescaper const html_unescaper = {
+    .start = '&',
+    .unescape = html_unescape
+};
 
 
 void
-stringm__grow_capacity_by(
+stringm__extend_json_escaped(
         StringM * const s,
-        size_t const to_grow )
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__grow_capacity_by( &v, to_grow );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_escaped( s, xs, &json_escaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__grow_capacity_for(
+stringm__extend_url_escaped(
         StringM * const s,
-        size_t const req_space )
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__grow_capacity_for( &v, req_space );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_escaped( s, xs, &url_escaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__ensure_capacity(
+stringm__extend_html_escaped(
         StringM * const s,
-        size_t const min_capacity )
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__ensure_capacity( &v, min_capacity );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_escaped( s, xs, &html_escaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__shrink_capacity(
-        StringM * const s )
+stringm__extend_json_unescaped(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__shrink_capacity( &v );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_unescaped( s, xs, &json_unescaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__shrink_capacity_to(
+stringm__extend_url_unescaped(
         StringM * const s,
-        size_t const max_capacity )
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__shrink_capacity_to( &v, max_capacity );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_unescaped( s, xs, &url_unescaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__shrink_capacity_by(
+stringm__extend_html_unescaped(
         StringM * const s,
-        size_t const to_shrink )
+        StringC const xs )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__shrink_capacity_by( &v, to_shrink );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    extend_unescaped( s, xs, &html_unescaper );
+    STRING_TRACE_END( xs.length );
 }
 
 
+// The value of each byte in a base64 alphabet, or `BASE64_BAD` if the byte
+// isn't in the alphabet.
+#define BASE64_BAD 255
+
+static unsigned char const base64_values[ UCHAR_MAX + 1 ] = {
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255, 62,255,255,255, 63,
+     52, 53, 54, 55, 56, 57, 58, 59, 60, 61,255,255,255,255,255,255,
+    255,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+     15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,255,255,255,255,255,
+    255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+     41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255
+};
+
+static unsigned char const base64url_values[ UCHAR_MAX + 1 ] = {
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255, 62,255,255,
+     52, 53, 54, 55, 56, 57, 58, 59, 60, 61,255,255,255,255,255,255,
+    255,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+     15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,255,255,255,255, 63,
+    255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+     41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255
+};
+
+
+typedef struct base64 {
+    char const * alphabet;
+    unsigned char const * values;
+    bool pad;
+} Base64;
+
+
+static Base64 const base64_std = {
+    .alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                "0123456789+/",
+    .values = base64_values,
+    .pad = true
+};
+
+
+static Base64 const base64_url = {
+    .alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                "0123456789-_",
+    .values = base64url_values,
+    .pad = false
+};
+
+
+static
 void
-stringm__free_spare_capacity(
-        StringM * const s )
+extend_base64_encoded(
+        StringM * const s,
+        StringC const xs,
+        Base64 const * const b64 )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
-
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__free_spare_capacity( &v );
-    *s = stringm__view( v );
+    size_t const n = xs.length;
+    size_t const rem = n % 3;
+    size_t const len = ( n / 3 ) * 4
+                     + ( ( rem == 0 ) ? 0 : b64->pad ? 4 : rem + 1 );
+    errno = 0;
+    stringm__grow_capacity_for( s, len );
+    if ( errno ) { return; }
+    unsigned char const * const in = ( unsigned char const * ) xs.e;
+    char const * const alpha = b64->alphabet;
+    char * out = s->e + s->length;
+    size_t i = 0;
+    for ( ; i + 3 <= n; i += 3 ) {
+        uint32_t const v = ( uint32_t ) in[ i ] << 16
+                         | ( uint32_t ) in[ i + 1 ] << 8
+                         | ( uint32_t ) in[ i + 2 ];
+        out[ 0 ] = alpha[ v >> 18 ];
+        out[ 1 ] = alpha[ ( v >> 12 ) & 0x3F ];
+        out[ 2 ] = alpha[ ( v >> 6 ) & 0x3F ];
+        out[ 3 ] = alpha[ v & 0x3F ];
+        out += 4;
+    }
+    if ( rem > 0 ) {
+        uint32_t const v = ( uint32_t ) in[ i ] << 16
+                         | ( ( rem == 2 ) ? ( uint32_t ) in[ i + 1 ] << 8 : 0 );
+        out[ 0 ] = alpha[ v >> 18 ];
+        out[ 1 ] = alpha[ ( v >> 12 ) & 0x3F ];
+        if ( rem == 2 ) {
+            out[ 2 ] = alpha[ ( v >> 6 ) & 0x3F ];
+        }
+        if ( b64->pad ) {
+            out[ 2 ] = ( rem == 2 ) ? out[ 2 ] : '=';
+            out[ 3 ] = '=';
+        }
+    }
+    s->length += len;
+    keep_null( s );
 }
 
 
-char *
-stringm__elements(
-        StringM const s )
+static
+size_t
+extend_base64_decoded(
+        StringM * const s,
+        StringC const xs,
+        Base64 const * const b64 )
 {
-    ASSERT( stringm__is_valid( s ) );
-
-    return s.e;
+    size_t n = xs.length;
+    size_t pad = 0;
+    while ( pad < 2 && n > 0 && xs.e[ n - 1 ] == '=' ) {
+        n--;
+        pad++;
+    }
+    size_t const rem = n % 4;
+    if ( ( pad > 0 && ( n + pad ) % 4 != 0 ) || rem == 1 ) {
+        size_t const bad = ( rem == 1 ) ? n - 1 : n;
+        errno = EINVAL;
+        for ( size_t i = 0; i < bad; i++ ) {
+            if ( b64->values[ ( unsigned char ) xs.e[ i ] ] == BASE64_BAD ) {
+                return i;
+            }
+        }
+        return bad;
+    }
+    size_t const len = ( n / 4 ) * 3 + ( ( rem == 0 ) ? 0 : rem - 1 );
+    errno = 0;
+    stringm__grow_capacity_for( s, len );
+    if ( errno ) { return 0; }
+    unsigned char const * const in = ( unsigned char const * ) xs.e;
+    unsigned char const * const vals = b64->values;
+    char * out = s->e + s->length;
+    for ( size_t i = 0; i < n; i += 4 ) {
+        size_t const m = MIN( n - i, ( size_t ) 4 );
+        unsigned char const a = vals[ in[ i ] ];
+        unsigned char const b = vals[ in[ i + 1 ] ];
+        unsigned char const c = ( m > 2 ) ? vals[ in[ i + 2 ] ] : 0;
+        unsigned char const d = ( m > 3 ) ? vals[ in[ i + 3 ] ] : 0;
+        if ( ( a | b | c | d ) & 0x80 ) {
+            size_t j = i;
+            while ( vals[ in[ j ] ] != BASE64_BAD ) {
+                j++;
+            }
+            // Restore the null byte that the decoding wrote over:
+            keep_null( s );
+            errno = EINVAL;
+            return j;
+        }
+        uint32_t const v = ( uint32_t ) a << 18 | ( uint32_t ) b << 12
+                         | ( uint32_t ) c << 6 | d;
+        out[ 0 ] = ( char )( v >> 16 );
+        if ( m > 2 ) { out[ 1 ] = ( char )( ( v >> 8 ) & 0xFF ); }
+        if ( m > 3 ) { out[ 2 ] = ( char )( v & 0xFF ); }
+        out += m - 1;
+    }
+    s->length += len;
+    keep_null( s );
+    return xs.length;
 }
 
 
-size_t
-stringm__length(
-        StringM const s )
+static char const hex_digits_lower[] = "0123456789abcdef";
+
+
+void
+stringm__extend_base64_encoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    return s.length;
+    STRING_TRACE_BEGIN;
+    extend_base64_encoded( s, xs, &base64_std );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__same(
-        StringM const s,
-        StringM const t )
+void
+stringm__extend_base64url_encoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ), stringm__is_valid( t ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    return vec_char__same( vec_char__view_stringm( s ),
-                           vec_char__view_stringm( t ) );
+    STRING_TRACE_BEGIN;
+    extend_base64_encoded( s, xs, &base64_url );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__is_empty(
-        StringM const s )
+static
+void
+extend_hex_encoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ) );
-
-    return stringm__length( s ) == 0;
+    errno = 0;
+    stringm__grow_capacity_for( s, xs.length * 2 );
+    if ( errno ) { return; }
+    char * const out = s->e + s->length;
+    for ( size_t i = 0; i < xs.length; i++ ) {
+        unsigned char const x = ( unsigned char ) xs.e[ i ];
+        out[ 2 * i ] = hex_digits_lower[ x >> 4 ];
+        out[ 2 * i + 1 ] = hex_digits_lower[ x & 0xF ];
+    }
+    s->length += xs.length * 2;
+    keep_null( s );
 }
 
 
-bool
-stringm__isnt_empty(
-        StringM const s )
+void
+stringm__extend_hex_encoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ),
+            xs.length <= SIZE_MAX / 2 );
 
-    return !stringm__is_empty( s );
+    STRING_TRACE_BEGIN;
+    extend_hex_encoded( s, xs );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__is_empty0(
-        StringM const s )
+size_t
+stringm__extend_base64_decoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    return stringm__is_empty( s )
-        || stringm__equal( s, stringc__view_str0( "" ) );
+    STRING_TRACE_BEGIN;
+    size_t const r = extend_base64_decoded( s, xs, &base64_std );
+    STRING_TRACE_END( xs.length );
+    return r;
 }
 
 
-bool
-stringm__isnt_empty0(
-        StringM const s )
+size_t
+stringm__extend_base64url_decoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    return !stringm__is_empty0( s );
+    STRING_TRACE_BEGIN;
+    size_t const r = extend_base64_decoded( s, xs, &base64_url );
+    STRING_TRACE_END( xs.length );
+    return r;
 }
 
 
-char
-stringm__get(
-        StringM const s,
-        size_t const index )
+static
+size_t
+extend_hex_decoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ), index < stringm__length( s ) );
-
-    return *( stringm__get_ptr( s, index ) );
+    size_t const len = xs.length / 2;
+    errno = 0;
+    stringm__grow_capacity_for( s, len );
+    if ( errno ) { return 0; }
+    char * const out = s->e + s->length;
+    for ( size_t i = 0; i < len; i++ ) {
+        int const hi = hex_value( xs.e[ 2 * i ] );
+        int const lo = hex_value( xs.e[ 2 * i + 1 ] );
+        if ( hi < 0 || lo < 0 ) {
+            // Restore the null byte that the decoding wrote over:
+            keep_null( s );
+            errno = EINVAL;
+            return ( hi < 0 ) ? 2 * i : 2 * i + 1;
+        }
+        out[ i ] = ( char )( hi << 4 | lo );
+    }
+    if ( xs.length % 2 != 0 ) {
+        keep_null( s );
+        errno = EINVAL;
+        return xs.length - 1;
+    }
+    s->length += len;
+    keep_null( s );
+    return xs.length;
 }
 
 
-char *
-stringm__get_ptr(
-        StringM const s,
-        size_t const index )
+size_t
+stringm__extend_hex_decoded(
+        StringM * const s,
+        StringC const xs )
 {
-    ASSERT( stringm__is_valid( s ), index < stringm__length( s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( xs ) );
 
-    return stringm__elements( s ) + index;
+    STRING_TRACE_BEGIN;
+    size_t const r = extend_hex_decoded( s, xs );
+    STRING_TRACE_END( xs.length );
+    return r;
 }
 
 
-char
-stringm__first(
-        StringM const s )
+bool
+stringm__equal_stringc(
+        StringM const x,
+        StringC const y )
 {
-    ASSERT( stringm__is_valid( s ), stringm__isnt_empty( s ) );
+    ASSERT( stringm__is_valid( x ), stringc__is_valid( y ) );
 
-    return *( stringm__first_ptr( s ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), y );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
-char *
-stringm__first_ptr(
-        StringM const s )
+bool
+stringm__equal_stringm(
+        StringM const x,
+        StringM const y )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringm__is_valid( x ), stringm__is_valid( y ) );
 
-    return stringm__is_empty( s ) ? NULL : stringm__elements( s );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
-char
-stringm__last(
-        StringM const s )
+bool
+stringm__equal_arrayc(
+        StringM const x,
+        ArrayC_char const y )
 {
-    ASSERT( stringm__is_valid( s ), stringm__isnt_empty( s ) );
+    ASSERT( stringm__is_valid( x ), arrayc_char__is_valid( y ) );
 
-    return *( stringm__last_ptr( s ) );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
-char *
-stringm__last_ptr(
-        StringM const s )
+bool
+stringm__equal_arraym(
+        StringM const x,
+        ArrayM_char const y )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringm__is_valid( x ), arraym_char__is_valid( y ) );
 
-    return stringm__is_empty( s )
-               ? NULL
-               : stringm__get_ptr( s, stringm__length( s ) - 1 );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
 bool
-stringm__last_is_null(
-        StringM const s )
+stringm__equal_vec(
+        StringM const x,
+        Vec_char const y )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringm__is_valid( x ), vec_char__is_valid( y ) );
 
-    return stringm__isnt_empty( s ) && stringm__last( s ) == '\0';
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
 bool
-stringm__last_isnt_null(
-        StringM const s )
+stringm__equal_str(
+        StringM const x,
+        char const * const y )
 {
-    ASSERT( stringm__is_valid( s ) );
+    ASSERT( stringm__is_valid( x ), y != NULL );
 
-    return !stringm__last_is_null( s );
+    STRING_TRACE_BEGIN;
+    bool const r = equal( stringc__view( x ), stringc__view( y ) );
+    STRING_TRACE_END( x.length );
+    return r;
 }
 
 
+// Drops the first `n` elements of `s`, moving the rest down.
+static
 void
-stringm__append(
+drop_prefix(
         StringM * const s,
-        char const c )
+        size_t const n )
+{
+    if ( n > 0 ) {
+        memmove( s->e, s->e + n, s->length - n );
+        s->length -= n;
+        keep_null( s );
+    }
+}
+
+
+void
+stringm__trim(
+        StringM * const s )
 {
     ASSERT( s != NULL, stringm__is_valid( *s ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__append( &v, c );
-    *s = stringm__view( v );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    s->length -= space_suffix_length( s->e, s->length );
+    keep_null( s );
+    drop_prefix( s, space_prefix_length( s->e, s->length ) );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__nullterm(
+stringm__trim_left(
         StringM * const s )
 {
     ASSERT( s != NULL, stringm__is_valid( *s ) );
 
-    if ( stringm__last_isnt_null( *s ) ) {
-        stringm__append( s, '\0' );
-    }
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    drop_prefix( s, space_prefix_length( s->e, s->length ) );
+    STRING_TRACE_END( n );
 }
 
 
-char
-stringm__pop(
+void
+stringm__trim_right(
         StringM * const s )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    char const r = vec_char__pop( &v );
-    *s = stringm__view( v );
-    return r;
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    s->length -= space_suffix_length( s->e, s->length );
+    keep_null( s );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__popn(
+stringm__trim_set(
         StringM * const s,
-        size_t const n )
+        StringC const set )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ) );
-
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__popn( &v, n );
-    *s = stringm__view( v );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( set ) );
+
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    s->length -= set_suffix_length( s->e, s->length, set );
+    keep_null( s );
+    drop_prefix( s, set_prefix_length( s->e, s->length, set ) );
+    STRING_TRACE_END( n );
 }
 
 
-bool
-stringm__pop_null(
-        StringM * const s )
+void
+stringm__trim_left_set(
+        StringM * const s,
+        StringC const set )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( set ) );
 
-    if ( stringm__last_is_null( *s ) ) {
-        stringm__pop( s );
-        return true;
-    } else {
-        return false;
-    }
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    drop_prefix( s, set_prefix_length( s->e, s->length, set ) );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__empty(
-        StringM * const s )
+stringm__trim_right_set(
+        StringM * const s,
+        StringC const set )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__isnt_empty( *s ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( set ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__empty( &v );
-    *s = stringm__view( v );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    s->length -= set_suffix_length( s->e, s->length, set );
+    keep_null( s );
+    STRING_TRACE_END( n );
 }
 
 
+// Sets with at most this many bytes are checked for eight bytes at a time
+// when removing or squeezing them, so that words without any can be moved
+// down whole; larger sets are checked a byte at a time.
+#define COMPACT_SWAR_SET_MAX 4
+
+
+// Moves the bytes of `s` that are kept down over those that are dropped,
+// and shortens it to them. The bytes in `set` are dropped, or if `squeeze`
+// is true, only those that repeat the byte before them.
+static
 void
-stringm__extend_stringc(
+compact_set(
         StringM * const s,
-        StringC const ext )
+        StringC const set,
+        bool const squeeze )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( ext ) );
-
-    stringm__extend_arrayc( s, arrayc_char__view_stringc( ext ) );
+    char * const xs = s->e;
+    size_t const n = s->length;
+    ByteSet const bs = byte_set__new( set );
+    size_t i = 0;
+    size_t j = 0;
+    int prev = -1;
+    if ( set.length <= COMPACT_SWAR_SET_MAX ) {
+        for ( ; i + 8 <= n; i += 8 ) {
+            uint64_t const w = swar_load( xs + i );
+            uint64_t m = 0;
+            for ( size_t k = 0; k < set.length; k++ ) {
+                m |= swar_eq( w, ( unsigned char ) set.e[ k ] );
+            }
+            if ( m == 0 ) {
+                prev = ( unsigned char ) xs[ i + 7 ];
+                memcpy( xs + j, &w, sizeof w );
+                j += 8;
+                continue;
+            }
+            for ( size_t k = 0; k < 8; k++ ) {
+                unsigned char const x = ( unsigned char ) xs[ i + k ];
+                xs[ j ] = ( char ) x;
+                j += !( bs.has[ x ] && ( !squeeze || x == prev ) );
+                prev = x;
+            }
+        }
+    }
+    for ( ; i < n; i++ ) {
+        unsigned char const x = ( unsigned char ) xs[ i ];
+        xs[ j ] = ( char ) x;
+        j += !( bs.has[ x ] && ( !squeeze || x == prev ) );
+        prev = x;
+    }
+    s->length = j;
+    keep_null( s );
 }
 
 
 void
-stringm__extend_stringm(
+stringm__remove(
         StringM * const s,
-        StringM const ext )
+        char const el )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), stringm__is_valid( ext ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
 
-    stringm__extend_arrayc( s, arrayc_char__view_stringm( ext ) );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    compact_set( s, stringc__new( &el, 1 ), false );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__extend_arrayc(
+stringm__remove_set(
         StringM * const s,
-        ArrayC_char const ext )
+        StringC const set )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), arrayc_char__is_valid( ext ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( set ) );
 
-    Vec_char v = vec_char__view_stringm( *s );
-    vec_char__extend_arrayc( &v, ext );
-    *s = stringm__view_vec( v );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    compact_set( s, set, false );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__extend_arraym(
+stringm__remove_if(
         StringM * const s,
-        ArrayM_char const ext )
+        bool ( * const f )( char x ) )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), arraym_char__is_valid( ext ) );
-
-    stringm__extend_arrayc( s, arrayc_char__view_arraym( ext ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ), f != NULL );
+
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    size_t j = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        char const x = s->e[ i ];
+        s->e[ j ] = x;
+        j += !f( x );
+    }
+    s->length = j;
+    keep_null( s );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__extend_vec(
+stringm__squeeze(
         StringM * const s,
-        Vec_char const ext )
+        char const el )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), vec_char__is_valid( ext ) );
+    ASSERT( s != NULL, stringm__is_valid( *s ) );
 
-    stringm__extend_arrayc( s, arrayc_char__view_vec( ext ) );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    compact_set( s, stringc__new( &el, 1 ), true );
+    STRING_TRACE_END( n );
 }
 
 
 void
-stringm__extend_str(
+stringm__squeeze_set(
         StringM * const s,
-        char const * const ext )
+        StringC const set )
 {
-    ASSERT( s != NULL, stringm__is_valid( *s ), ext != NULL );
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( set ) );
 
-    stringm__extend_stringc( s, stringc__view( ext ) );
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    compact_set( s, set, true );
+    STRING_TRACE_END( n );
 }
 
 
-bool
-stringm__equal_stringc(
-        StringM const x,
-        StringC const y )
+void
+stringm__replace_by(
+        StringM const xs,
+        char const el,
+        char const repl,
+        bool ( * const eq )( char x, char el ) )
 {
-    ASSERT( stringm__is_valid( x ), stringc__is_valid( y ) );
+    ASSERT( stringm__is_valid( xs ), eq != NULL );
 
-    return stringc__equal( stringc__view( x ), y );
+    STRING_TRACE_BEGIN;
+    arraym_char__replace_by( arraym_char__view_stringm( xs ), el, repl, eq );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__equal_stringm(
-        StringM const x,
-        StringM const y )
+void
+stringm__replace(
+        StringM const xs,
+        char const el,
+        char const repl )
 {
-    ASSERT( stringm__is_valid( x ), stringm__is_valid( y ) );
+    ASSERT( stringm__is_valid( xs ) );
 
-    return stringm__equal( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    arraym_char__replace_by( arraym_char__view_stringm( xs ), el, repl,
+                             char_equal );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__equal_arrayc(
-        StringM const x,
-        ArrayC_char const y )
+void
+stringm__replace_i(
+        StringM const xs,
+        char const el,
+        char const repl )
 {
-    ASSERT( stringm__is_valid( x ), arrayc_char__is_valid( y ) );
+    ASSERT( stringm__is_valid( xs ) );
 
-    return stringm__equal( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    arraym_char__replace_by( arraym_char__view_stringm( xs ), el, repl,
+                             char_equal_i );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__equal_arraym(
-        StringM const x,
-        ArrayM_char const y )
+void
+stringm__replacef(
+        StringM const xs,
+        bool ( * const f )( char x ),
+        char const repl )
 {
-    ASSERT( stringm__is_valid( x ), arraym_char__is_valid( y ) );
+    ASSERT( stringm__is_valid( xs ), f != NULL );
 
-    return stringm__equal( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    arraym_char__replacef( arraym_char__view_stringm( xs ), f, repl );
+    STRING_TRACE_END( xs.length );
 }
 
 
-bool
-stringm__equal_vec(
-        StringM const x,
-        Vec_char const y )
+static
+void
+replace_all(
+        StringM * const s,
+        StringC const needle,
+        StringC const repl )
 {
-    ASSERT( stringm__is_valid( x ), vec_char__is_valid( y ) );
+    size_t const count = count_in( stringc__view( *s ), needle );
+    if ( count == 0 ) { return; }
+    if ( repl.length <= needle.length ) {
+        s->length = replace_all_into( stringc__view( *s ), needle, repl,
+                                      s->e );
+        keep_null( s );
+        return;
+    }
+    // Move the contents up so that they end where the result will, so that
+    // the replacement can be done front-to-back without writing over
+    // anything that's yet to be read:
+    size_t const growth = count * ( repl.length - needle.length );
+    errno = 0;
+    stringm__ensure_capacity( s, s->length + growth );
+    if ( errno ) { return; }
+    memmove( s->e + growth, s->e, s->length );
+    s->length = replace_all_into( stringc__new( s->e + growth, s->length ),
+                                  needle, repl, s->e );
+    keep_null( s );
+}
+
 
-    return stringm__equal( x, stringc__view( y ) );
+void
+stringm__replace_all(
+        StringM * const s,
+        StringC const needle,
+        StringC const repl )
+{
+    ASSERT( s != NULL, stringm__is_valid( *s ), stringc__is_valid( needle ),
+            stringc__isnt_empty( needle ), stringc__is_valid( repl ) );
+
+    STRING_TRACE_BEGIN;
+    size_t const n = s->length;
+    replace_all( s, needle, repl );
+    STRING_TRACE_END( n );
 }
 
 
-bool
-stringm__equal_str(
-        StringM const x,
-        char const * const y )
+void
+stringm__to_lower(
+        StringM const xs )
 {
-    ASSERT( stringm__is_valid( x ), y != NULL );
+    ASSERT( stringm__is_valid( xs ) );
 
-    return stringm__equal( x, stringc__view( y ) );
+    STRING_TRACE_BEGIN;
+    switch_case_into( xs.e, xs.length, xs.e, 'A', 'Z' );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__replace_by(
+stringm__to_upper(
+        StringM const xs )
+{
+    ASSERT( stringm__is_valid( xs ) );
+
+    STRING_TRACE_BEGIN;
+    switch_case_into( xs.e, xs.length, xs.e, 'a', 'z' );
+    STRING_TRACE_END( xs.length );
+}
+
+
+typedef struct replace_job {
+    StringM xs;
+    char el;
+    char repl;
+    bool ( * eq )( char x, char el );
+    bool ( * f )( char x );
+} ReplaceJob;
+
+
+static
+void
+replace_job__run(
+        void * const ctx,
+        size_t const begin,
+        size_t const end )
+{
+    ReplaceJob const * const job = ctx;
+    ArrayM_char const xs = { .e = job->xs.e + begin, .length = end - begin };
+    if ( job->f != NULL ) {
+        arraym_char__replacef( xs, job->f, job->repl );
+    } else {
+        arraym_char__replace_by( xs, job->el, job->repl, job->eq );
+    }
+}
+
+
+void
+stringm__replace_by_parallel(
         StringM const xs,
         char const el,
         char const repl,
-        bool ( * const eq )( char x, char el ) )
+        bool ( * const eq )( char x, char el ),
+        size_t const threads )
 {
     ASSERT( stringm__is_valid( xs ), eq != NULL );
 
-    arraym_char__replace_by( arraym_char__view_stringm( xs ), el, repl, eq );
+    STRING_TRACE_BEGIN;
+    ReplaceJob job = { .xs = xs, .el = el, .repl = repl, .eq = eq };
+    run_chunked( xs.length, STRING_PARALLEL_MIN_CHUNK, threads,
+                 replace_job__run, &job );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__replace(
+stringm__replace_parallel(
         StringM const xs,
         char const el,
-        char const repl )
+        char const repl,
+        size_t const threads )
 {
     ASSERT( stringm__is_valid( xs ) );
 
-    stringm__replace_by( xs, el, repl, char_equal );
+    STRING_TRACE_BEGIN;
+    ReplaceJob job = { .xs = xs, .el = el, .repl = repl, .eq = char_equal };
+    run_chunked( xs.length, STRING_PARALLEL_MIN_CHUNK, threads,
+                 replace_job__run, &job );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__replace_i(
+stringm__replace_i_parallel(
         StringM const xs,
         char const el,
-        char const repl )
+        char const repl,
+        size_t const threads )
 {
     ASSERT( stringm__is_valid( xs ) );
 
-    stringm__replace_by( xs, el, repl, char_equal_i );
+    STRING_TRACE_BEGIN;
+    ReplaceJob job = { .xs = xs, .el = el, .repl = repl, .eq = char_equal_i };
+    run_chunked( xs.length, STRING_PARALLEL_MIN_CHUNK, threads,
+                 replace_job__run, &job );
+    STRING_TRACE_END( xs.length );
 }
 
 
 void
-stringm__replacef(
+stringm__replacef_parallel(
         StringM const xs,
         bool ( * const f )( char x ),
-        char const repl )
+        char const repl,
+        size_t const threads )
 {
     ASSERT( stringm__is_valid( xs ), f != NULL );
 
-    arraym_char__replacef( arraym_char__view_stringm( xs ), f, repl );
+    STRING_TRACE_BEGIN;
+    ReplaceJob job = { .xs = xs, .repl = repl, .f = f };
+    run_chunked( xs.length, STRING_PARALLEL_MIN_CHUNK, threads,
+                 replace_job__run, &job );
+    STRING_TRACE_END( xs.length );
 }
 
 
 
 
 
+static
 char *
-strm__copy_stringc(
+copy_str(
         StringC const s )
 {
-    ASSERT( stringc__is_valid( s ) );
-
     errno = 0;
     if ( stringc__last_is_null( s ) ) {
         char * const str = malloc( s.length );
@@ -1244,13 +4196,29 @@ strm__copy_stringc(
 }
 
 
+char *
+strm__copy_stringc(
+        StringC const s )
+{
+    ASSERT( stringc__is_valid( s ) );
+
+    STRING_TRACE_BEGIN;
+    char * const r = copy_str( s );
+    STRING_TRACE_END( s.length );
+    return r;
+}
+
+
 char *
 strm__copy_stringm(
         StringM const string )
 {
     ASSERT( stringm__is_valid( string ) );
 
-    return strm__copy_stringc( stringc__view_stringm( string ) );
+    STRING_TRACE_BEGIN;
+    char * const r = copy_str( stringc__view_stringm( string ) );
+    STRING_TRACE_END( string.length );
+    return r;
 }
 
 
@@ -30,6 +30,22 @@
 #include "def/string.h"
 
 
+// The least amount of work, in bytes, that a `_parallel` function will hand
+// to a thread of its own.
+#ifndef STRING_PARALLEL_MIN_CHUNK
+#define STRING_PARALLEL_MIN_CHUNK ( 1024 * 1024 )
+#endif
+
+
+// Define `STRING_RESERVE_NULL` when building this library to have every
+// `StringM` that it allocates keep one byte past its elements set to '\0',
+// so that `stringm__cstr()` never has to copy or grow. That byte is counted
+// in `capacity`, and the capacity arguments taken by this library are then
+// the number of elements wanted, not counting it. Strings made by viewing
+// memory allocated elsewhere don't hold that until they're modified or
+// passed to `stringm__terminate()`.
+
+
 
 ///////////////////////////////////
 /// STRINGC FUNCTIONS
@@ -161,6 +177,138 @@ bool stringc__equal_str    ( StringC, char const * str );
         default:     stringc__equal_str \
     )( STRING, X )
 
+// The `_lit` forms of the generic functions take a string literal, whose
+// length is known when compiling, so they don't have to scan it for its
+// null terminator as the `_str` variants do. Any null bytes inside the
+// literal count as elements.
+#define stringc__equal_lit( STRING, LIT ) \
+    stringc__equal_stringc( STRING, ( StringC ) STRINGC( "" LIT ) )
+
+
+// Returns the index of the first occurrence of `needle` in the string at or
+// after `from`, or `SIZE_MAX` if there is none.
+size_t
+stringc__find(
+        StringC,
+        StringC needle,
+        size_t from );
+
+
+// Returns the number of non-overlapping occurrences of `needle` in the
+// string.
+size_t
+stringc__count(
+        StringC,
+        StringC needle );
+
+
+// Returns the number of bytes of the string equal to `c`.
+size_t
+stringc__count_byte(
+        StringC,
+        char c );
+
+
+// Returns the number of lines in the string: the number of newlines, plus
+// one if the string doesn't end with one (and isn't empty).
+size_t
+stringc__count_lines(
+        StringC );
+
+
+// Sets each of the `UCHAR_MAX + 1` elements of `counts` to the number of
+// bytes of the string with that value.
+void
+stringc__byte_histogram(
+        StringC,
+        size_t * counts );
+
+
+// Returns a negative, zero or positive integer as the first string is
+// byte-wise less than, equal to, or greater than the second.
+int
+stringc__compare(
+        StringC,
+        StringC );
+
+
+// Returns the Levenshtein distance between the two strings: the fewest byte
+// insertions, deletions and substitutions that turn one into the other. This
+// takes `O( n * m / 64 )` time for strings of `n` and `m` bytes. If working
+// memory can't be allocated, this sets `errno` and returns `SIZE_MAX`.
+size_t
+stringc__levenshtein(
+        StringC,
+        StringC );
+
+
+// Returns true if the Levenshtein distance between the two strings is at
+// most `k`. This stops as soon as the distance is known to be over `k`, and
+// takes `O( k * n )` time when `k` is small next to the strings' lengths.
+// If working memory can't be allocated, this sets `errno` and returns false.
+bool
+stringc__within_distance(
+        StringC,
+        StringC,
+        size_t k );
+
+
+// Sorts `xs` into byte-wise order with a multikey quicksort over cached key
+// prefixes. If the working memory can't be allocated, this falls back to
+// `qsort`.
+void
+stringc__sort(
+        StringC * xs,
+        size_t n );
+
+
+// Sets `order[ i ]` to the index of the element of `xs` that belongs at index
+// `i` in sorted order, leaving `xs` untouched. Sets `errno` and returns
+// without writing to `order` if the working memory can't be allocated.
+void
+stringc__sort_order(
+        StringC const * xs,
+        size_t n,
+        size_t * order );
+
+
+// Like `stringc__sort()`, but buckets `xs` by their first two bytes and sorts
+// the buckets across at most `threads` threads. Arrays smaller than
+// `STRING_PARALLEL_MIN_CHUNK` bytes are sorted on the calling thread.
+void
+stringc__sort_parallel(
+        StringC * xs,
+        size_t n,
+        size_t threads );
+
+
+// Copies the `n` strings of `xs` into one allocation, and returns it as an
+// array of `n + 1` pointers to them (the last being `NULL`), as `execve()`
+// and `main()` take. The strings follow the array, null-terminated and
+// back-to-back; if `block_length` isn't `NULL`, this sets it to the length
+// of that block. The caller frees everything with one call to `free()`. A
+// string containing a null byte will appear to end there. Sets `errno` and
+// returns `NULL` if the memory can't be allocated.
+char * *
+stringc__copy_argv(
+        StringC const * xs,
+        size_t n,
+        size_t * block_length );
+
+
+// The trimming functions return the view of the given string without any
+// leading and/or trailing ASCII whitespace (or, for the `_set` variants, any
+// leading and/or trailing bytes that are in `set`). The result is always a
+// view into the given string: if every byte is trimmed, it's the empty view
+// at the point where trimming stopped.
+StringC stringc__trim      ( StringC );
+StringC stringc__trim_left ( StringC );
+StringC stringc__trim_right( StringC );
+
+StringC stringc__trim_set      ( StringC, StringC set );
+StringC stringc__trim_left_set ( StringC, StringC set );
+StringC stringc__trim_right_set( StringC, StringC set );
+
 
 StringM
 stringc__replaced_by(
@@ -192,6 +340,30 @@ stringc__replacedf(
 
 
 
+// Returns a copy of `xs` with every non-overlapping occurrence of `needle`
+// replaced by `replacement`, allocated at its exact final length. Sets
+// `errno` and returns an empty string if the copy couldn't be allocated.
+StringM
+stringc__replaced_all(
+        StringC xs,
+        StringC needle,
+        StringC replacement );
+
+
+// Returns a copy of `xs` with its ASCII letters in lowercase (or, for
+// `stringc__uppered()`, in uppercase). Bytes outside ASCII are copied as
+// they are. Sets `errno` and returns an empty string if the copy couldn't
+// be allocated.
+StringM
+stringc__lowered(
+        StringC xs );
+
+
+StringM
+stringc__uppered(
+        StringC xs );
+
+
 ///////////////////////////////////
 /// STRINGM FUNCTIONS
 ///////////////////////////////////
@@ -238,6 +410,17 @@ StringM stringm__view_vec   ( Vec_char );
 StringM stringm__view_strm0( char * str );
 
 
+// Returns a string of the `length` elements of `str`, taking ownership of
+// the buffer, which must have been allocated with `malloc()` (or be `NULL`
+// if `capacity` is zero) and have room for `capacity` elements. Nothing is
+// copied.
+StringM
+stringm__adopt(
+        char * str,
+        size_t length,
+        size_t capacity );
+
+
 StringM stringm__copy_stringc( StringC );
 StringM stringm__copy_stringm( StringM );
 StringM stringm__copy_arrayc ( ArrayC_char );
@@ -255,6 +438,9 @@ StringM stringm__copy_str    ( char const * str );
         default:     stringm__copy_str \
     )( X )
 
+#define stringm__copy_lit( LIT ) \
+    stringm__copy_stringc( ( StringC ) STRINGC( "" LIT ) )
+
 
 void stringm__copy_stringc_into( StringC, StringM * );
 void stringm__copy_stringm_into( StringM, StringM * );
@@ -286,6 +472,34 @@ stringm__into_vec(
         Vec_char * );
 
 
+// Returns the elements of `*s` as a null-terminated string that the caller
+// must `free()`, and leaves `*s` empty with no capacity. The null terminator
+// is written into spare capacity if there is any, and otherwise the buffer
+// grows by one byte; nothing is copied unless `realloc()` has to move it.
+// If it can't grow, this sets `errno`, leaves `*s` as it was, and returns
+// `NULL`.
+char *
+stringm__into_str(
+        StringM * s );
+
+
+// Returns the elements of `s` as a null-terminated string, which stays
+// valid until `s` is next modified. The string must already be terminated:
+// this is always the case when built with `STRING_RESERVE_NULL`, and
+// otherwise only after `stringm__terminate()`.
+char const *
+stringm__cstr(
+        StringM s );
+
+
+// Writes a null byte just past the elements of `*s`, without changing its
+// length, growing the buffer if there's no room. If it can't grow, this sets
+// `errno` and leaves `*s` as it was.
+void
+stringm__terminate(
+        StringM * s );
+
+
 void
 stringm__realloc(
         StringM *,
@@ -464,6 +678,49 @@ void stringm__extend_str    ( StringM *, char const * str );
         default:     stringm__extend_str \
     )( STRING, EXT )
 
+#define stringm__extend_lit( STRING, LIT ) \
+    stringm__extend_stringc( STRING, ( StringC ) STRINGC( "" LIT ) )
+
+
+// The escaping functions append the escaped form of `xs` to the string,
+// growing its capacity at most once. JSON escaping escapes quotes,
+// backslashes and control characters; URL escaping percent-encodes all but
+// the unreserved characters of RFC 3986; HTML escaping replaces `&`, `<`,
+// `>`, `"` and `'` with character references.
+void stringm__extend_json_escaped( StringM *, StringC xs );
+void stringm__extend_url_escaped ( StringM *, StringC xs );
+void stringm__extend_html_escaped( StringM *, StringC xs );
+
+
+// The unescaping functions append the unescaped form of `xs` to the string,
+// growing its capacity at most once. If `xs` contains an invalid escape
+// sequence, they set `errno` to `EINVAL` and leave the string unchanged.
+// HTML unescaping never fails: it leaves unknown references as they are.
+void stringm__extend_json_unescaped( StringM *, StringC xs );
+void stringm__extend_url_unescaped ( StringM *, StringC xs );
+void stringm__extend_html_unescaped( StringM *, StringC xs );
+
+
+// The encoding functions append the encoding of `xs` to the string, growing
+// its capacity at most once. Standard base64 output is padded with `=`;
+// URL-safe base64 output isn't. Hex output is in lowercase.
+void stringm__extend_base64_encoded   ( StringM *, StringC xs );
+void stringm__extend_base64url_encoded( StringM *, StringC xs );
+void stringm__extend_hex_encoded      ( StringM *, StringC xs );
+
+
+// The decoding functions append the decoding of `xs` to the string, growing
+// its capacity at most once, and return the index of the first invalid byte
+// in `xs`, or `xs.length` if it's all valid. If there is an invalid byte,
+// they set `errno` to `EINVAL` and leave the string's contents unchanged.
+// If the string can't grow to fit the decoding, they set `errno` to say
+// why, like `ENOMEM`, and return 0: check `errno` to tell that apart from
+// an invalid first byte. Base64 padding is optional, but must be correct if
+// present.
+size_t stringm__extend_base64_decoded   ( StringM *, StringC xs );
+size_t stringm__extend_base64url_decoded( StringM *, StringC xs );
+size_t stringm__extend_hex_decoded      ( StringM *, StringC xs );
+
 
 bool stringm__equal_stringc( StringM, StringC );
 bool stringm__equal_stringm( StringM, StringM );
@@ -482,6 +739,35 @@ bool stringm__equal_str( StringM, char const * str );
         default:     stringm__equal_str \
     )( STRING, X )
 
+#define stringm__equal_lit( STRING, LIT ) \
+    stringm__equal_stringc( STRING, ( StringC ) STRINGC( "" LIT ) )
+
+
+// Trimming a `StringM` on the right just reduces its length; trimming on the
+// left moves the remaining elements down to the start of the string. To trim
+// without moving anything, trim the `StringC` view of the string instead.
+void stringm__trim      ( StringM * );
+void stringm__trim_left ( StringM * );
+void stringm__trim_right( StringM * );
+
+void stringm__trim_set      ( StringM *, StringC set );
+void stringm__trim_left_set ( StringM *, StringC set );
+void stringm__trim_right_set( StringM *, StringC set );
+
+
+// Removes every occurrence of `element` from the string, or every byte in
+// `set`, or every byte that `f` returns true for, in place: the bytes that
+// are kept are moved down over those that aren't, and the length reduced to
+// match. Words of eight bytes with nothing to remove are moved whole.
+void stringm__remove    ( StringM *, char element );
+void stringm__remove_set( StringM *, StringC set );
+void stringm__remove_if ( StringM *, bool ( * f )( char x ) );
+
+// Squeezing collapses each run of a repeated `element`, or of a repeated
+// byte in `set`, to a single one, in place, as `tr -s` does.
+void stringm__squeeze    ( StringM *, char element );
+void stringm__squeeze_set( StringM *, StringC set );
+
 
 void
 stringm__replace_by(
@@ -512,6 +798,65 @@ stringm__replacef(
         char replacement );
 
 
+// Replaces every non-overlapping occurrence of `needle` in the string with
+// `replacement`, in place. The capacity grows at most once, and only if
+// `replacement` is longer than `needle`.
+void
+stringm__replace_all(
+        StringM *,
+        StringC needle,
+        StringC replacement );
+
+
+// Converts the ASCII letters of the string to lowercase (or uppercase), in
+// place, eight bytes at a time. Bytes outside ASCII are left as they are.
+void
+stringm__to_lower(
+        StringM xs );
+
+
+void
+stringm__to_upper(
+        StringM xs );
+
+
+// The `_parallel` variants split the string into at most `threads` chunks of
+// at least `STRING_PARALLEL_MIN_CHUNK` bytes, and replace each chunk on its
+// own thread. Strings too short to be split are handled on the calling
+// thread, as are chunks whose thread couldn't be started.
+void
+stringm__replace_by_parallel(
+        StringM xs,
+        char element,
+        char replacement,
+        bool ( * eq )( char x, char el ),
+        size_t threads );
+
+
+void
+stringm__replace_parallel(
+        StringM xs,
+        char element,
+        char replacement,
+        size_t threads );
+
+
+void
+stringm__replace_i_parallel(
+        StringM xs,
+        char element,
+        char replacement,
+        size_t threads );
+
+
+void
+stringm__replacef_parallel(
+        StringM xs,
+        bool ( * f )( char x ),
+        char replacement,
+        size_t threads );
+
+
 
 ///////////////////////////////////
 /// EXTENSIONS
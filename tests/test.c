@@ -1,9 +1,25 @@
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 
 #include <libmacro/assert.h>
+#include <libvec/vec-size.h>
 
 #include "../string.h"
+#include "../string-append.h"
+#include "../string-file.h"
+#include "../string-index.h"
+#include "../string-parse.h"
+#include "../string-pool.h"
+#include "../string-regex.h"
+#include "../string-suffix.h"
+#include "../string-symbols.h"
+#include "../string-table.h"
+#include "../string-trace.h"
+#include "keywords/http-method.h"
 
 
 static
@@ -19,6 +35,17 @@ test_properties( void )
             !stringc__equal( hello, world ),
             stringc__equal( hello, mhello ),
             stringc__equal( world, mworld ) );
+
+    ASSERT( stringc__equal_lit( hello, "hello" ),
+            !stringc__equal_lit( hello, "hell" ),
+            stringc__equal_lit( world, "world\0" ),
+            !stringc__equal_lit( world, "world" ),
+            stringm__equal_lit( mhello, "hello" ) );
+    StringM m = stringm__copy_lit( "a\0b" );
+    stringm__extend_lit( &m, "cd" );
+    ASSERT( m.length == 5, memcmp( m.e, "a\0bcd", 5 ) == 0,
+            stringm__equal_lit( m, "a\0bcd" ) );
+    stringm__free( &m );
 }
 
 
@@ -38,6 +65,71 @@ test_nullterm( void )
     ASSERT( foo.length == 4,
             stringm__equal( foo, ( StringC ) STRINGC0( "foo" ) ),
             stringm__last_is_null( foo ) );
+    stringm__free( &foo );
+
+    StringM bar = stringm__new_empty( 0 );
+    ASSERT( strcmp( stringm__cstr( bar ), "" ) == 0 );
+    stringm__extend( &bar, ( StringC ) STRINGC( "bar" ) );
+    stringm__terminate( &bar );
+    ASSERT( bar.length == 3, strcmp( stringm__cstr( bar ), "bar" ) == 0 );
+    stringm__pop( &bar );
+    stringm__terminate( &bar );
+    ASSERT( strcmp( stringm__cstr( bar ), "ba" ) == 0 );
+#ifdef STRING_RESERVE_NULL
+    for ( size_t i = 0; i < 100; i++ ) {
+        stringm__append( &bar, 'x' );
+        ASSERT( bar.length < bar.capacity,
+                strlen( stringm__cstr( bar ) ) == bar.length );
+    }
+    stringm__extend( &bar, ( StringC ) STRINGC( " baz  " ) );
+    stringm__trim_right( &bar );
+    ASSERT( strlen( stringm__cstr( bar ) ) == bar.length,
+            stringm__last( bar ) == 'z' );
+    stringm__free_spare_capacity( &bar );
+    stringm__shrink_capacity_to( &bar, 2 );
+    ASSERT( strcmp( stringm__cstr( bar ), "ba" ) == 0, bar.capacity == 3 );
+#endif
+    stringm__free( &bar );
+}
+
+
+static
+void
+test_ownership( void )
+{
+    StringM a = stringm__new_empty( 8 );
+    stringm__extend( &a, ( StringC ) STRINGC( "foo" ) );
+    char const * const e = a.e;
+    char * const str = stringm__into_str( &a );
+    ASSERT( str == e, strcmp( str, "foo" ) == 0,
+            a.e == NULL, a.length == 0, a.capacity == 0 );
+
+    StringM b = stringm__adopt( str, 3, 8 );
+    ASSERT( b.e == str, stringm__equal( b, "foo" ), b.capacity == 8 );
+    stringm__shrink_capacity( &b );
+    char * const full = stringm__into_str( &b );
+    ASSERT( strcmp( full, "foo" ) == 0, b.e == NULL );
+    free( full );
+
+    StringM empty = stringm__new_empty( 0 );
+    char * const nothing = stringm__into_str( &empty );
+    ASSERT( nothing != NULL, nothing[ 0 ] == '\0' );
+    free( nothing );
+
+    StringC const args[] = { STRINGC( "ls" ), STRINGC( "" ),
+                             STRINGC( "-l" ) };
+    size_t block;
+    char * * const argv = stringc__copy_argv( args, 3, &block );
+    ASSERT( argv != NULL, block == 7,
+            strcmp( argv[ 0 ], "ls" ) == 0,
+            strcmp( argv[ 1 ], "" ) == 0,
+            strcmp( argv[ 2 ], "-l" ) == 0,
+            argv[ 3 ] == NULL,
+            memcmp( argv[ 0 ], "ls\0\0-l", block ) == 0 );
+    free( argv );
+    char * * const none = stringc__copy_argv( NULL, 0, NULL );
+    ASSERT( none != NULL, none[ 0 ] == NULL );
+    free( none );
 }
 
 
@@ -53,11 +145,1313 @@ test_replace( void )
     stringm__free( &al );
     stringm__free( &ali );
 
+    StringC const c = STRINGC( "{{x}} + {{y}} = {{x}}{{y}}" );
+    StringC const x = STRINGC( "{{x}}" );
+    ASSERT( stringc__find( c, x, 0 ) == 0,
+            stringc__find( c, x, 1 ) == 16,
+            stringc__find( c, ( StringC ) STRINGC( "}}{" ), 0 ) == 19,
+            stringc__find( c, ( StringC ) STRINGC( "{{z}}" ), 0 ) == SIZE_MAX,
+            stringc__count( c, x ) == 2,
+            stringc__count( ( StringC ) STRINGC( "aaaaa" ),
+                            ( StringC ) STRINGC( "aa" ) ) == 2 );
+    StringM cr = stringc__replaced_all( c, x, ( StringC ) STRINGC( "1" ) );
+    ASSERT( stringm__equal( cr, "1 + {{y}} = 1{{y}}" ) );
+#ifdef STRING_RESERVE_NULL
+    ASSERT( cr.capacity == cr.length + 1 );
+#else
+    ASSERT( cr.capacity == cr.length );
+#endif
+    stringm__replace_all( &cr, ( StringC ) STRINGC( "{{y}}" ),
+                          ( StringC ) STRINGC( "twenty" ) );
+    ASSERT( stringm__equal( cr, "1 + twenty = 1twenty" ) );
+    stringm__replace_all( &cr, ( StringC ) STRINGC( "twenty" ),
+                          ( StringC ) STRINGC( "" ) );
+    ASSERT( stringm__equal( cr, "1 +  = 1" ) );
+    stringm__free( &cr );
+
     StringM const b = STRINGM( "truthful RUTH" );
     stringm__replace( b, 'u', 'x' );
     ASSERT( stringm__equal( b, "trxthfxl RUTH" ) );
     stringm__replace_i( b, 'H', 'z' );
     ASSERT( stringm__equal( b, "trxtzfxl RUTz" ) );
+
+    size_t const big_len = 4 * STRING_PARALLEL_MIN_CHUNK + 3;
+    StringM big = stringm__new_empty( big_len );
+    for ( size_t i = 0; i < big_len; i++ ) {
+        stringm__append( &big, ( i % 3 == 0 ) ? 'a' : 'B' );
+    }
+    stringm__replace_parallel( big, 'a', 'c', 4 );
+    stringm__replace_i_parallel( big, 'b', 'd', 3 );
+    bool big_ok = true;
+    for ( size_t i = 0; i < big_len; i++ ) {
+        big_ok = big_ok && big.e[ i ] == ( ( i % 3 == 0 ) ? 'c' : 'd' );
+    }
+    ASSERT( big_ok );
+    stringm__free( &big );
+}
+
+
+static
+void
+test_trim( void )
+{
+    StringC const a = STRINGC( " \t\r\n  hello,\vworld\f           \n " );
+    ASSERT( stringc__equal( stringc__trim( a ), "hello,\vworld" ),
+            stringc__trim( a ).e == a.e + 6,
+            stringc__equal( stringc__trim_left( a ),
+                            "hello,\vworld\f           \n " ),
+            stringc__equal( stringc__trim_right( a ),
+                            " \t\r\n  hello,\vworld" ),
+            stringc__is_empty( stringc__trim( ( StringC ) STRINGC( "  " ) ) ),
+            stringc__is_empty( stringc__trim( ( StringC ) STRINGC( "" ) ) ) );
+    // Trimming everything leaves an empty view at the trim point:
+    StringC const blank = STRINGC( " \t " );
+    ASSERT( stringc__trim_left( blank ).e == blank.e + 3,
+            stringc__trim_right( blank ).e == blank.e,
+            stringc__trim_left_set( blank, blank ).e == blank.e + 3,
+            stringc__trim_right_set( blank, blank ).e == blank.e,
+            stringc__is_empty( stringc__trim_left( blank ) ),
+            stringc__is_empty( stringc__trim_right( blank ) ) );
+
+    StringC const set = STRINGC( "-=" );
+    StringC const b = STRINGC( "=-=--title-=-" );
+    ASSERT( stringc__equal( stringc__trim_set( b, set ), "title" ),
+            stringc__equal( stringc__trim_left_set( b, set ), "title-=-" ),
+            stringc__equal( stringc__trim_right_set( b, set ),
+                            "=-=--title" ) );
+
+    StringM m = stringm__copy( a );
+    stringm__trim_right( &m );
+    ASSERT( stringm__equal( m, " \t\r\n  hello,\vworld" ) );
+    stringm__trim( &m );
+    ASSERT( stringm__equal( m, "hello,\vworld" ) );
+    stringm__trim_set( &m, ( StringC ) STRINGC( "hd" ) );
+    ASSERT( stringm__equal( m, "ello,\vworl" ) );
+    stringm__free( &m );
+}
+
+
+static
+bool
+is_control(
+        char const c )
+{
+    return ( unsigned char ) c < ' ' || c == 127;
+}
+
+
+static
+void
+test_remove( void )
+{
+    StringM m = stringm__copy( ( StringC ) STRINGC(
+        "a\tline  with\x01  some\r\n   spaces,,  and\x7F commas,,," ) );
+    stringm__remove_if( &m, is_control );
+    ASSERT( stringm__equal( m,
+                            "aline  with  some   spaces,,  and commas,,," ) );
+    stringm__squeeze( &m, ' ' );
+    ASSERT( stringm__equal( m, "aline with some spaces,, and commas,,," ) );
+    stringm__squeeze_set( &m, ( StringC ) STRINGC( ", " ) );
+    ASSERT( stringm__equal( m, "aline with some spaces, and commas," ) );
+    stringm__remove( &m, 'a' );
+    ASSERT( stringm__equal( m, "line with some spces, nd comms," ) );
+    stringm__remove_set( &m, ( StringC ) STRINGC( "aeiou ," ) );
+    ASSERT( stringm__equal( m, "lnwthsmspcsndcmms" ) );
+    stringm__remove_set( &m, ( StringC ) STRINGC( "lnwthsmpcd" ) );
+    ASSERT( stringm__is_empty( m ) );
+    stringm__squeeze( &m, 'x' );
+    ASSERT( stringm__is_empty( m ) );
+    stringm__free( &m );
+
+    // Compare against removing a byte at a time, over runs that span words:
+    srand( 50 );
+    char xs[ 300 ];
+    char ys[ 300 ];
+    for ( size_t k = 0; k < 200; k++ ) {
+        size_t const n = ( size_t ) rand() % sizeof xs;
+        for ( size_t i = 0; i < n; i++ ) {
+            xs[ i ] = "ab  c,\t"[ rand() % ( 2 + ( int ) ( k % 6 ) ) ];
+        }
+        StringC const set = ( k % 2 ) ? ( StringC ) STRINGC( " \t," )
+                                      : ( StringC ) STRINGC( " abc,\t" );
+        bool const squeeze = k % 3 == 0;
+        size_t j = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            bool const in = memchr( set.e, xs[ i ], set.length ) != NULL;
+            if ( !in || ( squeeze && ( i == 0 || xs[ i - 1 ] != xs[ i ] ) ) ) {
+                ys[ j++ ] = xs[ i ];
+            }
+        }
+        StringM s = stringm__copy( stringc__new( xs, n ) );
+        if ( squeeze ) {
+            stringm__squeeze_set( &s, set );
+        } else {
+            stringm__remove_set( &s, set );
+        }
+        ASSERT( stringm__equal( s, stringc__new( ys, j ) ) );
+        stringm__free( &s );
+    }
+}
+
+
+static
+void
+test_case( void )
+{
+    StringC const a = STRINGC( "Hello, World! [@`{] \xc3\x89t\xc3\xa9 ZAaz" );
+    StringM lo = stringc__lowered( a );
+    StringM up = stringc__uppered( a );
+    ASSERT( stringm__equal( lo,
+                            "hello, world! [@`{] \xc3\x89t\xc3\xa9 zaaz" ),
+            stringm__equal( up,
+                            "HELLO, WORLD! [@`{] \xc3\x89T\xc3\xa9 ZAAZ" ) );
+    stringm__to_upper( lo );
+    ASSERT( stringm__equal( lo, stringc__view( up ) ) );
+    stringm__free( &up );
+    stringm__free( &lo );
+
+    // Check every byte, at every offset into a word:
+    char xs[ 256 + 8 ];
+    for ( size_t i = 0; i < sizeof xs; i++ ) {
+        xs[ i ] = ( char ) ( i % 256 );
+    }
+    for ( size_t offset = 0; offset < 8; offset++ ) {
+        StringC const x = stringc__new( xs + offset, 256 );
+        StringM m = stringm__copy( x );
+        stringm__to_lower( m );
+        for ( size_t i = 0; i < 256; i++ ) {
+            unsigned char const c = ( unsigned char ) x.e[ i ];
+            unsigned char const expected = ( c >= 'A' && c <= 'Z' ) ? c + 32
+                                                                    : c;
+            ASSERT( ( unsigned char ) m.e[ i ] == expected );
+        }
+        stringm__free( &m );
+    }
+
+    StringM e = stringc__lowered( ( StringC ) STRINGC( "" ) );
+    ASSERT( e.length == 0 );
+    stringm__free( &e );
+}
+
+
+static
+void
+test_counting( void )
+{
+    StringC const a = STRINGC( "one\ntwo\n\nthree" );
+    ASSERT( stringc__count_byte( a, '\n' ) == 3,
+            stringc__count_byte( a, 'e' ) == 3,
+            stringc__count_byte( a, 'x' ) == 0,
+            stringc__count_lines( a ) == 4,
+            stringc__count_lines( ( StringC ) STRINGC( "one\ntwo\n" ) ) == 2,
+            stringc__count_lines( ( StringC ) STRINGC( "\n" ) ) == 1,
+            stringc__count_lines( ( StringC ) STRINGC( "" ) ) == 0 );
+
+    // Check against a scan over enough bytes for the per-byte counts to be
+    // summed up several times, and with a tail:
+    size_t const n = 8 * 1000 + 5;
+    char * const xs = malloc( n );
+    srand( 6 );
+    for ( size_t i = 0; i < n; i++ ) {
+        xs[ i ] = ( i < n / 2 ) ? '\xff' : ( char ) ( rand() % 256 );
+    }
+    StringC const x = stringc__new( xs, n );
+    size_t counts[ 256 ];
+    stringc__byte_histogram( x, counts );
+    size_t total = 0;
+    for ( size_t b = 0; b < 256; b++ ) {
+        size_t expected = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            expected += ( unsigned char ) xs[ i ] == b;
+        }
+        ASSERT( counts[ b ] == expected,
+                stringc__count_byte( x, ( char ) b ) == expected );
+        total += counts[ b ];
+    }
+    ASSERT( total == n );
+    free( xs );
+}
+
+
+static
+void
+test_escape( void )
+{
+    StringM s = stringm__new_empty( 0 );
+    stringm__extend_json_escaped( &s, ( StringC ) STRINGC(
+        "say \"hi\"\\\n\x01 to caf\xc3\xa9" ) );
+    ASSERT( stringm__equal( s,
+                "say \\\"hi\\\"\\\\\\n\\u0001 to caf\xc3\xa9" ) );
+    StringM t = stringm__new_empty( 0 );
+    stringm__extend_json_unescaped( &t, stringc__view( s ) );
+    ASSERT( stringm__equal( t, "say \"hi\"\\\n\x01 to caf\xc3\xa9" ) );
+    stringm__empty( &t );
+    stringm__extend_json_unescaped( &t, ( StringC ) STRINGC(
+        "\\u00e9\\u20AC\\ud83d\\ude00\\/" ) );
+    ASSERT( stringm__equal( t, "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80/" ) );
+    size_t const len = t.length;
+    stringm__extend_json_unescaped( &t, ( StringC ) STRINGC( "ok\\ud83d" ) );
+    ASSERT( errno == EINVAL, t.length == len );
+    stringm__extend_json_unescaped( &t, ( StringC ) STRINGC( "ok\\q" ) );
+    ASSERT( errno == EINVAL, t.length == len );
+
+    stringm__empty( &s );
+    stringm__extend_url_escaped( &s, ( StringC ) STRINGC(
+        "a b&c=d/~e_f.g-h\xff" ) );
+    ASSERT( stringm__equal( s, "a%20b%26c%3Dd%2F~e_f.g-h%FF" ) );
+    stringm__empty( &t );
+    stringm__extend_url_unescaped( &t, stringc__view( s ) );
+    ASSERT( stringm__equal( t, "a b&c=d/~e_f.g-h\xff" ) );
+    stringm__extend_url_unescaped( &t, ( StringC ) STRINGC( "%4" ) );
+    ASSERT( errno == EINVAL );
+
+    stringm__empty( &s );
+    stringm__extend_html_escaped( &s, ( StringC ) STRINGC(
+        "<a href=\"x\">Tom & Jerry's</a>" ) );
+    ASSERT( stringm__equal( s, "&lt;a href=&quot;x&quot;&gt;"
+                               "Tom &amp; Jerry&#39;s&lt;/a&gt;" ) );
+    stringm__empty( &t );
+    stringm__extend_html_unescaped( &t, stringc__view( s ) );
+    ASSERT( stringm__equal( t, "<a href=\"x\">Tom & Jerry's</a>" ) );
+    stringm__empty( &t );
+    stringm__extend_html_unescaped( &t, ( StringC ) STRINGC(
+        "&#233;&#x20ac;&apos;&bogus; & &#;&#xD800;" ) );
+    ASSERT( stringm__equal( t, "\xc3\xa9\xe2\x82\xac'&bogus; & &#;&#xD800;" ) );
+    stringm__free( &s );
+    stringm__free( &t );
+}
+
+
+static
+void
+test_base64_hex( void )
+{
+    StringM s = stringm__new_empty( 0 );
+    stringm__extend_base64_encoded( &s, ( StringC ) STRINGC( "Ma" ) );
+    stringm__extend_base64_encoded( &s, ( StringC ) STRINGC( "Man" ) );
+    stringm__extend_base64_encoded( &s, ( StringC ) STRINGC( "M" ) );
+    ASSERT( stringm__equal( s, "TWE=TWFuTQ==" ) );
+    stringm__empty( &s );
+    stringm__extend_base64url_encoded( &s, ( StringC ) STRINGC( "\xfb\xff" ) );
+    ASSERT( stringm__equal( s, "-_8" ) );
+    stringm__empty( &s );
+    stringm__extend_hex_encoded( &s, ( StringC ) STRINGC( "\x00\xab\x7f" ) );
+    ASSERT( stringm__equal( s, "00ab7f" ) );
+
+    StringM t = stringm__new_empty( 0 );
+    StringC const b64 = STRINGC( "aGVsbG8sIHdvcmxkIQ==" );
+    ASSERT( stringm__extend_base64_decoded( &t, b64 ) == b64.length,
+            stringm__equal( t, "hello, world!" ) );
+    stringm__empty( &t );
+    ASSERT( stringm__extend_base64url_decoded( &t,
+                ( StringC ) STRINGC( "-_8" ) ) == 3,
+            stringm__equal( t, "\xfb\xff" ) );
+    size_t const len = t.length;
+    ASSERT( stringm__extend_base64_decoded( &t,
+                ( StringC ) STRINGC( "aGVs*G8=" ) ) == 4,
+            errno == EINVAL, t.length == len );
+    ASSERT( stringm__extend_base64_decoded( &t,
+                ( StringC ) STRINGC( "aGVsb" ) ) == 4, errno == EINVAL );
+    ASSERT( stringm__extend_base64_decoded( &t,
+                ( StringC ) STRINGC( "aG=" ) ) == 2, errno == EINVAL );
+    ASSERT( stringm__extend_base64url_decoded( &t,
+                ( StringC ) STRINGC( "ab+/" ) ) == 2, errno == EINVAL );
+    ASSERT( stringm__extend_hex_decoded( &t,
+                ( StringC ) STRINGC( "00AB7f" ) ) == 6,
+            stringm__equal( t, ( StringC )
+                                   STRINGC( "\xfb\xff\x00\xab\x7f" ) ) );
+    ASSERT( stringm__extend_hex_decoded( &t,
+                ( StringC ) STRINGC( "00g1" ) ) == 2, errno == EINVAL );
+    ASSERT( stringm__extend_hex_decoded( &t,
+                ( StringC ) STRINGC( "001" ) ) == 2, errno == EINVAL,
+            t.length == len + 3 );
+#ifdef STRING_RESERVE_NULL
+    // Failed decodes keep the reserved null, though they write past it:
+    stringm__empty( &s );
+    stringm__extend( &s, ( StringC ) STRINGC( "ab" ) );
+    ASSERT( stringm__extend_base64_decoded( &s,
+                ( StringC ) STRINGC( "QUJDREVGR0hJ!!!!" ) ) == 12,
+            errno == EINVAL, strcmp( stringm__cstr( s ), "ab" ) == 0,
+            stringm__extend_hex_decoded( &s,
+                ( StringC ) STRINGC( "4142434g" ) ) == 7,
+            errno == EINVAL, strcmp( stringm__cstr( s ), "ab" ) == 0,
+            stringm__extend_hex_decoded( &s,
+                ( StringC ) STRINGC( "414243444" ) ) == 8,
+            errno == EINVAL, strcmp( stringm__cstr( s ), "ab" ) == 0 );
+#endif
+    stringm__free( &s );
+    stringm__free( &t );
+}
+
+
+static
+bool
+is_sorted(
+        StringC const * const xs,
+        size_t const n )
+{
+    for ( size_t i = 1; i < n; i++ ) {
+        if ( stringc__compare( xs[ i - 1 ], xs[ i ] ) > 0 ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static
+void
+test_sort( void )
+{
+    ASSERT( stringc__compare( ( StringC ) STRINGC( "ab" ),
+                              ( StringC ) STRINGC( "abc" ) ) < 0,
+            stringc__compare( ( StringC ) STRINGC0( "ab" ),
+                              ( StringC ) STRINGC( "ab" ) ) > 0,
+            stringc__compare( ( StringC ) STRINGC( "b" ),
+                              ( StringC ) STRINGC( "abc" ) ) > 0,
+            stringc__compare( ( StringC ) STRINGC( "" ),
+                              ( StringC ) STRINGC( "" ) ) == 0 );
+
+    StringC words[] = {
+        STRINGC( "pneumonoultramicroscopic" ), STRINGC( "pneumonia" ),
+        STRINGC( "pneumonoultra" ), STRINGC( "" ), STRINGC0( "pneu" ),
+        STRINGC( "pneu" ), STRINGC( "zebra" ), STRINGC( "pneumonoultra" )
+    };
+    size_t const nwords = sizeof words / sizeof words[ 0 ];
+    size_t order[ sizeof words / sizeof words[ 0 ] ];
+    stringc__sort_order( words, nwords, order );
+    ASSERT( order[ 0 ] == 3, order[ 1 ] == 5, order[ 2 ] == 4,
+            order[ nwords - 1 ] == 6 );
+    stringc__sort( words, nwords );
+    ASSERT( is_sorted( words, nwords ),
+            stringc__equal( words[ 3 ], "pneumonia" ),
+            stringc__equal( words[ 6 ], "pneumonoultramicroscopic" ) );
+
+    size_t const n = 2 * STRING_PARALLEL_MIN_CHUNK / sizeof ( StringC );
+    static char const alphabet[] = "aab\xff";
+    char * const pool = malloc( n * 12 );
+    StringC * const xs = malloc( n * sizeof *xs );
+    srand( 1 );
+    for ( size_t i = 0; i < n; i++ ) {
+        size_t const len = rand() % 12;
+        for ( size_t j = 0; j < len; j++ ) {
+            pool[ i * 12 + j ] = alphabet[ rand() % 4 ];
+        }
+        xs[ i ] = stringc__new( pool + i * 12, len );
+    }
+    stringc__sort_parallel( xs, n, 4 );
+    ASSERT( is_sorted( xs, n ) );
+
+    // The prefixes of a long run of one byte, shuffled, share long runs of
+    // equal keys, and sort by length:
+    size_t const m = 4096;
+    memset( pool, 'a', m );
+    for ( size_t i = 0; i < m; i++ ) {
+        xs[ i ] = stringc__new( pool, i );
+    }
+    for ( size_t i = m - 1; i > 0; i-- ) {
+        size_t const j = ( size_t ) rand() % ( i + 1 );
+        StringC const x = xs[ i ];
+        xs[ i ] = xs[ j ];
+        xs[ j ] = x;
+    }
+    stringc__sort( xs, m );
+    for ( size_t i = 0; i < m; i++ ) {
+        ASSERT( xs[ i ].length == i );
+    }
+    free( xs );
+    free( pool );
+}
+
+
+static
+size_t
+naive_distance(
+        StringC const a,
+        StringC const b )
+{
+    size_t * const row = malloc( ( b.length + 1 ) * sizeof *row );
+    for ( size_t j = 0; j <= b.length; j++ ) {
+        row[ j ] = j;
+    }
+    for ( size_t i = 1; i <= a.length; i++ ) {
+        size_t diag = row[ 0 ];
+        row[ 0 ] = i;
+        for ( size_t j = 1; j <= b.length; j++ ) {
+            size_t const up = row[ j ];
+            size_t v = diag + ( a.e[ i - 1 ] != b.e[ j - 1 ] );
+            v = ( up + 1 < v ) ? up + 1 : v;
+            v = ( row[ j - 1 ] + 1 < v ) ? row[ j - 1 ] + 1 : v;
+            row[ j ] = v;
+            diag = up;
+        }
+    }
+    size_t const d = row[ b.length ];
+    free( row );
+    return d;
+}
+
+
+static
+void
+test_distance( void )
+{
+    StringC const kitten = STRINGC( "kitten" );
+    StringC const sitting = STRINGC( "sitting" );
+    ASSERT( stringc__levenshtein( kitten, sitting ) == 3,
+            stringc__levenshtein( sitting, kitten ) == 3,
+            stringc__levenshtein( kitten, kitten ) == 0,
+            stringc__levenshtein( kitten, ( StringC ) STRINGC( "" ) ) == 6,
+            stringc__within_distance( kitten, sitting, 3 ),
+            !stringc__within_distance( kitten, sitting, 2 ),
+            stringc__within_distance( ( StringC ) STRINGC( "" ),
+                                      ( StringC ) STRINGC( "" ), 0 ) );
+
+    // Random strings over a small alphabet, long enough to need several
+    // words of bit-vectors, with some of them near-copies of each other:
+    static char const alphabet[] = "acgt";
+    char a[ 300 ];
+    char b[ 300 ];
+    srand( 2 );
+    for ( size_t n = 0; n < 300; n++ ) {
+        size_t const alen = rand() % 300;
+        for ( size_t i = 0; i < alen; i++ ) {
+            a[ i ] = alphabet[ rand() % 4 ];
+        }
+        size_t blen = 0;
+        for ( size_t i = 0; i < alen && blen < 300; i++ ) {
+            int const r = rand() % 20;
+            if ( r == 0 ) {
+                continue;
+            } else if ( r == 1 && blen < 299 ) {
+                b[ blen++ ] = alphabet[ rand() % 4 ];
+            }
+            b[ blen++ ] = ( r == 2 ) ? alphabet[ rand() % 4 ] : a[ i ];
+        }
+        if ( n % 4 == 0 ) {
+            blen = rand() % 300;
+            for ( size_t i = 0; i < blen; i++ ) {
+                b[ i ] = alphabet[ rand() % 4 ];
+            }
+        }
+        StringC const x = stringc__new( a, alen );
+        StringC const y = stringc__new( b, blen );
+        size_t const d = naive_distance( x, y );
+        size_t const k = rand() % ( d + 2 );
+        ASSERT( stringc__levenshtein( x, y ) == d,
+                stringc__within_distance( x, y, d ),
+                stringc__within_distance( x, y, k ) == ( d <= k ),
+                IMPLIES( d > 0, !stringc__within_distance( x, y, d - 1 ) ) );
+    }
+}
+
+
+static
+bool
+is_short(
+        StringC const s )
+{
+    return s.length < 4;
+}
+
+
+static
+void
+test_table( void )
+{
+    StringTable t = stringtable__new_empty( 0, 0 );
+    stringtable__append( &t, ( StringC ) STRINGC( "pear" ) );
+    StringC const more[] = { STRINGC( "fig" ), STRINGC( "" ),
+                             STRINGC( "apple" ), STRINGC( "banana" ) };
+    stringtable__extend( &t, more, 4 );
+    ASSERT( stringtable__length( t ) == 5,
+            stringc__equal( stringtable__get( t, 0 ), "pear" ),
+            stringc__equal( stringtable__get( t, 1 ), "fig" ),
+            stringc__equal( stringtable__get( t, 2 ), "" ),
+            stringc__equal( stringtable__get( t, 4 ), "banana" ),
+            stringc__equal( stringtable__blob( t ), "pearfigapplebanana" ) );
+#ifdef STRING_RESERVE_NULL
+    ASSERT( strcmp( stringm__cstr( t.blob ), "pearfigapplebanana" ) == 0 );
+#endif
+    stringtable__sort( &t );
+    ASSERT( stringtable__length( t ) == 5,
+            stringc__equal( stringtable__get( t, 0 ), "" ),
+            stringc__equal( stringtable__get( t, 1 ), "apple" ),
+            stringc__equal( stringtable__get( t, 2 ), "banana" ),
+            stringc__equal( stringtable__get( t, 3 ), "fig" ),
+            stringc__equal( stringtable__get( t, 4 ), "pear" ) );
+#ifdef STRING_RESERVE_NULL
+    ASSERT( strcmp( stringm__cstr( t.blob ), "applebananafigpear" ) == 0 );
+#endif
+    stringtable__compact( &t, is_short );
+    ASSERT( stringtable__length( t ) == 2,
+            stringc__equal( stringtable__get( t, 0 ), "" ),
+            stringc__equal( stringtable__get( t, 1 ), "fig" ) );
+#ifdef STRING_RESERVE_NULL
+    ASSERT( t.blob.capacity == 4,
+            strcmp( stringm__cstr( t.blob ), "fig" ) == 0 );
+#else
+    ASSERT( t.blob.capacity == 3 );
+#endif
+    stringtable__free( &t );
+}
+
+
+static
+StringRegex *
+regex(
+        char const * const pattern )
+{
+    StringRegex * const re = stringregex__new( stringc__view_str( pattern ),
+                                               NULL );
+    ASSERT( re != NULL );
+    return re;
+}
+
+
+static
+bool
+finds(
+        char const * const pattern,
+        char const * const str,
+        char const * const expected )
+{
+    StringRegex * const re = regex( pattern );
+    StringC found;
+    bool const r = stringregex__find( re, stringc__view_str( str ), 0,
+                                      &found );
+    stringregex__free( re );
+    return ( expected == NULL ) ? !r
+                                : ( r && stringc__equal( found, expected ) );
+}
+
+
+static
+void
+test_index( void )
+{
+    StringC const words[] = {
+        STRINGC( "banana" ), STRINGC( "bandana" ), STRINGC( "ban" ),
+        STRINGC( "an" ), STRINGC( "cabana" ), STRINGC( "" ),
+        STRINGC( "bandanna" )
+    };
+    StringIndex * const idx = stringindex__new( words, 7 );
+    ASSERT( idx != NULL, stringindex__length( idx ) == 7,
+            stringc__equal( stringindex__get( idx, 4 ), "cabana" ) );
+    Vec_size ids = vec_size__new_empty( 0 );
+    stringindex__containing( idx, ( StringC ) STRINGC( "ana" ), &ids );
+    ASSERT( ids.length == 3, ids.e[ 0 ] == 0, ids.e[ 1 ] == 1,
+            ids.e[ 2 ] == 4 );
+    vec_size__empty( &ids );
+    stringindex__containing( idx, ( StringC ) STRINGC( "an" ), &ids );
+    ASSERT( ids.length == 6 );
+    vec_size__empty( &ids );
+    stringindex__containing( idx, ( StringC ) STRINGC( "nanab" ), &ids );
+    ASSERT( ids.length == 0 );
+    stringindex__within_distance( idx, ( StringC ) STRINGC( "bandanna" ), 1,
+                                  &ids );
+    ASSERT( ids.length == 2, ids.e[ 0 ] == 1, ids.e[ 1 ] == 6 );
+    stringindex__free( idx );
+
+    // Check queries against every string by hand, over random strings of a
+    // small alphabet so that they share plenty of trigrams:
+    size_t const n = 2000;
+    char * const pool = malloc( n * 16 );
+    StringC * const xs = malloc( n * sizeof *xs );
+    srand( 3 );
+    for ( size_t i = 0; i < n; i++ ) {
+        size_t const len = rand() % 16;
+        for ( size_t j = 0; j < len; j++ ) {
+            pool[ i * 16 + j ] = "abcd"[ rand() % 4 ];
+        }
+        xs[ i ] = stringc__new( pool + i * 16, len );
+    }
+    StringIndex * const big = stringindex__new( xs, n );
+    ASSERT( big != NULL );
+    for ( size_t q = 0; q < 200; q++ ) {
+        StringC const x = xs[ rand() % n ];
+        size_t const from = ( x.length == 0 ) ? 0 : rand() % x.length;
+        size_t const rest = x.length - from;
+        StringC const needle = stringc__new( x.e + from, ( q % 2 == 0 )
+                                   ? rest : ( rest < 4 ) ? rest : 4 );
+        size_t const k = rand() % 3;
+        vec_size__empty( &ids );
+        stringindex__containing( big, needle, &ids );
+        size_t found = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            if ( needle.length == 0
+              || stringc__find( xs[ i ], needle, 0 ) != SIZE_MAX ) {
+                ASSERT( found < ids.length, ids.e[ found ] == i );
+                found++;
+            }
+        }
+        ASSERT( found == ids.length );
+        vec_size__empty( &ids );
+        stringindex__within_distance( big, x, k, &ids );
+        found = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            if ( stringc__levenshtein( xs[ i ], x ) <= k ) {
+                ASSERT( found < ids.length, ids.e[ found ] == i );
+                found++;
+            }
+        }
+        ASSERT( found == ids.length );
+    }
+    stringindex__free( big );
+    vec_size__free( &ids );
+    free( xs );
+    free( pool );
+}
+
+
+static
+int
+compare_positions(
+        void const * const x,
+        void const * const y )
+{
+    size_t const a = *( size_t const * ) x;
+    size_t const b = *( size_t const * ) y;
+    return ( a > b ) - ( a < b );
+}
+
+
+static
+void
+test_suffix( void )
+{
+    StringC const banana = STRINGC( "banana" );
+    StringSuffixArray * const sa = stringsuffixarray__new( banana );
+    StringFMIndex * const fm = stringfmindex__new( sa, 2 );
+    ASSERT( sa != NULL, fm != NULL, stringfmindex__length( fm ) == 6 );
+    size_t positions[ 8 ];
+    ASSERT( stringsuffixarray__locate( sa, ( StringC ) STRINGC( "ana" ),
+                                       positions, 8 ) == 2,
+            positions[ 0 ] == 3, positions[ 1 ] == 1,
+            stringfmindex__locate( fm, ( StringC ) STRINGC( "ana" ),
+                                   positions, 1 ) == 2,
+            positions[ 0 ] == 3,
+            stringsuffixarray__count( sa, ( StringC ) STRINGC( "a" ) ) == 3,
+            stringfmindex__count( fm, ( StringC ) STRINGC( "a" ) ) == 3,
+            stringfmindex__count( fm, ( StringC ) STRINGC( "nab" ) ) == 0,
+            stringfmindex__count( fm, ( StringC ) STRINGC( "x" ) ) == 0,
+            stringfmindex__count( fm, ( StringC ) STRINGC( "bananas" ) )
+                == 0 );
+    stringfmindex__free( fm );
+    stringsuffixarray__free( sa );
+
+    StringSuffixArray * const esa = stringsuffixarray__new(
+                                        ( StringC ) STRINGC( "" ) );
+    StringFMIndex * const efm = stringfmindex__new( esa, 4 );
+    ASSERT( stringsuffixarray__count( esa, banana ) == 0,
+            stringfmindex__count( efm, banana ) == 0 );
+    stringfmindex__free( efm );
+    stringsuffixarray__free( esa );
+
+    // Check random patterns against a scan of random texts, some of them
+    // highly repetitive:
+    size_t const n = 5000;
+    char * const text = malloc( n );
+    size_t * const found = malloc( n * sizeof *found );
+    size_t * const expected = malloc( n * sizeof *expected );
+    srand( 4 );
+    for ( size_t t = 0; t < 4; t++ ) {
+        size_t const len = ( t == 0 ) ? 1 : n / ( 4 - t );
+        for ( size_t i = 0; i < len; i++ ) {
+            text[ i ] = ( t == 3 ) ? "ab"[ ( i % 7 ) != 0 ]
+                                   : "abcd\xff"[ rand() % ( 2 + t ) ];
+        }
+        StringC const s = stringc__new( text, len );
+        StringSuffixArray * const tsa = stringsuffixarray__new( s );
+        StringFMIndex * const tfm = stringfmindex__new( tsa, 1 + t * 3 );
+        ASSERT( tsa != NULL, tfm != NULL );
+        for ( size_t q = 0; q < 100; q++ ) {
+            size_t const from = rand() % len;
+            size_t const rest = len - from;
+            size_t const plen = 1 + rand() % ( ( rest < 8 ) ? rest : 8 );
+            StringC const p = stringc__new( text + from, plen );
+            size_t count = 0;
+            for ( size_t i = 0; i + plen <= len; i++ ) {
+                if ( memcmp( text + i, p.e, plen ) == 0 ) {
+                    expected[ count++ ] = i;
+                }
+            }
+            ASSERT( stringsuffixarray__count( tsa, p ) == count,
+                    stringfmindex__count( tfm, p ) == count );
+            ASSERT( stringsuffixarray__locate( tsa, p, found, n ) == count );
+            qsort( found, count, sizeof *found, compare_positions );
+            ASSERT( memcmp( found, expected, count * sizeof *found ) == 0 );
+            ASSERT( stringfmindex__locate( tfm, p, found, n ) == count );
+            qsort( found, count, sizeof *found, compare_positions );
+            ASSERT( memcmp( found, expected, count * sizeof *found ) == 0 );
+        }
+        stringfmindex__free( tfm );
+        stringsuffixarray__free( tsa );
+    }
+    free( expected );
+    free( found );
+    free( text );
+}
+
+
+static
+void
+test_symbols( void )
+{
+    // Train on URL-like strings, and check that they all round-trip:
+    size_t const n = 2000;
+    char ( * const urls )[ 64 ] = malloc( n * sizeof *urls );
+    StringC * const xs = malloc( n * sizeof *xs );
+    char const * const hosts[] = { "example.com", "libstring.org", "a.io" };
+    srand( 5 );
+    for ( size_t i = 0; i < n; i++ ) {
+        int const len = snprintf( urls[ i ], sizeof urls[ i ],
+                                  "https://www.%s/items/%d?page=%d",
+                                  hosts[ rand() % 3 ], rand() % 100000,
+                                  rand() % 10 );
+        xs[ i ] = stringc__new( urls[ i ], ( size_t ) len );
+    }
+    StringSymbolTable * const t = stringsymboltable__train( xs, n );
+    ASSERT( t != NULL );
+    StringM c = stringm__new_empty( 0 );
+    StringM d = stringm__new_empty( 0 );
+    size_t plain = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        c.length = 0;
+        d.length = 0;
+        errno = 0;
+        stringsymboltable__compress( t, xs[ i ], &c );
+        ASSERT( errno == 0 );
+        StringC const cc = stringc__view( c );
+        stringsymboltable__decompress( t, cc, &d );
+        ASSERT( errno == 0, c.length <= 2 * xs[ i ].length,
+                stringc__equal( stringc__view( d ), xs[ i ] ),
+                stringsymboltable__decompressed_length( t, cc )
+                    == xs[ i ].length,
+                stringsymboltable__equal( t, cc, xs[ i ] ),
+                !stringsymboltable__equal( t, cc, xs[ ( i + 1 ) % n ] )
+                || stringc__equal( xs[ i ], xs[ ( i + 1 ) % n ] ),
+                !stringsymboltable__equal(
+                    t, cc, stringc__new( xs[ i ].e, xs[ i ].length - 1 ) ) );
+        plain += xs[ i ].length;
+    }
+
+    // Compressing all of them appends, and compresses well:
+    StringM all = stringm__new_empty( 0 );
+    for ( size_t i = 0; i < n; i++ ) {
+        stringsymboltable__compress( t, xs[ i ], &all );
+    }
+    ASSERT( all.length * 2 < plain );
+    stringm__free( &all );
+
+    // Equal strings compress to equal forms:
+    StringM c2 = stringm__new_empty( 0 );
+    c.length = 0;
+    stringsymboltable__compress( t, xs[ n - 1 ], &c );
+    stringsymboltable__compress( t, stringc__view( d ), &c2 );
+    ASSERT( stringc__equal( stringc__view( c ), stringc__view( c2 ) ) );
+
+    // Decompressing into a buffer truncates, but gives the full length:
+    stringm__empty( &c );
+    stringsymboltable__compress( t, xs[ 0 ], &c );
+    char buf[ 64 ];
+    for ( size_t size = 0; size <= xs[ 0 ].length; size++ ) {
+        memset( buf, '#', sizeof buf );
+        ASSERT( stringsymboltable__decompress_into(
+                    t, stringc__view( c ), buf, size ) == xs[ 0 ].length,
+                memcmp( buf, xs[ 0 ].e, size ) == 0, buf[ size ] == '#' );
+    }
+
+    // Bytes the table hasn't seen are escaped:
+    stringm__empty( &c );
+    StringC const odd = STRINGC( "\xff\x01~" );
+    stringsymboltable__compress( t, odd, &c );
+    ASSERT( c.length == 6 );
+    stringm__empty( &d );
+    stringsymboltable__decompress( t, stringc__view( c ), &d );
+    ASSERT( stringc__equal( stringc__view( d ), odd ) );
+    stringm__free( &c2 );
+    stringm__free( &d );
+    stringm__free( &c );
+    stringsymboltable__free( t );
+
+    // A table trained on nothing escapes every byte:
+    StringSymbolTable * const e = stringsymboltable__train( NULL, 0 );
+    StringM ec = stringm__new_empty( 0 );
+    stringsymboltable__compress( e, ( StringC ) STRINGC( "" ), &ec );
+    ASSERT( e != NULL, ec.length == 0 );
+    stringsymboltable__compress( e, ( StringC ) STRINGC( "ab" ), &ec );
+    ASSERT( ec.length == 4,
+            stringsymboltable__equal( e, stringc__view( ec ),
+                                      ( StringC ) STRINGC( "ab" ) ) );
+    stringm__free( &ec );
+    stringsymboltable__free( e );
+    free( xs );
+    free( urls );
+}
+
+
+static
+void
+test_regex( void )
+{
+    ASSERT( finds( "b+", "abbbc", "bbb" ),
+            finds( "b+?", "abbbc", "b" ),
+            finds( "a|ab", "xab", "a" ),
+            finds( "(?:ab|a)c", "xabc", "abc" ),
+            finds( "x*", "abc", "" ),
+            finds( "^a", "ba", NULL ),
+            finds( "a$", "aba", "a" ),
+            finds( "c$|b", "abc", "b" ),
+            finds( "[^a-c]\\d{2,3}", "ad12345", "d123" ),
+            finds( "\\w+@\\w+\\.com", "to: bob@example.com;",
+                   "bob@example.com" ),
+            finds( "needle[0-9]", "needle needle7", "needle7" ),
+            finds( "\\x41.B", "zA\nB AxB", "AxB" ) );
+
+    StringRegex * const re = regex( "(\\d+)-(\\d+)?(x)?" );
+    StringC const text = STRINGC( "ab 12-34 5-" );
+    StringC g[ 4 ];
+    ASSERT( stringregex__groups( re ) == 3,
+            stringregex__captures( re, text, 0, g ),
+            stringc__equal( g[ 0 ], "12-34" ),
+            stringc__equal( g[ 1 ], "12" ),
+            stringc__equal( g[ 2 ], "34" ),
+            g[ 3 ].e == NULL,
+            stringregex__captures( re, text, 8, g ),
+            stringc__equal( g[ 0 ], "5-" ),
+            g[ 2 ].e == NULL,
+            !stringregex__find( re, text, 10, NULL ),
+            !stringregex__match( re, text ),
+            stringregex__match( re, ( StringC ) STRINGC( "1-2x" ) ) );
+    stringregex__free( re );
+
+    StringRegex * const alt = regex( "a|ab" );
+    ASSERT( stringregex__match( alt, ( StringC ) STRINGC( "ab" ) ),
+            !stringregex__match( alt, ( StringC ) STRINGC( "abb" ) ) );
+    stringregex__free( alt );
+
+    size_t index = 0;
+    errno = 0;
+    ASSERT( stringregex__new( ( StringC ) STRINGC( "ab(c|d" ), &index )
+                == NULL,
+            errno == EINVAL, index == 2 );
+    errno = 0;
+    ASSERT( stringregex__new( ( StringC ) STRINGC( "a{3,2}" ), &index )
+                == NULL,
+            errno == EINVAL, index == 1 );
+    errno = 0;
+    ASSERT( stringregex__new( ( StringC ) STRINGC( "a)" ), &index ) == NULL,
+            errno == EINVAL, index == 1 );
+}
+
+
+static
+void
+test_keywords( void )
+{
+    for ( int i = 0; i < HTTP_METHOD_COUNT; i++ ) {
+        ASSERT( http_method__lookup( http_method__names[ i ] ) == i );
+    }
+    ASSERT( http_method__lookup( ( StringC ) STRINGC( "PATCH" ) )
+                == HTTP_METHOD_PATCH,
+            http_method__lookup( ( StringC ) STRINGC( "DELETE" ) )
+                == HTTP_METHOD_DELETE,
+            http_method__lookup( ( StringC ) STRINGC( "get" ) ) == -1,
+            http_method__lookup( ( StringC ) STRINGC( "GETS" ) ) == -1,
+            http_method__lookup( ( StringC ) STRINGC( "POS" ) ) == -1,
+            http_method__lookup( ( StringC ) STRINGC( "" ) ) == -1 );
+}
+
+
+static
+void
+test_file( void )
+{
+    char const * const path = "string-file-test.tmp";
+    size_t const n = 2 * STRING_PARALLEL_MIN_CHUNK + 3;
+    char * const xs = malloc( n );
+    for ( size_t i = 0; i < n; i++ ) {
+        xs[ i ] = ( char ) ( i * 7 + i / 251 );
+    }
+    FILE * const f = fopen( path, "wb" );
+    ASSERT( f != NULL, fwrite( xs, 1, n, f ) == n, fclose( f ) == 0 );
+
+    for ( size_t threads = 1; threads <= 4; threads += 3 ) {
+        StringM s = stringm__copy( ( StringC ) STRINGC( "head" ) );
+        errno = 0;
+        stringm__read_file_parallel( &s, path, threads );
+        ASSERT( errno == 0, s.length == n + 4,
+                memcmp( s.e, "head", 4 ) == 0,
+                memcmp( s.e + 4, xs, n ) == 0 );
+        stringm__free( &s );
+
+        // A string that already fits the file isn't grown to find its end:
+        StringM fit = stringm__new_empty( n );
+        size_t const capacity = fit.capacity;
+        errno = 0;
+        stringm__read_file_parallel( &fit, path, threads );
+        ASSERT( errno == 0, fit.length == n, fit.capacity == capacity,
+                memcmp( fit.e, xs, n ) == 0 );
+        stringm__free( &fit );
+    }
+
+    // A missing file leaves the string as it was:
+    StringM s = stringm__copy( ( StringC ) STRINGC( "head" ) );
+    errno = 0;
+    stringm__read_file( &s, "string-file-test.missing" );
+    ASSERT( errno == ENOENT, stringm__equal( s, "head" ) );
+
+    FILE * const empty = fopen( path, "wb" );
+    ASSERT( empty != NULL, fclose( empty ) == 0 );
+    errno = 0;
+    stringm__read_file( &s, path );
+    ASSERT( errno == 0, stringm__equal( s, "head" ) );
+    stringm__free( &s );
+    ASSERT( remove( path ) == 0 );
+    free( xs );
+}
+
+
+static
+void
+test_trace( void )
+{
+    stringtrace__reset();
+    StringC const x = STRINGC( "one\ntwo\nthree" );
+    ASSERT( stringc__count_byte( x, '\n' ) == 2,
+            stringc__count_byte( x, 'e' ) == 3,
+            stringc__count_lines( x ) == 3,
+            stringc__trim( x ).length == x.length );
+    StringM y = stringm__copy( x );
+    stringm__remove( &y, 'e' );
+    ASSERT( y.length == x.length - 3 );
+    stringm__free( &y );
+    FILE * const f = tmpfile();
+    ASSERT( f != NULL );
+    stringtrace__dump( f );
+    rewind( f );
+    char line[ 256 ];
+    size_t calls = 0;
+    size_t bytes = 0;
+    size_t trim_calls = 0;
+    size_t trim_bytes = 0;
+    size_t remove_calls = 0;
+    size_t remove_bytes = 0;
+    while ( fgets( line, sizeof line, f ) != NULL ) {
+        if ( strncmp( line, "stringc__count_byte ", 20 ) == 0 ) {
+            ASSERT( sscanf( line + 20, "%zu %zu", &calls, &bytes ) == 2 );
+        } else if ( strncmp( line, "stringc__trim ", 14 ) == 0 ) {
+            ASSERT( sscanf( line + 14, "%zu %zu",
+                            &trim_calls, &trim_bytes ) == 2 );
+        } else if ( strncmp( line, "stringm__remove ", 16 ) == 0 ) {
+            ASSERT( sscanf( line + 16, "%zu %zu",
+                            &remove_calls, &remove_bytes ) == 2 );
+        }
+    }
+    ASSERT( fclose( f ) == 0 );
+#ifdef STRING_TRACE
+    ASSERT( calls == 2, bytes == 2 * x.length,
+            trim_calls == 1, trim_bytes == x.length,
+            remove_calls == 1, remove_bytes == x.length );
+#else
+    ASSERT( calls == 0, trim_calls == 0, remove_calls == 0 );
+#endif
+}
+
+
+static
+void
+test_parse( void )
+{
+    uint64_t u = 7;
+    ASSERT( stringc__parse_u64( ( StringC ) STRINGC( "0" ), &u ) == 1,
+            u == 0,
+            stringc__parse_u64( ( StringC ) STRINGC( "12345678x" ), &u ) == 8,
+            u == 12345678,
+            stringc__parse_u64(
+                ( StringC ) STRINGC( "000000000000000000000042" ), &u ) == 24,
+            u == 42,
+            stringc__parse_u64(
+                ( StringC ) STRINGC( "18446744073709551615" ), &u ) == 20,
+            u == UINT64_MAX );
+    // Every length, to cover the eight-digit steps and what's left after:
+    char const * const digits = "1234567890123456789";
+    for ( size_t n = 1; n <= 19; n++ ) {
+        char buf[ 20 ] = { 0 };
+        memcpy( buf, digits, n );
+        ASSERT( stringc__parse_u64( stringc__new( digits, n ), &u ) == n,
+                u == strtoull( buf, NULL, 10 ) );
+    }
+    errno = 0;
+    ASSERT( stringc__parse_u64(
+                ( StringC ) STRINGC( "18446744073709551616" ), &u ) == 20,
+            errno == ERANGE, u == UINT64_MAX );
+    u = 7;
+    errno = 0;
+    ASSERT( stringc__parse_u64( ( StringC ) STRINGC( "-1" ), &u ) == 0,
+            errno == EINVAL, u == 7,
+            stringc__parse_u64( ( StringC ) STRINGC( "" ), &u ) == 0 );
+
+    int64_t i = 0;
+    ASSERT( stringc__parse_i64( ( StringC ) STRINGC( "-42 " ), &i ) == 3,
+            i == -42,
+            stringc__parse_i64( ( StringC ) STRINGC( "+42" ), &i ) == 3,
+            i == 42,
+            stringc__parse_i64(
+                ( StringC ) STRINGC( "-9223372036854775808" ), &i ) == 20,
+            i == INT64_MIN,
+            stringc__parse_i64(
+                ( StringC ) STRINGC( "9223372036854775807" ), &i ) == 19,
+            i == INT64_MAX );
+    errno = 0;
+    ASSERT( stringc__parse_i64(
+                ( StringC ) STRINGC( "9223372036854775808" ), &i ) == 19,
+            errno == ERANGE, i == INT64_MAX );
+    errno = 0;
+    ASSERT( stringc__parse_i64( ( StringC ) STRINGC( "-" ), &i ) == 0,
+            errno == EINVAL );
+
+    ASSERT( stringc__parse_hex_u64( ( StringC ) STRINGC( "ff" ), &u ) == 2,
+            u == 255,
+            stringc__parse_hex_u64(
+                ( StringC ) STRINGC( "DeadBeefCafeF00Dz" ), &u ) == 16,
+            u == UINT64_C( 0xDEADBEEFCAFEF00D ) );
+    errno = 0;
+    ASSERT( stringc__parse_hex_u64(
+                ( StringC ) STRINGC( "10000000000000000" ), &u ) == 17,
+            errno == ERANGE, u == UINT64_MAX );
+
+    double d = 0;
+    ASSERT( stringc__parse_double( ( StringC ) STRINGC( "1.5e3," ), &d ) == 5,
+            d == 1500.0,
+            stringc__parse_double( ( StringC ) STRINGC( "-.25" ), &d ) == 4,
+            d == -0.25,
+            stringc__parse_double( ( StringC ) STRINGC( "7." ), &d ) == 2,
+            d == 7.0,
+            stringc__parse_double( ( StringC ) STRINGC( "2e" ), &d ) == 1,
+            d == 2.0,
+            stringc__parse_double( ( StringC ) STRINGC( "-Infinity" ),
+                                   &d ) == 9,
+            d < 0, d * 0.5 == d,
+            stringc__parse_double( ( StringC ) STRINGC( "nan" ), &d ) == 3,
+            d != d );
+    errno = 0;
+    ASSERT( stringc__parse_double( ( StringC ) STRINGC( "." ), &d ) == 0,
+            errno == EINVAL );
+    errno = 0;
+    ASSERT( stringc__parse_double( ( StringC ) STRINGC( "1e400" ), &d ) == 5,
+            errno == ERANGE );
+
+    // Compare against `strtod()` on the shortest round-tripping forms of
+    // random doubles, and on long runs of digits that need the fallback:
+    char const * const cases[] = {
+        "2.2250738585072011e-308", "4.9e-324", "1.7976931348623157e308",
+        "9007199254740993", "0.1000000000000000055511151231257827",
+        "123456789012345678901234567890e-10", "1e23", "8.589973e9",
+        "2.47032822920623272088284396434110686182529901307162382212792841250"
+        "337753635104375932649918180817996189898282347722858865463328355177"
+        "969898199387398005390939063150356595155702263922908583924491051844"
+        "359318028499365361525003193704576782492193656236698636584807570015"
+        "857692699037063119282795585513329278343384093519780155312465972635"
+        "795746227664652728272200563740064854999770965994704540208281662262"
+        "378573934507363390079677619305775067401763246736009689513405355374"
+        "585166611342237666786041621596804619144672918403005300575308490487"
+        "653917113865916462395249126236538818796362393732804238910186723484"
+        "976682350898633885879256283027559956575244555072551893136908362547"
+        "791869486679949683240497058210285131854513962138377228261454376934"
+        "125320985913276672363281255e-324"
+    };
+    for ( size_t k = 0; k < sizeof cases / sizeof cases[ 0 ]; k++ ) {
+        StringC const x = stringc__new( cases[ k ], strlen( cases[ k ] ) );
+        ASSERT( stringc__parse_double( x, &d ) == x.length,
+                d == strtod( cases[ k ], NULL ) );
+    }
+    srand( 49 );
+    for ( size_t k = 0; k < 20000; k++ ) {
+        uint64_t bits = 0;
+        for ( size_t j = 0; j < 4; j++ ) {
+            bits = bits << 16 | ( uint64_t ) ( rand() & 0xFFFF );
+        }
+        double x;
+        memcpy( &x, &bits, sizeof x );
+        if ( x != x || x - x != 0 ) {
+            continue;
+        }
+        char buf[ 64 ];
+        int const n = snprintf( buf, sizeof buf, "%.*g",
+                                1 + ( int ) ( k % 17 ), x );
+        ASSERT( stringc__parse_double( stringc__new( buf, ( size_t ) n ),
+                                       &d ) == ( size_t ) n,
+                d == strtod( buf, NULL ) );
+    }
+}
+
+
+#define APPEND_THREADS 4
+#define APPEND_RECORDS 2000
+
+
+typedef struct append_job {
+    StringAppendBuffer * b;
+    char name;
+} AppendJob;
+
+
+static
+int
+append_thread(
+        void * const job_ )
+{
+    AppendJob const * const job = job_;
+    char record[ 17 ];
+    for ( size_t i = 0; i < APPEND_RECORDS; i++ ) {
+        snprintf( record, sizeof record, "%c%014zu\n", job->name, i );
+        while ( !stringappendbuffer__append(
+                    job->b, stringc__new( record, 16 ) ) ) {
+            ASSERT( errno == ENOBUFS );
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+
+static
+void
+test_append( void )
+{
+    StringAppendBuffer * const b = stringappendbuffer__new( 40 );
+    ASSERT( b != NULL,
+            stringappendbuffer__append( b, ( StringC ) STRINGC( "hello " ) ),
+            stringappendbuffer__append( b, ( StringC ) STRINGC( "world" ) ),
+            stringc__equal( stringappendbuffer__take( b ), "hello world" ),
+            stringc__is_empty( stringappendbuffer__take( b ) ) );
+    StringC const x = STRINGC( "0123456789012345678901234567890" );
+    errno = 0;
+    ASSERT( stringappendbuffer__append( b, x ),
+            !stringappendbuffer__append( b, x ), errno == ENOBUFS,
+            !stringappendbuffer__append( b, ( StringC ) STRINGC( "ab" ) ),
+            stringc__equal( stringappendbuffer__take( b ), x ),
+            stringappendbuffer__append( b, x ),
+            stringc__equal( stringappendbuffer__take( b ), x ) );
+    // A record that could never fit is refused without closing the segment:
+    StringC const y = STRINGC( "01234567890123456789012345678901234567890" );
+    errno = 0;
+    ASSERT( !stringappendbuffer__append( b, y ), errno == EMSGSIZE,
+            stringappendbuffer__append( b, x ),
+            stringc__equal( stringappendbuffer__take( b ), x ) );
+    stringappendbuffer__free( b );
+
+    // Take records while threads append them, and check that each thread's
+    // records all arrive whole and in order:
+    StringAppendBuffer * const shared = stringappendbuffer__new( 1000 );
+    AppendJob jobs[ APPEND_THREADS ];
+    thrd_t ts[ APPEND_THREADS ];
+    for ( size_t t = 0; t < APPEND_THREADS; t++ ) {
+        jobs[ t ] = ( AppendJob ){ .b = shared, .name = ( char ) ( 'a' + t ) };
+        ASSERT( thrd_create( &ts[ t ], append_thread, &jobs[ t ] )
+                == thrd_success );
+    }
+    size_t seen[ APPEND_THREADS ] = { 0 };
+    size_t total = 0;
+    while ( total < APPEND_THREADS * APPEND_RECORDS ) {
+        StringC const taken = stringappendbuffer__take( shared );
+        ASSERT( taken.length % 16 == 0 );
+        for ( size_t i = 0; i < taken.length; i += 16 ) {
+            size_t const t = ( size_t ) ( taken.e[ i ] - 'a' );
+            ASSERT( t < APPEND_THREADS, taken.e[ i + 15 ] == '\n',
+                    strtoull( taken.e + i + 1, NULL, 10 ) == seen[ t ] );
+            seen[ t ]++;
+            total++;
+        }
+    }
+    for ( size_t t = 0; t < APPEND_THREADS; t++ ) {
+        ASSERT( thrd_join( ts[ t ], NULL ) == thrd_success );
+    }
+    ASSERT( stringc__is_empty( stringappendbuffer__take( shared ) ) );
+    stringappendbuffer__free( shared );
+}
+
+
+static
+int
+pool_free_thread(
+        void * const buffers )
+{
+    StringM * const xs = buffers;
+    for ( size_t i = 0; i < 3; i++ ) {
+        stringpool__free( &xs[ i ] );
+    }
+    return 0;
+}
+
+
+static
+int
+pool_thread(
+        void * const buffer )
+{
+    StringM s = stringpool__new_empty( 1000 );
+    stringm__append( &s, 'x' );
+    *( char * * ) buffer = s.e;
+    stringpool__free( &s );
+    return 0;
+}
+
+
+static
+void
+test_pool( void )
+{
+    StringM a = stringpool__new_empty( 100 );
+    ASSERT( a.length == 0, a.capacity >= 100 );
+    char * const e = a.e;
+    stringm__append( &a, 'a' );
+    stringpool__free( &a );
+    ASSERT( a.e == NULL, a.capacity == 0 );
+    StringM b = stringpool__new_empty( 70 );
+    ASSERT( b.e == e, b.length == 0, b.capacity >= 100 );
+    stringpool__free( &b );
+
+    // A thread's buffers go to the global list when it exits:
+    char * from_thread = NULL;
+    thrd_t t;
+    ASSERT( thrd_create( &t, pool_thread, &from_thread ) == thrd_success,
+            thrd_join( t, NULL ) == thrd_success );
+    StringM c = stringpool__new_empty( 1000 );
+    ASSERT( c.e == from_thread, c.length == 0 );
+    stringpool__free( &c );
+
+    // Even if the thread only gave buffers back:
+    StringM given[ 3 ];
+    char * given_e[ 3 ];
+    for ( size_t i = 0; i < 3; i++ ) {
+        given[ i ] = stringm__new_empty( 5000 );
+        given_e[ i ] = given[ i ].e;
+    }
+    ASSERT( thrd_create( &t, pool_free_thread, given ) == thrd_success,
+            thrd_join( t, NULL ) == thrd_success );
+    StringM g = stringpool__new_empty( 4096 );
+    ASSERT( g.e == given_e[ 0 ] || g.e == given_e[ 1 ]
+            || g.e == given_e[ 2 ] );
+    stringpool__free( &g );
+
+    StringM big = stringpool__new_empty( STRING_POOL_MAX_CAPACITY + 1 );
+    ASSERT( big.capacity >= STRING_POOL_MAX_CAPACITY + 1 );
+    stringpool__free( &big );
+
+    // A buffer with room for 63 elements can't be given out for 64:
+    StringM small = stringm__new_empty( 63 );
+    stringpool__free( &small );
+    StringM d = stringpool__new_empty( 64 );
+    char * const de = d.e;
+    for ( size_t i = 0; i < 64; i++ ) {
+        stringm__append( &d, 'd' );
+    }
+    ASSERT( d.e == de, d.length == 64 );
+    stringpool__free( &d );
+    stringpool__clear();
 }
 
 
@@ -69,8 +1463,48 @@ main( void )
     puts( "  property tests passed" );
     test_nullterm();
     puts( "  nullterm tests passed" );
+    test_ownership();
+    puts( "  ownership tests passed" );
     test_replace();
     puts( "  replace tests passed" );
+    test_trim();
+    puts( "  trim tests passed" );
+    test_remove();
+    puts( "  remove tests passed" );
+    test_case();
+    puts( "  case tests passed" );
+    test_counting();
+    puts( "  counting tests passed" );
+    test_escape();
+    puts( "  escape tests passed" );
+    test_base64_hex();
+    puts( "  base64 and hex tests passed" );
+    test_sort();
+    puts( "  sort tests passed" );
+    test_distance();
+    puts( "  distance tests passed" );
+    test_table();
+    puts( "  table tests passed" );
+    test_index();
+    puts( "  index tests passed" );
+    test_suffix();
+    puts( "  suffix array tests passed" );
+    test_symbols();
+    puts( "  symbol table tests passed" );
+    test_regex();
+    puts( "  regex tests passed" );
+    test_keywords();
+    puts( "  keyword tests passed" );
+    test_pool();
+    puts( "  pool tests passed" );
+    test_append();
+    puts( "  append buffer tests passed" );
+    test_file();
+    puts( "  file tests passed" );
+    test_trace();
+    puts( "  trace tests passed" );
+    test_parse();
+    puts( "  parse tests passed" );
     puts( "All tests passed!" );
 
 }
@@ -0,0 +1,500 @@
+
+// Copyright 2015  Malcolm Inglis <http://minglis.id.au>
+//
+// This file is part of Libstring.
+//
+// Libstring is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Affero General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// Libstring is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Libstring. If not, see <https://gnu.org/licenses/>.
+
+
+// Generates a minimal perfect hash function for a set of keywords, as a
+// C header and source file. Run it as:
+//
+//     keywords [-I INCLUDE] KEYWORDS NAME OUT
+//
+// where `KEYWORDS` is a file of one keyword per line, optionally followed
+// by whitespace and the name of its enumerator; blank lines and lines
+// starting with `#` are skipped, and any other line that starts with
+// whitespace, or that's longer than `LINE_MAX_LENGTH` bytes before its
+// newline, is an error. This writes `OUT.h`, declaring:
+//
+//     enum NAME { NAME_FOO, NAME_BAR, ..., NAME_COUNT };
+//     extern StringC const NAME__names[ NAME_COUNT ];
+//     int NAME__lookup( StringC );
+//
+// (with the enumerators in upper case), and `OUT.c`, defining them.
+// `NAME__lookup()` returns the enumerator of the given keyword, or -1 if
+// it isn't one, by hashing it once and then comparing it to the only
+// keyword it could be. The generated header includes `INCLUDE` for the
+// `StringC` type, which defaults to `<libstring/string.h>`.
+//
+// Keys are hashed with a seeded FNV-1a hash, and put into buckets by the
+// high half of it. The buckets are placed from largest to smallest, each
+// with the first displacement that moves all of its keys into free slots
+// (as in "hash, displace, and compress", by Belazzougui et al.).
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>     // PRIu64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define KEYWORDS_MAX 65536
+#define DISPLACEMENTS_MAX ( UINT32_C( 1 ) << 24 )
+#define SEEDS_MAX 64
+#define LINE_MAX_LENGTH 4095
+
+
+// The hash functions, which are also written into the generated source, as
+// `hash_functions` below; the two must be kept the same (which the tests
+// would notice if they weren't).
+
+static
+uint64_t
+keyword_hash(
+        char const * const xs,
+        size_t const length,
+        uint64_t const seed )
+{
+    uint64_t h = UINT64_C( 14695981039346656037 ) ^ seed;
+    for ( size_t i = 0; i < length; i++ ) {
+        h = ( h ^ ( unsigned char ) xs[ i ] ) * UINT64_C( 1099511628211 );
+    }
+    h ^= h >> 33;
+    h *= UINT64_C( 0xff51afd7ed558ccd );
+    h ^= h >> 33;
+    return h;
+}
+
+
+static
+uint32_t
+keyword_slot(
+        uint64_t const h,
+        uint32_t const displacement,
+        uint32_t const slots )
+{
+    uint32_t x = ( uint32_t ) h ^ displacement;
+    x ^= x >> 16;
+    x *= UINT32_C( 0x85ebca6b );
+    x ^= x >> 13;
+    x *= UINT32_C( 0xc2b2ae35 );
+    x ^= x >> 16;
+    return x % slots;
+}
+
+
+static char const hash_functions[] =
+    "static\n"
+    "uint64_t\n"
+    "keyword_hash(\n"
+    "        char const * const xs,\n"
+    "        size_t const length,\n"
+    "        uint64_t const seed )\n"
+    "{\n"
+    "    uint64_t h = UINT64_C( 14695981039346656037 ) ^ seed;\n"
+    "    for ( size_t i = 0; i < length; i++ ) {\n"
+    "        h = ( h ^ ( unsigned char ) xs[ i ] ) "
+            "* UINT64_C( 1099511628211 );\n"
+    "    }\n"
+    "    h ^= h >> 33;\n"
+    "    h *= UINT64_C( 0xff51afd7ed558ccd );\n"
+    "    h ^= h >> 33;\n"
+    "    return h;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "static\n"
+    "uint32_t\n"
+    "keyword_slot(\n"
+    "        uint64_t const h,\n"
+    "        uint32_t const displacement,\n"
+    "        uint32_t const slots )\n"
+    "{\n"
+    "    uint32_t x = ( uint32_t ) h ^ displacement;\n"
+    "    x ^= x >> 16;\n"
+    "    x *= UINT32_C( 0x85ebca6b );\n"
+    "    x ^= x >> 13;\n"
+    "    x *= UINT32_C( 0xc2b2ae35 );\n"
+    "    x ^= x >> 16;\n"
+    "    return x % slots;\n"
+    "}\n";
+
+
+typedef struct keyword {
+    char * text;
+    size_t length;
+    char * name;
+    uint64_t hash;
+} Keyword;
+
+
+static
+void
+die(
+        char const * const message,
+        char const * const detail )
+{
+    fprintf( stderr, "keywords: %s%s%s\n", message,
+             detail ? ": " : "", detail ? detail : "" );
+    exit( EXIT_FAILURE );
+}
+
+
+static
+void
+die_at(
+        char const * const message,
+        char const * const path,
+        size_t const line_number )
+{
+    fprintf( stderr, "keywords: %s:%zu: %s\n", path, line_number, message );
+    exit( EXIT_FAILURE );
+}
+
+
+static
+void *
+xalloc(
+        size_t const n,
+        size_t const size )
+{
+    void * const p = calloc( n ? n : 1, size );
+    if ( p == NULL ) { die( "out of memory", NULL ); }
+    return p;
+}
+
+
+static
+char *
+xstrndup(
+        char const * const xs,
+        size_t const length )
+{
+    char * const r = xalloc( length + 1, 1 );
+    memcpy( r, xs, length );
+    return r;
+}
+
+
+// Reads the keywords in `path` into `*keywords`, and returns how many
+// there are.
+static
+size_t
+read_keywords(
+        char const * const path,
+        char const * const prefix,
+        Keyword * * const keywords )
+{
+    FILE * const f = fopen( path, "r" );
+    if ( f == NULL ) { die( strerror( errno ), path ); }
+    Keyword * const ks = xalloc( KEYWORDS_MAX, sizeof *ks );
+    size_t n = 0;
+    size_t line_number = 0;
+    char line[ LINE_MAX_LENGTH + 2 ];
+    while ( fgets( line, sizeof line, f ) != NULL ) {
+        line_number++;
+        if ( strchr( line, '\n' ) == NULL && !feof( f ) ) {
+            die_at( "line too long", path, line_number );
+        }
+        size_t const indent = strspn( line, " \t\r\n" );
+        if ( line[ indent ] == '\0' || line[ indent ] == '#' ) { continue; }
+        if ( indent > 0 ) {
+            die_at( "keyword is indented", path, line_number );
+        }
+        size_t const length = strcspn( line, " \t\r\n" );
+        if ( n == KEYWORDS_MAX ) { die( "too many keywords", path ); }
+        Keyword * const k = &ks[ n++ ];
+        k->text = xstrndup( line, length );
+        k->length = length;
+        char const * name = line + length;
+        name += strspn( name, " \t" );
+        size_t const name_length = strcspn( name, " \t\r\n" );
+        if ( name_length > 0 ) {
+            k->name = xstrndup( name, name_length );
+        } else {
+            // Make the name from the prefix and the keyword:
+            size_t const plen = strlen( prefix );
+            k->name = xalloc( plen + 1 + length + 1, 1 );
+            for ( size_t i = 0; i < plen; i++ ) {
+                unsigned char const c = ( unsigned char ) prefix[ i ];
+                k->name[ i ] = ( char ) toupper( c );
+            }
+            k->name[ plen ] = '_';
+            for ( size_t i = 0; i < length; i++ ) {
+                unsigned char const c = ( unsigned char ) line[ i ];
+                k->name[ plen + 1 + i ] = isalnum( c ) ? ( char ) toupper( c )
+                                                       : '_';
+            }
+        }
+        for ( size_t i = 0; i < n - 1; i++ ) {
+            if ( ks[ i ].length == length
+              && memcmp( ks[ i ].text, k->text, length ) == 0 ) {
+                die( "duplicate keyword", k->text );
+            }
+        }
+    }
+    if ( ferror( f ) ) { die( strerror( errno ), path ); }
+    fclose( f );
+    if ( n == 0 ) { die( "no keywords", path ); }
+    *keywords = ks;
+    return n;
+}
+
+
+typedef struct bucket {
+    uint32_t index;
+    uint32_t size;
+    uint32_t * keys;
+} Bucket;
+
+
+static
+int
+bucket__compare_size(
+        void const * const a,
+        void const * const b )
+{
+    Bucket const * const x = a;
+    Bucket const * const y = b;
+    return ( x->size < y->size ) - ( x->size > y->size );
+}
+
+
+// Tries to place the keywords into `n` slots with `seed`, setting
+// `displacements` (for each of `nb` buckets) and `ids` (for each slot).
+static
+bool
+place(
+        Keyword * const ks,
+        uint32_t const n,
+        uint32_t const nb,
+        uint64_t const seed,
+        uint32_t * const displacements,
+        uint32_t * const ids )
+{
+    Bucket * const buckets = xalloc( nb, sizeof *buckets );
+    uint32_t * const members = xalloc( n, sizeof *members );
+    uint32_t * const slots = xalloc( n, sizeof *slots );
+    bool * const taken = xalloc( n, sizeof *taken );
+    for ( uint32_t i = 0; i < nb; i++ ) {
+        buckets[ i ].index = i;
+    }
+    for ( uint32_t k = 0; k < n; k++ ) {
+        ks[ k ].hash = keyword_hash( ks[ k ].text, ks[ k ].length, seed );
+        buckets[ ( ks[ k ].hash >> 32 ) % nb ].size++;
+    }
+    uint32_t offset = 0;
+    for ( uint32_t i = 0; i < nb; i++ ) {
+        buckets[ i ].keys = members + offset;
+        offset += buckets[ i ].size;
+        buckets[ i ].size = 0;
+    }
+    for ( uint32_t k = 0; k < n; k++ ) {
+        Bucket * const b = &buckets[ ( ks[ k ].hash >> 32 ) % nb ];
+        b->keys[ b->size++ ] = k;
+    }
+    qsort( buckets, nb, sizeof *buckets, bucket__compare_size );
+    bool ok = true;
+    for ( uint32_t i = 0; ok && i < nb && buckets[ i ].size > 0; i++ ) {
+        Bucket const b = buckets[ i ];
+        uint32_t d = 0;
+        for ( ; d < DISPLACEMENTS_MAX; d++ ) {
+            uint32_t j = 0;
+            for ( ; j < b.size; j++ ) {
+                uint32_t const s = keyword_slot( ks[ b.keys[ j ] ].hash, d, n );
+                bool collides = taken[ s ];
+                for ( uint32_t m = 0; m < j && !collides; m++ ) {
+                    collides = slots[ m ] == s;
+                }
+                if ( collides ) { break; }
+                slots[ j ] = s;
+            }
+            if ( j == b.size ) { break; }
+        }
+        if ( d == DISPLACEMENTS_MAX ) {
+            ok = false;
+            break;
+        }
+        displacements[ b.index ] = d;
+        for ( uint32_t j = 0; j < b.size; j++ ) {
+            taken[ slots[ j ] ] = true;
+            ids[ slots[ j ] ] = b.keys[ j ];
+        }
+    }
+    free( buckets );
+    free( members );
+    free( slots );
+    free( taken );
+    return ok;
+}
+
+
+static
+void
+write_literal(
+        FILE * const f,
+        Keyword const k )
+{
+    fputc( '"', f );
+    for ( size_t i = 0; i < k.length; i++ ) {
+        unsigned char const c = ( unsigned char ) k.text[ i ];
+        if ( c == '"' || c == '\\' ) {
+            fprintf( f, "\\%c", c );
+        } else if ( isprint( c ) ) {
+            fputc( c, f );
+        } else {
+            fprintf( f, "\\%03o", c );
+        }
+    }
+    fputc( '"', f );
+}
+
+
+static
+FILE *
+open_output(
+        char const * const out,
+        char const * const extension,
+        char * * const path )
+{
+    *path = xalloc( strlen( out ) + strlen( extension ) + 1, 1 );
+    strcat( strcat( *path, out ), extension );
+    FILE * const f = fopen( *path, "w" );
+    if ( f == NULL ) { die( strerror( errno ), *path ); }
+    return f;
+}
+
+
+static
+void
+close_output(
+        FILE * const f,
+        char const * const path )
+{
+    if ( ferror( f ) || fclose( f ) != 0 ) { die( strerror( errno ), path ); }
+}
+
+
+int
+main(
+        int const argc,
+        char * const * const argv )
+{
+    char const * include = "<libstring/string.h>";
+    int a = 1;
+    if ( argc > 2 && strcmp( argv[ 1 ], "-I" ) == 0 ) {
+        include = argv[ 2 ];
+        a = 3;
+    }
+    if ( argc - a != 3 ) {
+        die( "usage: keywords [-I INCLUDE] KEYWORDS NAME OUT", NULL );
+    }
+    char const * const input = argv[ a ];
+    char const * const name = argv[ a + 1 ];
+    char const * const out = argv[ a + 2 ];
+
+    size_t const plen = strlen( name );
+    char * const upper = xalloc( plen + 1, 1 );
+    for ( size_t i = 0; i < plen; i++ ) {
+        upper[ i ] = ( char ) toupper( ( unsigned char ) name[ i ] );
+    }
+
+    Keyword * ks;
+    uint32_t const n = ( uint32_t ) read_keywords( input, name, &ks );
+    uint32_t const nb = ( n + 3 ) / 4;
+    uint32_t * const displacements = xalloc( nb, sizeof *displacements );
+    uint32_t * const ids = xalloc( n, sizeof *ids );
+    uint64_t seed = 0;
+    while ( !place( ks, n, nb, seed, displacements, ids ) ) {
+        if ( ++seed == SEEDS_MAX ) {
+            die( "couldn't find a perfect hash function", input );
+        }
+    }
+    size_t min_length = SIZE_MAX;
+    size_t max_length = 0;
+    for ( uint32_t k = 0; k < n; k++ ) {
+        min_length = ks[ k ].length < min_length ? ks[ k ].length : min_length;
+        max_length = ks[ k ].length > max_length ? ks[ k ].length : max_length;
+    }
+
+    char * hpath;
+    FILE * const h = open_output( out, ".h", &hpath );
+    fprintf( h, "// Generated by `keywords` from `%s`; don't edit.\n\n",
+             input );
+    fprintf( h, "#ifndef %s_KEYWORDS_H\n#define %s_KEYWORDS_H\n\n\n",
+             upper, upper );
+    fprintf( h, "#include %s\n\n\n", include );
+    fprintf( h, "enum %s {\n", name );
+    for ( uint32_t k = 0; k < n; k++ ) {
+        fprintf( h, "    %s,\n", ks[ k ].name );
+    }
+    fprintf( h, "    %s_COUNT\n};\n\n\n", upper );
+    fprintf( h, "// The keyword of each `enum %s`.\n", name );
+    fprintf( h, "extern StringC const %s__names[ %s_COUNT ];\n\n\n",
+             name, upper );
+    fprintf( h, "// Returns the `enum %s` of the given keyword, or -1 if it "
+                "isn't one.\n", name );
+    fprintf( h, "int\n%s__lookup(\n        StringC );\n\n\n#endif\n\n", name );
+    close_output( h, hpath );
+
+    char const * const base = strrchr( out, '/' ) ? strrchr( out, '/' ) + 1
+                                                  : out;
+    char * cpath;
+    FILE * const c = open_output( out, ".c", &cpath );
+    fprintf( c, "// Generated by `keywords` from `%s`; don't edit.\n\n",
+             input );
+    fprintf( c, "#include \"%s.h\"\n\n#include <stdint.h>\n\n\n", base );
+    fprintf( c, "StringC const %s__names[ %s_COUNT ] = {\n", name, upper );
+    for ( uint32_t k = 0; k < n; k++ ) {
+        fputs( "    STRINGC( ", c );
+        write_literal( c, ks[ k ] );
+        fputs( " ),\n", c );
+    }
+    fputs( "};\n\n\n", c );
+    fprintf( c, "static uint32_t const displacements[ %u ] = {\n", nb );
+    for ( uint32_t i = 0; i < nb; i++ ) {
+        fprintf( c, "%s%u,%s", ( i % 8 == 0 ) ? "    " : " ",
+                 displacements[ i ],
+                 ( i % 8 == 7 || i + 1 == nb ) ? "\n" : "" );
+    }
+    fputs( "};\n\n\n", c );
+    fprintf( c, "static uint32_t const ids[ %u ] = {\n", n );
+    for ( uint32_t i = 0; i < n; i++ ) {
+        fprintf( c, "%s%u,%s", ( i % 8 == 0 ) ? "    " : " ",
+                 ids[ i ], ( i % 8 == 7 || i + 1 == n ) ? "\n" : "" );
+    }
+    fputs( "};\n\n\n", c );
+    fputs( hash_functions, c );
+    fprintf( c, "\n\n"
+                "int\n"
+                "%s__lookup(\n"
+                "        StringC const xs )\n"
+                "{\n"
+                "    if ( xs.length < %zu || xs.length > %zu ) { return -1; }\n"
+                "    uint64_t const h = keyword_hash( xs.e, xs.length, "
+                        "%" PRIu64 " );\n"
+                "    uint32_t const d = displacements[ ( h >> 32 ) %% %u ];\n"
+                "    uint32_t const id = ids[ keyword_slot( h, d, %u ) ];\n"
+                "    return stringc__equal( xs, %s__names[ id ] ) "
+                        "? ( int ) id : -1;\n"
+                "}\n\n",
+             name, min_length, max_length, seed, nb, n, name );
+    close_output( c, cpath );
+    return EXIT_SUCCESS;
+}